@@ -0,0 +1,194 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <boost/coroutine2/coroutine.hpp>
+
+#include "async_connection.h"
+#include "co_stack.h"
+#include "co_task.h"
+#include "connection.h"
+#include "connection_pool.h"
+
+/**
+ * @brief Compare the connection models: the cost of suspending and resuming a connection
+ * coroutine, and the memory a parked connection holds
+ *
+ * Each model parks the given number of coroutines the way a connection waits for its
+ * socket, then resumes every one of them round after round. The stackful coroutines run
+ * on regions of a connection pool like the connections do, the stackless ones on frames
+ * of the frame pool. The resident bytes are measured on the process once the coroutines
+ * are parked, the connection object is added to them.
+ *
+ * usage: coroutine_bench [connections] [rounds] [stack size]
+ */
+
+namespace {
+
+using push_type = boost::coroutines2::coroutine<void>::push_type;
+using pull_type = boost::coroutines2::coroutine<void>::pull_type;
+
+/**
+ * @brief Get the resident bytes of the process
+ */
+size_t resident()
+{
+    std::ifstream statm{ "/proc/self/statm" };
+    size_t size = 0;
+    size_t pages = 0;
+    statm >> size >> pages;
+    return pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * @brief The stackful coroutine, placed above its stack like a connection
+ */
+class fiber
+{
+public:
+    fiber(void * stack, size_t stack_size)
+        : source_{ co_stack{ stack, stack_size }, [this](pull_type & sink) {
+            sink_ = &sink;
+            while (true) {
+                sink();
+            }
+        } }
+    {
+    }
+
+    void resume()
+    {
+        source_();
+    }
+
+private:
+    pull_type *sink_{ nullptr };  ///< the pull type
+    push_type  source_;           ///< the push type
+};
+
+/**
+ * @brief The awaiter parking a stackless coroutine, keeps its handle like a connection
+ */
+struct park
+{
+    std::coroutine_handle<> &waiting;  ///< the parked coroutine
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) noexcept { waiting = h; }
+
+    void await_resume() const noexcept { }
+};
+
+/**
+ * @brief The stackless coroutine, parks itself in a loop
+ */
+co_task<> parked(std::coroutine_handle<> & waiting)
+{
+    while (true) {
+        co_await park{ waiting };
+    }
+}
+
+/**
+ * @brief Print the results of a model, \b reserved is 0 if the model maps nothing ahead
+ */
+void report(const char * model, size_t connections, size_t rounds, std::chrono::nanoseconds elapsed, size_t resident_bytes, size_t object_size, size_t reserved)
+{
+    auto const switches = static_cast<double>(connections * rounds);
+    std::cout << model << ": " << static_cast<double>(elapsed.count()) / switches << " ns per resume and suspend, "
+              << resident_bytes / connections + object_size << " bytes resident per connection";
+    if (reserved != 0) {
+        std::cout << ", " << reserved << " bytes reserved per connection";
+    }
+
+    std::cout << std::endl;
+}
+
+void bench_stackful(size_t connections, size_t rounds, size_t stack_size)
+{
+    connection_pool pool{ stack_size, sizeof(connection), 0 };
+    std::vector<char *> stacks;
+    std::vector<fiber *> fibers;
+    stacks.reserve(connections);
+    fibers.reserve(connections);
+
+    // park the coroutines, each one enters its stack once
+    auto const before = resident();
+    for (size_t i = 0; i < connections; ++i) {
+        auto const stack = static_cast<char *>(pool.acquire());
+        auto const f = ::new(stack + pool.stack_size()) fiber{ stack, pool.stack_size() };
+        f->resume();
+        stacks.push_back(stack);
+        fibers.push_back(f);
+    }
+
+    auto const after = resident();
+
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (auto const f : fibers) {
+            f->resume();
+        }
+    }
+
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    auto const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto const reserved = (page_size + pool.stack_size() + sizeof(connection) + page_size - 1) & ~(page_size - 1);
+    report("stackful", connections, rounds, elapsed, after > before ? after - before : 0, 0, reserved);
+
+    for (size_t i = 0; i < connections; ++i) {
+        fibers[i]->~fiber();
+        pool.release(stacks[i], pool.stack_size());
+    }
+}
+
+void bench_stackless(size_t connections, size_t rounds)
+{
+    std::vector<co_task<>> tasks;
+    std::vector<std::coroutine_handle<>> waiting(connections);
+    tasks.reserve(connections);
+
+    // park the coroutines, each one runs up to its first wait
+    auto const before = resident();
+    for (size_t i = 0; i < connections; ++i) {
+        tasks.push_back(parked(waiting[i]));
+        tasks.back().handle().resume();
+    }
+
+    auto const after = resident();
+
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (auto const h : waiting) {
+            h.resume();
+        }
+    }
+
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    report("stackless", connections, rounds, elapsed, after > before ? after - before : 0, sizeof(async_connection), 0);
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    auto const connections = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000ul;
+    auto const rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100ul;
+    auto const stack_size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 256ul * 1024;
+    if (connections == 0 || rounds == 0) {
+        std::cerr << "usage: " << argv[0] << " [connections] [rounds] [stack size]" << std::endl;
+        return 1;
+    }
+
+    std::cout << connections << " connections, " << rounds << " rounds" << std::endl;
+    bench_stackful(connections, rounds, stack_size);
+    bench_stackless(connections, rounds);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ipam.h"
+
+/**
+ * @brief Measure the ipam address allocation from a /24 pool up to a /8 pool
+ *
+ * For each prefix length a pool is created and filled lowest first the way the endpoint
+ * addresses are requested, then a sample of addresses spread over the full pool is
+ * released and requested again by address, the way the endpoints come and go. The bitmap
+ * bytes of the full pool are printed with the times.
+ *
+ * usage: ipam_bench [longest prefix] [shortest prefix] [churn addresses]
+ */
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+double per_operation(bench_clock::duration elapsed, size_t count)
+{
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(count);
+}
+
+bool bench(int length, size_t churn)
+{
+    ipam addresses;
+    ipv4_prefix pool;
+    auto const pool_text = "10.0.0.0/" + std::to_string(length);
+    if (addresses.request_pool(pool_text, pool) != ipam::result::ok) {
+        std::cerr << pool_text << ": pool refused" << std::endl;
+        return false;
+    }
+
+    // fill the pool, lowest free address first
+    ipv4_prefix allocated;
+    size_t filled = 0;
+    auto start = bench_clock::now();
+    while (addresses.request_address(pool_text, { }, allocated) == ipam::result::ok) {
+        ++filled;
+    }
+
+    auto const fill = bench_clock::now() - start;
+
+    // the churn sample, every step-th address of the full pool
+    auto const sample = churn < filled ? churn : filled;
+    auto const step = filled / sample;
+    std::vector<std::string> sampled;
+    sampled.reserve(sample);
+    for (size_t i = 0; i < sample; ++i) {
+        char text[INET_ADDRSTRLEN];
+        auto const addr = in_addr{ htonl(pool.address + 1 + static_cast<uint32_t>(i * step)) };
+        sampled.emplace_back(inet_ntop(AF_INET, &addr, text, sizeof text));
+    }
+
+    start = bench_clock::now();
+    for (auto const & a : sampled) {
+        addresses.release_address(pool_text, a);
+    }
+
+    for (auto const & a : sampled) {
+        addresses.request_address(pool_text, a, allocated);
+    }
+
+    auto const churned = bench_clock::now() - start;
+    std::cout << pool_text << ": " << filled << " addresses, fill " << per_operation(fill, filled)
+              << " ns per address, churn " << per_operation(churned, sample * 2)
+              << " ns per release or request, " << addresses.memory() << " bitmap bytes" << std::endl;
+    return addresses.address_count() == filled;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    auto const longest = argc > 1 ? std::atoi(argv[1]) : 24;
+    auto const shortest = argc > 2 ? std::atoi(argv[2]) : ipam::min_length;
+    auto const churn = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 65536ul;
+    if (longest > 30 || shortest < ipam::min_length || shortest > longest || churn == 0) {
+        std::cerr << "usage: " << argv[0] << " [longest prefix] [shortest prefix] [churn addresses]" << std::endl;
+        return 1;
+    }
+
+    for (auto length = longest; length >= shortest; --length) {
+        if (!bench(length, churn)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
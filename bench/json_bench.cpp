@@ -0,0 +1,109 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "json_binder.h"
+#include "json_parser.h"
+#include "plugin_api.h"
+
+/**
+ * @brief Measure the plugin request parsing on the payloads dockerd sends
+ *
+ * Every payload of the payload directory is bound to its request struct the way a plugin
+ * handler receives it, once fed whole and once in fragments of the given size, the way
+ * a body arrives split over several reads. The fragments cut the tokens and go through
+ * the scratch buffer of the parser.
+ *
+ * usage: json_bench [iterations] [fragment size] [payload directory]
+ */
+
+namespace {
+
+/**
+ * @brief Read a payload, empty if missing
+ */
+std::string load(const std::string & directory, const char * name)
+{
+    std::ifstream file{ directory + "/" + name, std::ios::binary };
+    return { std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{ } };
+}
+
+/**
+ * @brief Parse a payload into a request struct
+ *
+ * @return true if the document is valid and binds a valid request
+ */
+template <typename Request>
+bool parse(std::string_view payload, size_t fragment)
+{
+    json_parser parser;
+    json_binder<Request> binder;
+    while (!payload.empty()) {
+        auto const n = payload.size() < fragment ? payload.size() : fragment;
+        if (!parser.feed(payload.substr(0, n), binder)) {
+            return false;
+        }
+
+        payload.remove_prefix(n);
+    }
+
+    return parser.finish(binder) && binder.target().valid();
+}
+
+template <typename Request>
+void bench(const std::string & directory, const char * name, size_t iterations, size_t fragment)
+{
+    auto const payload = load(directory, name);
+    if (payload.empty()) {
+        std::cerr << name << ": missing in " << directory << std::endl;
+        return;
+    }
+
+    std::cout << name << " (" << payload.size() << " bytes):";
+    for (auto const size : { payload.size(), fragment }) {
+        if (!parse<Request>(payload, size)) {
+            std::cout << " rejected" << std::endl;
+            return;
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            parse<Request>(payload, size);
+        }
+
+        auto const elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        auto const per_document = elapsed / static_cast<double>(iterations);
+        std::cout << (size == payload.size() ? " whole " : " split ") << per_document << " ns "
+                  << static_cast<double>(payload.size()) * 1000.0 / per_document << " MB/s";
+    }
+
+    std::cout << std::endl;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    auto const iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000ul;
+    auto const fragment = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16ul;
+    std::string const directory = argc > 3 ? argv[3] : JSON_BENCH_PAYLOADS;
+    if (iterations == 0 || fragment == 0) {
+        std::cerr << "usage: " << argv[0] << " [iterations] [fragment size] [payload directory]" << std::endl;
+        return 1;
+    }
+
+    std::cout << iterations << " iterations, " << fragment << " byte fragments" << std::endl;
+    bench<create_network_request>(directory, "create_network.json", iterations, fragment);
+    bench<delete_network_request>(directory, "delete_network.json", iterations, fragment);
+    bench<create_endpoint_request>(directory, "create_endpoint.json", iterations, fragment);
+    bench<join_request>(directory, "join.json", iterations, fragment);
+    bench<endpoint_request>(directory, "leave.json", iterations, fragment);
+    bench<request_pool_request>(directory, "request_pool.json", iterations, fragment);
+    bench<address_request>(directory, "request_address.json", iterations, fragment);
+    bench<address_request>(directory, "release_address.json", iterations, fragment);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "address_bitmap.h"
+
+address_bitmap::address_bitmap(size_t size)
+    : size_{ size }
+{
+    // a level of words per 64 words below, up to a single word
+    auto words = (size + 63) / 64;
+    levels_.emplace_back(words, 0);
+    while (words > 1) {
+        words = (words + 63) / 64;
+        levels_.emplace_back(words, 0);
+    }
+
+    // the bits past the end of each level are set so the search never picks them, a word
+    // filled by them is full in the level above
+    auto bits = size;
+    for (size_t level = 0; level < levels_.size(); ++level) {
+        auto & words = levels_[level];
+        if (bits % 64 != 0) {
+            words.back() |= full << (bits % 64);
+        }
+
+        if (level + 1 < levels_.size()) {
+            for (size_t i = 0; i < words.size(); ++i) {
+                if (words[i] == full) {
+                    levels_[level + 1][i / 64] |= uint64_t{ 1 } << (i % 64);
+                }
+            }
+        }
+
+        bits = words.size();
+    }
+}
+
+size_t address_bitmap::allocate()
+{
+    if (levels_.back()[0] == full) {
+        return npos;
+    }
+
+    // the first clear bit of each level names the word to look at in the level below
+    size_t index = 0;
+    for (auto level = levels_.size(); level-- > 0; ) {
+        auto const word = levels_[level][index];
+        index = index * 64 + static_cast<size_t>(__builtin_ctzll(~word));
+    }
+
+    set(index);
+    return index;
+}
+
+bool address_bitmap::allocate(size_t index)
+{
+    if (index >= size_ || test(index)) {
+        return false;
+    }
+
+    set(index);
+    return true;
+}
+
+bool address_bitmap::release(size_t index)
+{
+    if (!test(index)) {
+        return false;
+    }
+
+    // a full word gets a clear bit, the words above stop being full
+    for (auto & words : levels_) {
+        auto & word = words[index / 64];
+        auto const was_full = word == full;
+        word &= ~(uint64_t{ 1 } << (index % 64));
+        if (!was_full) {
+            break;
+        }
+
+        index /= 64;
+    }
+
+    --used_;
+    return true;
+}
+
+size_t address_bitmap::memory() const
+{
+    size_t bytes = 0;
+    for (auto const & words : levels_) {
+        bytes += words.capacity() * sizeof(uint64_t);
+    }
+
+    return bytes;
+}
+
+void address_bitmap::set(size_t index)
+{
+    // a word becoming full sets its bit in the level above
+    for (auto & words : levels_) {
+        auto & word = words[index / 64];
+        word |= uint64_t{ 1 } << (index % 64);
+        if (word != full) {
+            break;
+        }
+
+        index /= 64;
+    }
+
+    ++used_;
+}
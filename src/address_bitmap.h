@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The hierarchical bitmap allocator of a range of indexes
+ *
+ * The leaf level has a bit per index, set when the index is allocated. Each upper level
+ * has a bit per word of the level below, set when that word is full, up to a single top
+ * word. The lowest free index is found by descending from the top word and taking the
+ * first clear bit of one word per level with tzcnt, four words for the 2^24 addresses of
+ * a /8. Allocating and releasing touch one word per level at most.
+ */
+class address_bitmap
+{
+public:
+    static constexpr size_t npos = SIZE_MAX;  ///< no index
+
+    /**
+     * @brief Construct a new address bitmap object, every index free
+     *
+     * @param size the number of indexes, at least 1
+     */
+    explicit address_bitmap(size_t size);
+
+    /**
+     * @brief Allocate the lowest free index
+     *
+     * @return size_t the index, npos if every index is allocated
+     */
+    size_t allocate();
+
+    /**
+     * @brief Allocate an index
+     *
+     * @param index the index
+     * @return true if the index was free
+     */
+    bool allocate(size_t index);
+
+    /**
+     * @brief Release an index
+     *
+     * @param index the index
+     * @return true if the index was allocated
+     */
+    bool release(size_t index);
+
+    /**
+     * @brief Check if an index is allocated
+     */
+    bool test(size_t index) const;
+
+    /**
+     * @brief Get the number of indexes
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the number of allocated indexes
+     */
+    size_t used() const;
+
+    /**
+     * @brief Get the bytes held by the levels
+     */
+    size_t memory() const;
+
+private:
+    /**
+     * @brief Set a leaf bit and mark the words it fills in the upper levels
+     */
+    void set(size_t index);
+
+    static constexpr uint64_t full = ~uint64_t{ 0 };  ///< a word without a clear bit
+
+    std::vector<std::vector<uint64_t>> levels_{ };  ///< the levels, the leaves first, the last one is one word
+    size_t                             size_{ 0 };  ///< the number of indexes
+    size_t                             used_{ 0 };  ///< the allocated indexes
+};
+
+inline bool address_bitmap::test(size_t index) const
+{
+    return index < size_ && (levels_[0][index / 64] >> (index % 64) & 1) != 0;
+}
+
+inline size_t address_bitmap::size() const
+{
+    return size_;
+}
+
+inline size_t address_bitmap::used() const
+{
+    return used_;
+}
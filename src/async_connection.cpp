@@ -0,0 +1,190 @@
+#include "async_connection.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+#include "frame_pool.h"
+#include "server.h"
+
+async_connection::async_connection(server & server, int fd)
+    : connection_base{ server, fd }
+    , completion_{ server.dispatcher().completes_io() }
+    , task_{ run() }
+    , waiting_{ task_.handle() }
+{
+}
+
+void async_connection::on_timer()
+{
+    connection_base::on_timer();
+
+    // the request uses the buffers of the connection until it completes
+    if (timed_out_ && status_ == status::waiting_on_io) {
+        server_.dispatcher().cancel(static_cast<io_request &>(*this));
+    }
+}
+
+void async_connection::on_complete()
+{
+    if (status_ == status::waiting_on_io) {
+        resume();
+    }
+}
+
+int async_connection::events() const
+{
+    return completion_ ? 0 : connection_base::events();
+}
+
+void async_connection::destroy()
+{
+    deallocate(this);
+}
+
+co_task<> async_connection::run()
+{
+    try {
+        for (auto a = next(); a != action::close; a = next()) {
+            switch (a) {
+            case action::receive:
+                received(co_await recv());
+                break;
+
+            case action::send:
+                co_await send();
+                break;
+
+            case action::wait_response:
+                co_await ready(status::waiting_on_response);
+                break;
+
+            case action::wait_sync:
+                co_await ready(status::waiting_on_sync);
+                break;
+
+            case action::close:
+                break;
+            }
+        }
+    } catch (...) {
+        log_error();
+    }
+
+    finish();
+}
+
+co_task<size_t> async_connection::recv()
+{
+    if (completion_) {
+        // hold no buffer while idle, the ring lends one once data arrives, or the receive
+        // buffer is filled in place if the ring ran dry
+        auto & dispatcher = server_.dispatcher();
+        buffer_.release();
+        set_deadline(deadline::read_idle, idle_timeout_);
+        dispatcher.receive(*this, *this);
+        co_await ready(status::waiting_on_io);
+        if (result() == -ENOBUFS) {
+            auto const data = buffer_.prepare();
+            dispatcher.receive(*this, data, buffer_.free_size(), *this);
+            co_await ready(status::waiting_on_io);
+        }
+
+        clear_deadline(deadline::read_idle);
+        if (result() < 0) {
+            throw std::system_error{ -result(), std::system_category(), "cannot receive data" };
+        }
+
+        // the buffer of the ring goes back once on_complete returns
+        auto const n = static_cast<size_t>(result());
+        if (!data()) {
+            buffer_.commit(n);
+            co_return n;
+        }
+
+        for (size_t copied = 0; copied < n; ) {
+            auto const dst = buffer_.prepare();
+            auto const len = std::min(buffer_.free_size(), n - copied);
+            memcpy(dst, data() + copied, len);
+            buffer_.commit(len);
+            copied += len;
+        }
+
+        co_return n;
+    }
+
+    do {
+        auto const data = buffer_.prepare();
+        auto const n = ::recv(fd(), data, buffer_.free_size(), 0);
+        if (n >= 0) {
+            clear_deadline(deadline::read_idle);
+            buffer_.commit(n);
+            co_return static_cast<size_t>(n);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // hold no buffer while idle
+            buffer_.release();
+
+            set_deadline(deadline::read_idle, idle_timeout_);
+            co_await ready(status::waiting_on_read);
+        } else {
+            throw std::system_error{ errno, std::system_category(), "cannot receive data" };
+        }
+    } while (true);
+}
+
+co_task<> async_connection::send()
+{
+    if (completion_) {
+        // the message lives in the frame until the send completes
+        iovec iov[response_writer::max_iov];
+        msghdr msg{ };
+        msg.msg_iov = iov;
+        auto & output = exchange_->output;
+        while (!output.empty()) {
+            msg.msg_iovlen = output.gather(iov);
+            server_.dispatcher().send(*this, msg, *this);
+            co_await ready(status::waiting_on_io);
+            if (result() > 0) {
+                output.advance(static_cast<size_t>(result()));
+            } else if (result() == 0) {
+                throw std::runtime_error{ "cannot send data" };
+            } else {
+                throw std::system_error{ -result(), std::system_category(), "cannot send data" };
+            }
+        }
+
+        co_return;
+    }
+
+    auto & output = exchange_->output;
+    while (!output.empty()) {
+        auto const n = output.write(fd());
+        if (n > 0) {
+            continue;
+        } else if (n == 0) {
+            throw std::runtime_error{ "cannot send data" };
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            co_await ready(status::waiting_on_write);
+        } else {
+            throw std::system_error{ errno, std::system_category(), "cannot send data" };
+        }
+    }
+}
+
+async_connection * async_connection::allocate(server & server, int sock)
+{
+    auto const mem = frame_pool::allocate(sizeof(async_connection));
+    return ::new(mem) async_connection{ server, sock };
+}
+
+void async_connection::deallocate(async_connection * conn)
+{
+    // destroy connection object, its coroutine frames go back to the pool
+    conn->~async_connection();
+    frame_pool::deallocate(conn, sizeof(async_connection));
+}
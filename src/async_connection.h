@@ -0,0 +1,202 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <coroutine>
+#include <cstddef>
+
+#include "co_task.h"
+#include "connection_base.h"
+#include "io_request.h"
+
+/**
+ * @brief the connection, runs on stackless coroutines
+ *
+ * The connection, its coroutine frames and its receive buffer come from the frame
+ * pool. The receive buffer is held only while a request is in progress, an idle
+ * keep-alive connection costs the connection object and a few frames.
+ *
+ * On the io_uring backend the socket is not polled, the connection is itself the
+ * io_request of its receives and sends. A receive waits in a buffer of the ring, copied
+ * into the receive buffer once data arrives, and a send submits the gathered queue, the
+ * requests of every connection are submitted together once per loop iteration.
+ */
+class async_connection
+    : public connection_base
+    , public io_request
+{
+    friend server;
+
+    /**
+     * @brief The awaiter suspending the coroutine until the socket is ready
+     */
+    class ready_awaiter
+    {
+    public:
+        ready_awaiter(async_connection & conn, status status);
+
+        bool await_ready() const noexcept;
+
+        void await_suspend(std::coroutine_handle<> h) noexcept;
+
+        void await_resume() const;
+
+    private:
+        async_connection &conn_;    ///< the connection
+        status            status_;  ///< the waiting status
+    };
+
+public:
+    /**
+     * @brief Move constructor is deleted
+     */
+    async_connection(async_connection &&) noexcept = delete;
+
+    /**
+     * @brief Move assignment is deleted
+     */
+    void operator=(async_connection &&) noexcept = delete;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    async_connection(const async_connection &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const async_connection &) = delete;
+
+protected:
+    /**
+     * @brief Construct a new async connection object
+     *
+     * @param server the server object
+     * @param fd the file descriptor
+     */
+    async_connection(server & server, int fd);
+
+    /**
+     * @brief Destroy the async connection object
+     */
+    ~async_connection() override = default;
+
+    /**
+     * @brief Run the connection coroutine, performs the actions of the request state machine
+     */
+    co_task<> run();
+
+    /**
+     * @brief The on timer callback, a timed out receive or send is cancelled and throws
+     * once completed
+     */
+    void on_timer() override;
+
+    /**
+     * @brief The on complete callback, resumes the coroutine waiting for the receive or
+     * the send
+     */
+    void on_complete() override;
+
+    /**
+     * @brief Get the events the socket is subscribed with, none if it receives and sends
+     * with io_request objects
+     */
+    int events() const override;
+
+    /**
+     * @brief Resume the suspended coroutine
+     */
+    void resume() override;
+
+    /**
+     * @brief Deallocate the connection
+     */
+    void destroy() override;
+
+    /**
+     * @brief Wait until the socket is ready
+     *
+     * @param status the waiting status, waiting_on_read, waiting_on_write, waiting_on_io,
+     * waiting_on_sync or waiting_on_response
+     * @return ready_awaiter the awaiter, throws on resume if a deadline has passed
+     */
+    ready_awaiter ready(status status);
+
+    /**
+     * @brief Receive data from the socket into the receive buffer, the read idle deadline
+     * applies while waiting, a buffer holding no request is released while waiting
+     *
+     * @return co_task<size_t> the received data length, 0 if the peer closed the connection
+     */
+    co_task<size_t> recv();
+
+    /**
+     * @brief Send the queued responses to the socket
+     *
+     * @return co_task<> completes when the queue is empty
+     */
+    co_task<> send();
+
+    /**
+     * @brief Allocate a new async connection object from the frame pool
+     *
+     * @param server the server object
+     * @param sock the socket file descriptor
+     * @return async_connection* the pointer to the connection object
+     */
+    static async_connection * allocate(server & server, int sock);
+
+    /**
+     * @brief Deallocate the async connection object
+     *
+     * @param conn the pointer to the connection object
+     */
+    static void deallocate(async_connection * conn);
+
+private:
+    bool                    completion_;  ///< the socket is received from and sent to with io_request objects
+    co_task<>               task_;        ///< the connection coroutine
+    std::coroutine_handle<> waiting_{ };  ///< the suspended coroutine
+};
+
+inline async_connection::ready_awaiter::ready_awaiter(async_connection & conn, status status)
+    : conn_{ conn }
+    , status_{ status }
+{
+}
+
+inline bool async_connection::ready_awaiter::await_ready() const noexcept
+{
+    return false;
+}
+
+inline void async_connection::ready_awaiter::await_suspend(std::coroutine_handle<> h) noexcept
+{
+    conn_.status_ = status_;
+    conn_.waiting_ = h;
+}
+
+inline void async_connection::ready_awaiter::await_resume() const
+{
+    // a timed out deferred response is answered with the 504 queued in its place
+    if (status_ != status::waiting_on_response) {
+        conn_.check_timeout();
+    }
+}
+
+inline async_connection::ready_awaiter async_connection::ready(status status)
+{
+    return ready_awaiter{ *this, status };
+}
+
+inline void async_connection::resume()
+{
+    // set the status
+    status_ = status::running;
+
+    // take back the cpu
+    auto const h = waiting_;
+    waiting_ = { };
+    h.resume();
+}
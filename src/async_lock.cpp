@@ -0,0 +1,53 @@
+#include "async_lock.h"
+
+bool async_mutex::lock(async_waiter & w)
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (!locked_) {
+        locked_ = true;
+        return true;
+    }
+
+    waiters_.push_back(w);
+    return false;
+}
+
+bool async_mutex::try_lock()
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (locked_) {
+        return false;
+    }
+
+    locked_ = true;
+    return true;
+}
+
+void async_mutex::unlock()
+{
+    async_waiter * next = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        if (waiters_.empty()) {
+            locked_ = false;
+            return;
+        }
+
+        // the mutex goes to the oldest waiter and stays locked, no caller overtakes it
+        next = &waiters_.front();
+        waiters_.pop_front();
+    }
+
+    next->wake();
+}
+
+bool async_mutex::cancel(async_waiter & w)
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (!w.list_hook_.is_linked()) {
+        return false;
+    }
+
+    waiters_.erase(waiters_.iterator_to(w));
+    return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <mutex>
+
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/list_hook.hpp>
+
+#include "event_dispatcher.h"
+#include "task_queue.h"
+
+class async_mutex;
+
+/**
+ * @brief The waiter of an async mutex, the node of its wait list
+ *
+ * The waiter is provided by the caller and lives until the wait is over, a wait allocates
+ * nothing. Once the wait is over the waiter is posted to its dispatcher as a task and
+ * on_run is called on the dispatcher thread, whichever thread ended the wait. A wait
+ * ended on the dispatcher thread itself is run later in the same loop iteration, without
+ * waking the dispatcher through its eventfd.
+ */
+class async_waiter
+    : public task
+{
+    friend async_mutex;
+
+    using list_hook = boost::intrusive::list_member_hook<>;
+
+public:
+    /**
+     * @brief Construct a new async waiter object
+     *
+     * @param dispatcher the dispatcher on_run is called on
+     */
+    explicit async_waiter(event_dispatcher & dispatcher);
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    async_waiter(const async_waiter &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const async_waiter &) = delete;
+
+    /**
+     * @brief Get the dispatcher on_run is called on
+     */
+    event_dispatcher & dispatcher() const;
+
+protected:
+    /**
+     * @brief Wake up the waiter on its dispatcher
+     */
+    void wake();
+
+private:
+    list_hook         list_hook_{ };  ///< the list hook
+    event_dispatcher &dispatcher_;    ///< the dispatcher of the waiter
+
+    using wait_list = boost::intrusive::list
+        < async_waiter
+        , boost::intrusive::member_hook
+            < async_waiter
+            , list_hook
+            , &async_waiter::list_hook_
+            >
+        >;
+};
+
+/**
+ * @brief The mutex of the event dispatcher threads
+ *
+ * The owner holds it across suspension points, a lock waiting for the owner parks the
+ * waiter in a FIFO wait list instead of blocking its thread, and an unlock hands the mutex
+ * to the first waiter rather than to the next caller, so the waiters are served in order
+ * and none starves. The mutex may be shared by dispatcher threads, the list is guarded by
+ * a mutex held for a few pointer updates only.
+ */
+class async_mutex
+{
+public:
+    async_mutex() = default;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    async_mutex(const async_mutex &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const async_mutex &) = delete;
+
+    /**
+     * @brief Lock the mutex
+     *
+     * @param w the waiter, parked if the mutex is locked
+     * @return true if locked, on_run is not called
+     * @return false if parked, on_run is called once the waiter owns the mutex
+     */
+    bool lock(async_waiter & w);
+
+    /**
+     * @brief Lock the mutex if it is unlocked
+     *
+     * @return true if locked
+     */
+    bool try_lock();
+
+    /**
+     * @brief Unlock the mutex, handed to the first waiter if any
+     */
+    void unlock();
+
+    /**
+     * @brief Stop waiting
+     *
+     * @param w the parked waiter
+     * @return true if the waiter left the list, on_run is not called
+     * @return false if the mutex was handed over already, on_run is called
+     */
+    bool cancel(async_waiter & w);
+
+private:
+    std::mutex              mutex_{ };         ///< guards the owner flag and the wait list
+    bool                    locked_{ false };  ///< the mutex has an owner
+    async_waiter::wait_list waiters_{ };       ///< the waiters, oldest first
+};
+
+inline async_waiter::async_waiter(event_dispatcher & dispatcher)
+    : dispatcher_{ dispatcher }
+{
+}
+
+inline event_dispatcher & async_waiter::dispatcher() const
+{
+    return dispatcher_;
+}
+
+inline void async_waiter::wake()
+{
+    dispatcher_.post(*this);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+
+class http_request;
+class http_response;
+
+/**
+ * @brief The receiver of a streamed request body
+ *
+ * A route streaming its body creates a consumer once the request header is parsed. The
+ * body fragments are passed to it as they are parsed and are not kept in the receive
+ * buffer. The consumer builds the response once the request is complete.
+ */
+class body_consumer
+{
+public:
+    /**
+     * @brief Consume a body fragment
+     *
+     * @param data the fragment
+     * @return true to continue, false to reject the request with 400
+     */
+    virtual bool on_body(std::string_view data) = 0;
+
+    /**
+     * @brief Build the response of the complete request
+     *
+     * @param request the request, its body is empty
+     * @param response the response
+     * @return true if the request is handled
+     */
+    virtual bool on_complete(const http_request &request, http_response *response) = 0;
+
+    /**
+     * @brief Destroy the consumer and release its memory
+     */
+    virtual void destroy() = 0;
+
+protected:
+    ~body_consumer() = default;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "frame_pool.h"
+
+template <typename T = void>
+class co_task;
+
+namespace detail {
+
+/**
+ * @brief The promise part shared by all task types, the continuation, the exception and
+ * the pooled frame allocation
+ */
+class co_promise_base
+{
+    /**
+     * @brief The final awaiter, transfers control to the awaiting coroutine
+     */
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) const noexcept
+        {
+            auto const continuation = h.promise().continuation_;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+public:
+    static void * operator new(size_t size)
+    {
+        return frame_pool::allocate(size);
+    }
+
+    static void operator delete(void * p, size_t size) noexcept
+    {
+        frame_pool::deallocate(p, size);
+    }
+
+    std::suspend_always initial_suspend() const noexcept { return { }; }
+
+    final_awaiter final_suspend() const noexcept { return { }; }
+
+    void unhandled_exception() noexcept
+    {
+        exception_ = std::current_exception();
+    }
+
+    /**
+     * @brief Set the coroutine resumed when the task completes
+     *
+     * @param continuation the awaiting coroutine
+     */
+    void set_continuation(std::coroutine_handle<> continuation) noexcept
+    {
+        continuation_ = continuation;
+    }
+
+    /**
+     * @brief Rethrow the exception the task completed with, if any
+     */
+    void rethrow() const
+    {
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+private:
+    std::coroutine_handle<> continuation_{ };  ///< the awaiting coroutine, none for a top level task
+    std::exception_ptr      exception_{ };     ///< the exception the task completed with
+};
+
+template <typename T>
+class co_promise
+    : public co_promise_base
+{
+public:
+    co_task<T> get_return_object() noexcept;
+
+    void return_value(T value)
+    {
+        value_ = std::move(value);
+    }
+
+    T result()
+    {
+        rethrow();
+        return std::move(value_);
+    }
+
+private:
+    T value_{ };  ///< the task result
+};
+
+template <>
+class co_promise<void>
+    : public co_promise_base
+{
+public:
+    co_task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept { }
+
+    void result() const
+    {
+        rethrow();
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief The lazily started stackless coroutine task
+ *
+ * The task owns its frame, it starts when awaited and resumes the awaiting coroutine
+ * by symmetric transfer when it completes, so a chain of awaited tasks never grows the
+ * thread stack. A top level task is started with start() and stays suspended at its
+ * end until the task object is destroyed. The frames come from the frame pool.
+ *
+ * @tparam T the result type
+ */
+template <typename T>
+class [[nodiscard]] co_task
+{
+public:
+    using promise_type = detail::co_promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    co_task() = default;
+
+    explicit co_task(handle_type handle) noexcept
+        : handle_{ handle }
+    {
+    }
+
+    ~co_task()
+    {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    co_task(co_task && other) noexcept
+        : handle_{ std::exchange(other.handle_, { }) }
+    {
+    }
+
+    co_task & operator=(co_task && other) noexcept
+    {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+
+            handle_ = std::exchange(other.handle_, { });
+        }
+
+        return *this;
+    }
+
+    co_task(const co_task &) = delete;
+
+    void operator=(const co_task &) = delete;
+
+    /**
+     * @brief Get the coroutine handle
+     */
+    handle_type handle() const noexcept
+    {
+        return handle_;
+    }
+
+    /**
+     * @brief Check if the task has completed
+     */
+    bool done() const noexcept
+    {
+        return !handle_ || handle_.done();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().set_continuation(awaiting);
+        return handle_;
+    }
+
+    T await_resume()
+    {
+        return handle_.promise().result();
+    }
+
+private:
+    handle_type handle_{ };  ///< the coroutine frame
+};
+
+namespace detail {
+
+template <typename T>
+inline co_task<T> co_promise<T>::get_return_object() noexcept
+{
+    return co_task<T>{ co_task<T>::handle_type::from_promise(*this) };
+}
+
+inline co_task<void> co_promise<void>::get_return_object() noexcept
+{
+    return co_task<void>{ co_task<void>::handle_type::from_promise(*this) };
+}
+
+} // namespace detail
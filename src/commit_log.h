@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief The log a handler's changes are appended to before its response is sent
+ *
+ * The records are numbered in append order. A connection whose handler left records
+ * that are not on stable storage parks its response, the server syncs the log once per
+ * event loop iteration for all parked connections and resumes them, so one flush covers
+ * every request of the iteration.
+ */
+class commit_log
+{
+public:
+    /**
+     * @brief Get the sequence number of the last appended record, may be called from any thread
+     */
+    virtual uint64_t appended() const = 0;
+
+    /**
+     * @brief Get the sequence number of the last record on stable storage, may be called
+     * from any thread
+     */
+    virtual uint64_t synced() const = 0;
+
+    /**
+     * @brief Write the appended records and flush them to stable storage, may be called
+     * from any thread, returns at once if another thread synced them already
+     *
+     * @return true if every record appended before the call is on stable storage
+     */
+    virtual bool sync() = 0;
+
+    /**
+     * @brief Check if a flush failed, may be called from any thread
+     *
+     * The records past the last synced one may be lost whatever a later flush reports, so
+     * the log never syncs again and every response waiting on it fails.
+     */
+    virtual bool failed() const = 0;
+
+protected:
+    ~commit_log() = default;
+};
@@ -1,120 +1,90 @@
 #include "connection.h"
 
-#include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-#include <iostream>
+#include <stdexcept>
 #include <system_error>
 
-#include "http_request.h"
 #include "server.h"
-
-template <typename Receiver>
-void recv_http_request(http_request &request, Receiver &&receiver)
-{
-    while (!request.is_completed()) {
-        char buf[1024];
-        auto const n = std::forward<Receiver>(receiver)(buf, sizeof buf);
-        if (n == 0) {
-            throw std::runtime_error{ "connection closed by peer" };
-        }
-
-        auto const err = request.parse(buf, n);
-        if (err < 0) {
-            throw std::runtime_error{ "cannot parse http request" };
-        }
-    }
-}
+#include "stack_profile.h"
 
 connection::connection(server & server, int fd, size_t stack_size)
-    : io_listener{ fd }
+    : connection_base{ server, fd }
     , stack_size_{ stack_size }
     , source_{ get_stack() , [this](pull_type & sink) {
         this->sink_ = &sink;
         this->run();
     } }
-    , server_{ server }
 {
 }
 
-void connection::on_read()
+void connection::destroy()
 {
-    if (status_ == status::waiting_on_read) {
-        resume();
-    }
+    deallocate(this);
 }
 
-void connection::on_write()
+void connection::sample_stack_usage()
 {
-    if (status_ == status::waiting_on_write) {
-        resume();
+    auto const stack = reinterpret_cast<char *>(this) - stack_size_;
+    auto const used = stack_profile::measure(stack, stack_size_);
+    if (!last_uri_.empty()) {
+        server_.record_stack_usage(last_uri_, used);
+    }
+
+    // the frames below this one are gone, the margin leaves room for the calls from here
+    auto const live = static_cast<char *>(__builtin_frame_address(0)) - live_margin;
+    auto const deepest = stack + (stack_size_ - used);
+    if (deepest < live) {
+        stack_profile::fill(deepest, static_cast<size_t>(live - deepest));
     }
 }
 
 void connection::run()
 {
-    try{
-        // receive http request
-        http_request request;
-        recv_http_request(request, [this](void * buf, size_t len) {
-            return recv(buf, len);
-        });
-
-        // find uri handler
-        auto const handler = server_.find_uri_handler(request.url());
-        if (handler) {
-            // create http response
-            http_response response;
-            auto const ok = (*handler)(this, request, &response);
-
-            if (ok) {
-                // construct http response header
-                char buf[1024];
-                auto const n = snprintf(buf, sizeof buf, "HTTP/1.1 %u OK\r\nContent-Length: %zu\r\n\r\n%s",
-                    response.status(), response.body().size(), response.body().data());
-
-                // send http response header
-                send(buf, n);
-
-                // send http response body
-                send(response.body().data(), response.body().size());
-            } else {
-                // send http response
-                std::string resp = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
-                send(resp.data(), resp.size());
+    try {
+        for (auto a = next(); a != action::close; a = next()) {
+            switch (a) {
+            case action::receive:
+                received(recv());
+                break;
+
+            case action::send:
+                send();
+                break;
+
+            case action::wait_response:
+                yield(status::waiting_on_response);
+                break;
+
+            case action::wait_sync:
+                yield(status::waiting_on_sync);
+                break;
+
+            case action::close:
+                break;
             }
-
-        } else {
-            // send http response
-            std::string resp = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-            send(resp.data(), resp.size());
         }
-    } catch (std::system_error const & e) {
-        std::cerr << "system error: " << e.what() << std::endl;
-    } catch (std::runtime_error const & e) {
-        std::cerr << "runtime error: " << e.what() << std::endl;
-    } catch (std::exception const & e) {
-        std::cerr << "exception: " << e.what() << std::endl;
     } catch (...) {
-        std::cerr << "unknown exception" << std::endl;
+        log_error();
     }
 
-    // close connection
-    server_.move_to_closing(*this);
-
-    // set status
-    status_ = status::closing;
+    finish();
 }
 
-ssize_t connection::recv(void * buf, size_t len)
+size_t connection::recv()
 {
     do {
-        auto const n = ::recv(fd(), buf, len, 0);
+        auto const data = buffer_.prepare();
+        auto const n = ::recv(fd(), data, buffer_.free_size(), 0);
         if (n >= 0) {
-            return n;
+            clear_deadline(deadline::read_idle);
+            buffer_.commit(n);
+            return static_cast<size_t>(n);
         } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            set_deadline(deadline::read_idle, idle_timeout_);
             yield(status::waiting_on_read);
+            check_timeout();
             continue;
         } else {
             throw std::system_error{ errno, std::system_category(), "cannot receive data" };
@@ -122,83 +92,57 @@ ssize_t connection::recv(void * buf, size_t len)
     } while (true);
 }
 
-ssize_t connection::send(const void * buf, size_t len)
+void connection::send()
 {
-    auto curr = static_cast<const char *>(buf);
-    auto const end = curr + len;
-
-    while (curr < end) {
-        auto const n = ::send(fd(), curr, end - curr, 0);
+    auto & output = exchange_->output;
+    while (!output.empty()) {
+        auto const n = output.write(fd());
         if (n > 0) {
-            curr += n;
+            continue;
         } else if (n == 0) {
             throw std::runtime_error{ "cannot send data" };
         } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
             yield(status::waiting_on_write);
+            check_timeout();
         } else {
             throw std::system_error{ errno, std::system_category(), "cannot send data" };
         }
     }
-
-    return len;
 }
 
-connection * connection::allocate(server &server, int sock, size_t stack_size)
+connection * connection::allocate(server &server, int sock)
 {
-    // get page size
-    auto const page_size = sysconf(_SC_PAGESIZE);
-
-    // get page mask
-    auto const page_mask = page_size - 1;
-
-    // align stack size to page size
-    stack_size = (stack_size + page_mask) & ~page_mask;
+    // take a region from the pool
+    auto & pool = server.pool();
+    auto const stack = static_cast<char *>(pool.acquire());
 
-    // calculate total size, add one page at the top of the stack as guard page
-    auto total_size = page_size + stack_size + sizeof(connection);
-
-    // align to page size
-    total_size = (total_size + page_mask) & ~page_mask;
-
-    // allocate memory
-    auto const mem = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (mem == MAP_FAILED) {
-        throw std::system_error{ errno, std::system_category(), "cannot allocate memory" };
-    }
-
-    // set guard page unreadable and unwritable
-    if (mprotect(mem, page_size, PROT_NONE) < 0) {
-        munmap(mem, total_size);
-        throw std::system_error{ errno, std::system_category(), "cannot set guard page unreadable and unwritable" };
+    // mark the stack to measure its usage on deallocation
+    if (server.stack_usage()) {
+        stack_profile::fill(stack, pool.stack_size());
     }
 
     // create connection object at then bottom of the stack
-    auto const conn = ::new(static_cast<char *>(mem) + page_size + stack_size) connection{ server, sock, stack_size };
+    auto const conn = ::new(stack + pool.stack_size()) connection{ server, sock, pool.stack_size() };
     return conn;
 }
 
 void connection::deallocate(connection * conn)
 {
-    // get page size
-    auto const page_size = sysconf(_SC_PAGESIZE);
-
-    // get page mask
-    auto const page_mask = page_size - 1;
-
-    // calculate total size, add one page at the top of the stack as guard page
-    auto total_size = page_size + conn->stack_size_ + sizeof(connection);
-
-    // align to page size
-    total_size = (total_size + page_mask) & ~page_mask;
-
-    // calculate start of memory
-    auto const mem = reinterpret_cast<char *>(conn) - page_size - conn->stack_size_;
+    // calculate start of stack
+    auto & server = conn->server_;
+    auto const stack = reinterpret_cast<char *>(conn) - conn->stack_size_;
+    auto const stack_size = conn->stack_size_;
+
+    // measure how deep the coroutine went since the last request started
+    if (server.stack_usage()) {
+        server.record_stack_usage(conn->last_uri_, stack_profile::measure(stack, stack_size));
+    }
 
     // destroy connection object
     conn->~connection();
 
-    // deallocate memory
-    munmap(mem, total_size);
+    // give the region back to the pool
+    server.pool().release(stack, stack_size);
 }
 
 inline co_stack connection::get_stack()
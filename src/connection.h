@@ -1,30 +1,19 @@
 #pragma once
+#include <cstdint>
+
 #include <boost/coroutine2/coroutine.hpp>
-#include <boost/intrusive/list.hpp>
-#include <boost/intrusive/list_hook.hpp>
 
 #include "co_stack.h"
-#include "event_dispatcher.h"
-
-class server;
+#include "connection_base.h"
 
 /**
- * @brief the connection
+ * @brief the connection, runs on a stackful coroutine
  */
 class connection
-    : public io_listener
+    : public connection_base
 {
     friend server;
 
-    enum class status : uint8_t
-    {
-        running,
-        waiting_on_read,
-        waiting_on_write,
-        closing
-    };
-
-    using list_hook = boost::intrusive::list_member_hook<>;
     using stack     = boost::coroutines2::fixedsize_stack;
     using push_type = boost::coroutines2::coroutine<void>::push_type;
     using pull_type = boost::coroutines2::coroutine<void>::pull_type;
@@ -66,17 +55,7 @@ protected:
     ~connection() = default;
 
     /**
-     * @brief The on read callback
-     */
-    void on_read() override;
-
-    /**
-     * @brief The on write callback
-     */
-    void on_write() override;
-
-    /**
-     * @brief Run the connection coroutine
+     * @brief Run the connection coroutine, performs the actions of the request state machine
      */
     void run();
 
@@ -90,38 +69,43 @@ protected:
     /**
      * @brief Resume the connection coroutine
      */
-    void resume();
+    void resume() override;
 
     /**
-     * @brief Receive data from the socket
-     *
-     * @param buf the buffer
-     * @param len the buffer length
-     * @return ssize_t the received data length
+     * @brief Deallocate the connection
      */
-    ssize_t recv(void * buf, size_t len);
+    void destroy() override;
 
     /**
-     * @brief Send data to the socket
+     * @brief Record how deep the previous request went, the stack below the calling frame
+     * is marked again so the next request is measured on its own
+     */
+    void sample_stack_usage() override;
+
+    /**
+     * @brief Receive data from the socket into the receive buffer, the read idle deadline
+     * applies while waiting
      *
-     * @param buf the buffer
-     * @param len the buffer length
-     * @return ssize_t the sent data length
+     * @return size_t the received data length, 0 if the peer closed the connection
      */
-    ssize_t send(const void * buf, size_t len);
+    size_t recv();
 
     /**
-     * @brief Allocate a new connection object
+     * @brief Send the queued responses to the socket, the queue is empty on return
+     */
+    void send();
+
+    /**
+     * @brief Allocate a new connection object from the connection pool of the server
      *
      * @param server the server object
      * @param sock the socket file descriptor
-     * @param stack_size the stack size
      * @return connection* the pointer to the connection object
      */
-    static connection * allocate(server &server, int sock, size_t stack_size);
+    static connection * allocate(server &server, int sock);
 
     /**
-     * @brief Deallocate the connection object
+     * @brief Deallocate the connection object, its region goes back to the connection pool
      *
      * @param conn the pointer to the connection object
      */
@@ -135,12 +119,11 @@ protected:
     co_stack get_stack();
 
 private:
-    list_hook  list_hook_{ };               ///< the list hook
-    size_t     stack_size_{ 0 };            ///< the stack size
-    push_type  source_;                     ///< the push type
-    pull_type *sink_{ nullptr };            ///< the pull type
-    status     status_{ status::running };  ///< the status
-    server    &server_;                     ///< the server
+    static constexpr size_t live_margin = 2048;  ///< the stack below the sampling frame left unmarked, room for its calls
+
+    size_t      stack_size_{ 0 };  ///< the stack size
+    push_type   source_;           ///< the push type
+    pull_type  *sink_{ nullptr };  ///< the pull type
 };
 
 inline void connection::yield(status status)
@@ -0,0 +1,582 @@
+#include "connection_base.h"
+
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#include "body_consumer.h"
+#include "frame_pool.h"
+#include "http_response.h"
+#include "response_writer.h"
+#include "server.h"
+
+namespace {
+
+/**
+ * @brief Get the Connection header line of a response, http/1.0 keeps the connection open
+ * only on request
+ */
+http_response::connection_header connection_header_of(const http_request & request, bool keep_alive)
+{
+    using connection_header = http_response::connection_header;
+    if (!keep_alive) {
+        return connection_header::close;
+    }
+
+    return request.http_major() == 1 && request.http_minor() == 0 ? connection_header::keep_alive : connection_header::none;
+}
+
+/**
+ * @brief The owner of a deferred response its connection stopped waiting for, the handler
+ * keeps filling it and the response is freed once completed
+ */
+class orphan_response final
+    : public response_listener
+{
+public:
+    explicit orphan_response(std::unique_ptr<http_response> response)
+        : response_{ std::move(response) }
+    {
+        // the body written straight into the send buffer goes nowhere
+        response_->listen(*this);
+        response_->bind(sink_);
+    }
+
+    http_response * on_response_deferred(http_response && response) override
+    {
+        response_ = std::make_unique<http_response>(std::move(response));
+        return response_.get();
+    }
+
+    void on_response_completed() override
+    {
+        delete this;
+    }
+
+private:
+    std::unique_ptr<http_response> response_;  ///< the response
+    std::string                    sink_{ };   ///< the output of the response
+};
+
+}
+
+connection_base::connection_base(server & server, int fd)
+    : io_listener{ fd }
+    , server_{ server }
+{
+}
+
+connection_base::~connection_base()
+{
+    release_exchange();
+    release_consumer();
+    if (deferred_ && deferred_->is_deferred()) {
+        abandon_response();
+    }
+}
+
+int connection_base::events() const
+{
+    return event_dispatcher::readable | event_dispatcher::writable;
+}
+
+void connection_base::sample_stack_usage()
+{
+}
+
+void connection_base::on_read()
+{
+    if (status_ == status::waiting_on_read) {
+        resume();
+    }
+}
+
+void connection_base::on_write()
+{
+    if (status_ == status::waiting_on_write) {
+        resume();
+    }
+}
+
+void connection_base::on_timer()
+{
+    static const char * const names[deadline_count] = {
+        "read idle timeout",
+        "request header timeout",
+        "request timeout",
+        "log sync timeout"
+    };
+
+    // find the passed deadline
+    auto const now = event_dispatcher::now();
+    for (auto i = 0u; i < deadline_count; ++i) {
+        if (deadlines_[i] != 0 && deadlines_[i] <= now) {
+            timed_out_ = names[i];
+            break;
+        }
+    }
+
+    if (!timed_out_) {
+        update_timer();
+        return;
+    }
+
+    // wake up the coroutine, it throws from recv or send
+    if (status_ == status::waiting_on_read || status_ == status::waiting_on_write) {
+        resume();
+        return;
+    }
+
+    // the handler is left to complete its response alone, the client gets a 504 in its
+    // place and the connection closes after it
+    if (status_ == status::waiting_on_response) {
+        abandon_response();
+        deferred_ = std::make_unique<http_response>();
+        deferred_->status(504);
+        resume();
+        return;
+    }
+
+    // the records may still be synced, the connection closes without waiting for it
+    if (status_ == status::waiting_on_sync) {
+        server_.unpark(*this);
+        resume();
+    }
+}
+
+http_response * connection_base::on_response_deferred(http_response && response)
+{
+    deferred_ = std::make_unique<http_response>(std::move(response));
+    return deferred_.get();
+}
+
+void connection_base::abandon_response()
+{
+    new orphan_response{ std::move(deferred_) };
+}
+
+void connection_base::on_response_completed()
+{
+    // a response completed before its handler returned is queued without waiting
+    if (status_ == status::waiting_on_response) {
+        resume();
+    }
+}
+
+void connection_base::finish()
+{
+    // stop the timer
+    server_.dispatcher().cancel(*this);
+
+    // close connection
+    server_.move_to_closing(*this);
+
+    // set status
+    status_ = status::closing;
+}
+
+connection_base::action connection_base::next()
+{
+    // the responses parked for the log sync are sent first
+    if (syncing_) {
+        syncing_ = false;
+        check_synced();
+        return action::send;
+    }
+
+    auto const & timeouts = server_.get_timeouts();
+    while (true) {
+        switch (stage_) {
+        case stage::idle:
+            // wait for the next request no longer than the keep-alive timeout
+            idle_timeout_ = served_ == 0 ? timeouts.read_idle : timeouts.keep_alive;
+            started_ = false;
+            headers_completed_ = false;
+
+            // the buffer may hold the beginning of pipelined requests, otherwise the
+            // responses are sent and the request state is given back while waiting
+            buffer_.start_request();
+            if (buffer_.empty()) {
+                if (exchange_ && !exchange_->output.empty()) {
+                    return flush();
+                }
+
+                release_exchange();
+                return action::receive;
+            }
+
+            acquire_exchange();
+            exchange_->request.emplace(buffer_, this);
+            stage_ = stage::receiving;
+            break;
+
+        case stage::receiving: {
+            auto & request = *exchange_->request;
+            auto & output = exchange_->output;
+            if (request.is_completed()) {
+                // close the connection after the request limit
+                auto const max_requests = server_.max_requests();
+                keep_alive_ = request.should_keep_alive()
+                    && (max_requests == 0 || served_ + 1 < max_requests);
+
+                // a deferred response is queued once its handler completes it
+                stage_ = stage::streaming;
+                if (handle_request(request, keep_alive_, output)) {
+                    stage_ = stage::responding;
+                    return action::wait_response;
+                }
+
+                break;
+            }
+
+            // nothing left to parse, flush the responses before waiting for data
+            if (buffer_.empty()) {
+                return output.empty() ? action::receive : flush();
+            }
+
+            // start the request deadlines at the first byte
+            if (!started_) {
+                started_ = true;
+                idle_timeout_ = timeouts.read_idle;
+                set_deadline(deadline::header, timeouts.header);
+                set_deadline(deadline::request, timeouts.request);
+            }
+
+            auto const n = request.parse();
+            if (n < 0) {
+                if (!reject_request(request, output)) {
+                    throw std::runtime_error{ "cannot parse http request" };
+                }
+
+                // the rest of the rejected request is not read, close the connection
+                stage_ = stage::closing;
+                return flush();
+            }
+
+            consume(request, n);
+
+            if (request.is_headers_completed() && !headers_completed_) {
+                headers_completed_ = true;
+                clear_deadline(deadline::header);
+                continue_request(request, output);
+            }
+
+            break;
+        }
+
+        case stage::responding:
+            keep_alive_ = finish_request(*exchange_->request, keep_alive_, exchange_->output);
+            stage_ = stage::streaming;
+            break;
+
+        case stage::streaming:
+            // a streamed response is produced chunk by chunk as the socket drains
+            if (stream_response(exchange_->output)) {
+                return flush();
+            }
+
+            clear_deadline(deadline::request);
+            ++served_;
+
+            if (!keep_alive_) {
+                stage_ = stage::closing;
+                return flush();
+            }
+
+            stage_ = stage::idle;
+
+            // do not let a long pipeline grow the output without bound
+            if (exchange_->output.size() >= recv_buffer::initial_capacity * 16) {
+                return flush();
+            }
+
+            break;
+
+        case stage::closing:
+            return action::close;
+        }
+    }
+}
+
+void connection_base::received(size_t n)
+{
+    if (n != 0) {
+        return;
+    }
+
+    if (started_) {
+        throw std::runtime_error{ "connection closed by peer" };
+    }
+
+    // the peer closed the connection between requests
+    stage_ = stage::closing;
+}
+
+connection_base::action connection_base::flush()
+{
+    // the responses wait for the records their handlers logged
+    if (must_sync()) {
+        syncing_ = true;
+        return action::wait_sync;
+    }
+
+    return action::send;
+}
+
+void connection_base::log_error() const
+{
+    try {
+        throw;
+    } catch (std::system_error const & e) {
+        std::cerr << "system error: " << e.what() << std::endl;
+    } catch (std::runtime_error const & e) {
+        std::cerr << "runtime error: " << e.what() << std::endl;
+    } catch (std::exception const & e) {
+        std::cerr << "exception: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "unknown exception" << std::endl;
+    }
+}
+
+void connection_base::acquire_exchange()
+{
+    if (!exchange_) {
+        exchange_ = ::new(frame_pool::allocate(sizeof(exchange))) exchange{ };
+    }
+}
+
+void connection_base::release_exchange()
+{
+    if (exchange_) {
+        exchange_->~exchange();
+        frame_pool::deallocate(exchange_, sizeof(exchange));
+        exchange_ = nullptr;
+    }
+}
+
+unsigned connection_base::on_headers(http_request & request)
+{
+    route_ = server_.find_route(request.url());
+
+    // the body limit of the route, the server default otherwise
+    auto const max_body = route_ && route_->max_body() != 0 ? route_->max_body() : server_.max_body_size();
+    request.set_body_limit(max_body);
+
+    // a streaming route receives the body as it is parsed
+    if (route_ && route_->accepts(request.method())) {
+        consumer_ = route_->create_consumer();
+        if (consumer_) {
+            request.set_body_consumer(consumer_);
+        }
+    }
+
+    return 0;
+}
+
+void connection_base::consume(const http_request & request, size_t n)
+{
+    buffer_.consume(n);
+
+    // only the header of a request streaming its body is kept
+    if (auto const offset = request.streamed_body_offset(); offset != 0) {
+        buffer_.discard(offset);
+    }
+}
+
+void connection_base::continue_request(const http_request & request, response_writer & output)
+{
+    if (!request.is_completed() && request.expects_continue()) {
+        output.append("HTTP/1.1 100 Continue\r\n\r\n");
+    }
+}
+
+bool connection_base::reject_request(const http_request & request, response_writer & output)
+{
+    release_consumer();
+    if (request.rejected() == 0) {
+        return false;
+    }
+
+    http_response response;
+    response.status(request.rejected());
+    output.append(response, http_response::connection_header::close);
+    return true;
+}
+
+bool connection_base::handle_request(const http_request & request, bool keep_alive, response_writer & output)
+{
+    // the usage of the previous request is recorded, this one is reported under its uri
+    if (server_.stack_usage()) {
+        sample_stack_usage();
+        last_uri_.assign(request.url());
+    }
+
+    // the route is found once the header is parsed
+    auto const route = route_;
+    route_ = nullptr;
+
+    // a constant response is queued in place
+    if (route && route->response() && route->accepts(request.method())) {
+        output.append_static(route->response()->bytes(connection_header_of(request, keep_alive)));
+        return false;
+    }
+
+    // call the handler, or the consumer of the streamed body, the body may be written
+    // straight into the send buffer
+    http_response response;
+    output.bind(response);
+    response.listen(*this);
+    if (!route) {
+        response.status(404);
+    } else if (!route->accepts(request.method())) {
+        response.status(405);
+    } else if (!(consumer_ ? consumer_->on_complete(request, &response) : (*route)(request, &response))) {
+        response = http_response{ };
+        response.status(500);
+    }
+
+    release_consumer();
+
+    // the handler completes a deferred response later, or did before returning
+    if (response.is_deferred()) {
+        if (deferred_->is_deferred()) {
+            return true;
+        }
+
+        finish_request(request, keep_alive, output);
+        return false;
+    }
+
+    queue_response(request, keep_alive, response, output);
+    return false;
+}
+
+bool connection_base::finish_request(const http_request & request, bool keep_alive, response_writer & output)
+{
+    auto const keep = keep_alive && !timed_out_;
+    queue_response(request, keep, *deferred_, output);
+    deferred_.reset();
+    return keep;
+}
+
+void connection_base::queue_response(const http_request & request, bool keep_alive, http_response & response, response_writer & output)
+{
+    // the response acknowledges the records its handler logged, it waits for their sync,
+    // a response logging nothing is sent whatever other handlers left unsynced
+    if (auto const log = server_.get_commit_log()) {
+        auto const sequence = response.log_sequence();
+        if (sequence > sync_sequence_ && sequence > log->synced()) {
+            sync_sequence_ = sequence;
+        }
+    }
+
+    // http/1.0 has no chunked encoding, the streamed body is collected
+    if (response.is_streamed() && request.http_major() == 1 && request.http_minor() == 0) {
+        while (response.body_producer()(response.body())) {
+        }
+
+        response.body_producer() = nullptr;
+    }
+
+    // queue the header block and the body, written together
+    output.append(response, connection_header_of(request, keep_alive));
+
+    // the chunks follow the header block
+    if (response.is_streamed()) {
+        producer_ = std::move(response.body_producer());
+    }
+}
+
+bool connection_base::stream_response(response_writer & output)
+{
+    if (!producer_) {
+        return false;
+    }
+
+    // the producer appends to a buffer kept across chunks
+    chunk_.clear();
+    auto const more = producer_(chunk_);
+    if (!chunk_.empty()) {
+        output.append_chunk(chunk_);
+    }
+
+    if (more) {
+        return true;
+    }
+
+    // the empty chunk ends the body
+    output.append_chunk({ });
+    producer_ = nullptr;
+    return false;
+}
+
+bool connection_base::must_sync()
+{
+    if (sync_sequence_ == 0) {
+        return false;
+    }
+
+    // another connection's sync may have covered the records, none does once a sync failed
+    auto const log = server_.get_commit_log();
+    if (!log->failed() && log->synced() >= sync_sequence_) {
+        sync_sequence_ = 0;
+        return false;
+    }
+
+    set_deadline(deadline::sync, server_.get_timeouts().request);
+    server_.park(*this);
+    return true;
+}
+
+void connection_base::check_synced()
+{
+    check_timeout();
+
+    auto const log = server_.get_commit_log();
+    if (log->failed() || log->synced() < sync_sequence_) {
+        throw std::runtime_error{ "cannot sync the commit log" };
+    }
+
+    clear_deadline(deadline::sync);
+    sync_sequence_ = 0;
+}
+
+void connection_base::release_consumer()
+{
+    if (consumer_) {
+        consumer_->destroy();
+        consumer_ = nullptr;
+    }
+}
+
+void connection_base::set_deadline(deadline d, std::chrono::milliseconds timeout)
+{
+    if (timeout.count() > 0) {
+        deadlines_[static_cast<size_t>(d)] = event_dispatcher::now() + timeout.count();
+        update_timer();
+    }
+}
+
+void connection_base::update_timer()
+{
+    // find the nearest deadline
+    uint64_t nearest = 0;
+    for (auto const expires : deadlines_) {
+        if (expires != 0 && (nearest == 0 || expires < nearest)) {
+            nearest = expires;
+        }
+    }
+
+    // no deadline, stop the timer
+    auto & dispatcher = server_.dispatcher();
+    if (nearest == 0) {
+        dispatcher.cancel(*this);
+        return;
+    }
+
+    // move the timer if the nearest deadline changed
+    if (!is_armed() || expires() != nearest) {
+        auto const now = event_dispatcher::now();
+        dispatcher.arm(*this, std::chrono::milliseconds{ nearest > now ? nearest - now : 0 });
+    }
+}
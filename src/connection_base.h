@@ -0,0 +1,407 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/list_hook.hpp>
+
+#include "event_dispatcher.h"
+#include "http_request.h"
+#include "http_response.h"
+#include "recv_buffer.h"
+#include "response_writer.h"
+#include "router.h"
+
+class server;
+
+/**
+ * @brief The state shared by the connection models, the deadlines, the status the io
+ * callbacks resume on and the request handling
+ *
+ * The keep-alive, pipelining, 100-continue, deferred response, log sync and streaming
+ * logic is one state machine run by next(). It returns what the connection must do
+ * before it is called again, a connection model only supplies the receive, the send and
+ * the waits, on a stackful coroutine or on stackless ones, and finishes the connection
+ * once it returns action::close or throws.
+ */
+class connection_base
+    : public io_listener
+    , public timer_listener
+    , public request_listener
+    , public response_listener
+{
+    friend server;
+
+protected:
+    enum class status : uint8_t
+    {
+        running,
+        waiting_on_read,
+        waiting_on_write,
+        waiting_on_io,
+        waiting_on_sync,
+        waiting_on_response,
+        closing
+    };
+
+    /**
+     * @brief What the connection model does before it calls next() again
+     */
+    enum class action : uint8_t
+    {
+        receive,        ///< receive data into the buffer, then pass its length to received()
+        send,           ///< send the queued responses until exchange_->output is empty
+        wait_response,  ///< wait with waiting_on_response until the deferred response is completed
+        wait_sync,      ///< wait with waiting_on_sync until the server resumes the connection
+        close           ///< the connection is done, finish it
+    };
+
+    /**
+     * @brief The stage of the request in progress
+     */
+    enum class stage : uint8_t
+    {
+        idle,        ///< the next request is to be started
+        receiving,   ///< the request is received and parsed
+        responding,  ///< the handler completes its deferred response
+        streaming,   ///< the response is produced chunk by chunk
+        closing      ///< the last responses are sent, the connection closes
+    };
+
+    /**
+     * @brief The deadlines, the connection times out as soon as one of them passes
+     */
+    enum class deadline : uint8_t
+    {
+        read_idle,  ///< the peer sends no data
+        header,     ///< the request header is not received
+        request,    ///< the request is not handled
+        sync,       ///< the log records of the responses are not synced
+        count
+    };
+
+    /**
+     * @brief The state of the requests in progress, taken from the frame pool once a request
+     * starts and given back while the connection waits for the next one
+     */
+    struct exchange
+    {
+        response_writer             output{ };   ///< the responses to send, those of pipelined requests are sent together
+        std::optional<http_request> request{ };  ///< the request in progress, parsed from the receive buffer
+    };
+
+    using list_hook = boost::intrusive::list_member_hook<>;
+
+public:
+    /**
+     * @brief Move constructor is deleted
+     */
+    connection_base(connection_base &&) noexcept = delete;
+
+    /**
+     * @brief Move assignment is deleted
+     */
+    void operator=(connection_base &&) noexcept = delete;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    connection_base(const connection_base &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const connection_base &) = delete;
+
+protected:
+    /**
+     * @brief Construct a new connection base object
+     *
+     * @param server the server object
+     * @param fd the file descriptor
+     */
+    connection_base(server & server, int fd);
+
+    /**
+     * @brief Destroy the connection base object
+     */
+    ~connection_base() override;
+
+    /**
+     * @brief The on read callback
+     */
+    void on_read() override;
+
+    /**
+     * @brief The on write callback
+     */
+    void on_write() override;
+
+    /**
+     * @brief The on timer callback, resumes the coroutine with a timeout error
+     *
+     * A connection waiting for a deferred response queues a 504 in its place and closes
+     * after it, the handler completes its response alone. A connection waiting for the
+     * log sync leaves it and closes unanswered.
+     */
+    void on_timer() override;
+
+    /**
+     * @brief Keep the response a handler deferred until it is completed
+     *
+     * @param response the response
+     * @return http_response* the kept response
+     */
+    http_response * on_response_deferred(http_response && response) override;
+
+    /**
+     * @brief The deferred response is complete, resumes the coroutine waiting for it
+     */
+    void on_response_completed() override;
+
+    /**
+     * @brief Get the events the socket is subscribed with
+     *
+     * @return int event_dispatcher::readable and event_dispatcher::writable, 0 if the
+     * connection receives and sends with io_request objects
+     */
+    virtual int events() const;
+
+    /**
+     * @brief Record the stack usage of the request served last, called as the next request
+     * is handled when profiling the stack, a connection without a stack records nothing
+     */
+    virtual void sample_stack_usage();
+
+    /**
+     * @brief Resume the connection coroutine, the first call starts it
+     */
+    virtual void resume() = 0;
+
+    /**
+     * @brief Destroy the connection and release its memory
+     */
+    virtual void destroy() = 0;
+
+    /**
+     * @brief Stop the timer and hand the connection over to the server for closing
+     */
+    void finish();
+
+    /**
+     * @brief Run the request state machine until the connection must receive, send or wait
+     *
+     * @return action what to do before the next call
+     * @throw std::runtime_error if a request cannot be parsed or the log cannot be synced
+     * @throw std::system_error with ETIMEDOUT if a deadline passed while waiting for the sync
+     */
+    action next();
+
+    /**
+     * @brief Report the data received for action::receive, committed to the buffer
+     *
+     * @param n the received data length, 0 if the peer closed the connection
+     * @throw std::runtime_error if the peer closed the connection in the middle of a request
+     */
+    void received(size_t n);
+
+    /**
+     * @brief Log the exception being handled, the connection closes after it
+     */
+    void log_error() const;
+
+    /**
+     * @brief Take the request state from the frame pool unless it is held
+     */
+    void acquire_exchange();
+
+    /**
+     * @brief Give the request state back to the frame pool, the responses are sent
+     */
+    void release_exchange();
+
+    /**
+     * @brief Find the route once the request header is parsed, set the body limit and start
+     * streaming the body to the consumer of the route
+     *
+     * @param request the request
+     * @return unsigned 0, requests are rejected only for their body size
+     */
+    unsigned on_headers(http_request & request) override;
+
+    /**
+     * @brief Mark parsed bytes, drops the streamed body from the receive buffer
+     *
+     * @param request the request
+     * @param n the number of bytes
+     */
+    void consume(const http_request & request, size_t n);
+
+    /**
+     * @brief Queue the interim response of a client waiting for 100 Continue
+     *
+     * @param request the request, its header parsed
+     * @param output the response queue
+     */
+    void continue_request(const http_request & request, response_writer & output);
+
+    /**
+     * @brief Queue the response of a rejected request, the connection closes after it
+     *
+     * @param request the request
+     * @param output the response queue
+     * @return true if the request is rejected
+     * @return false if the request failed to parse
+     */
+    bool reject_request(const http_request & request, response_writer & output);
+
+    /**
+     * @brief Handle a request and queue the response
+     *
+     * @param request the request
+     * @param keep_alive true if the connection stays open after the response
+     * @param output the response queue
+     * @return true if the handler deferred the response, finish_request queues it once it
+     * is completed
+     * @return false if the response is queued
+     */
+    bool handle_request(const http_request & request, bool keep_alive, response_writer & output);
+
+    /**
+     * @brief Queue the deferred response once its handler completed it, or the 504 that
+     * replaced it once the request timed out
+     *
+     * @param request the request
+     * @param keep_alive true if the connection stays open after the response
+     * @param output the response queue
+     * @return true if the connection stays open after the response
+     * @return false if it closes, a timed out request closes it
+     */
+    bool finish_request(const http_request & request, bool keep_alive, response_writer & output);
+
+    /**
+     * @brief Queue the response of a handled request
+     *
+     * @param request the request
+     * @param keep_alive true if the connection stays open after the response
+     * @param response the response
+     * @param output the response queue
+     */
+    void queue_response(const http_request & request, bool keep_alive, http_response & response, response_writer & output);
+
+    /**
+     * @brief Queue the next chunk of a streamed response
+     *
+     * @param output the response queue
+     * @return true if a chunk is queued and more follow, send it before the next call
+     * @return false once the last chunk is queued, or if no response is streamed
+     */
+    bool stream_response(response_writer & output);
+
+    /**
+     * @brief Park the connection if its responses wait for log records that are not synced,
+     * no longer than the request timeout
+     *
+     * @return true if parked, check_synced is called once the server resumed the connection
+     */
+    bool must_sync();
+
+    /**
+     * @brief Send the queued responses once the log records they wait for are synced
+     *
+     * @return action action::wait_sync if the connection is parked, action::send otherwise
+     */
+    action flush();
+
+    /**
+     * @brief Throw if the log records the responses wait for could not be synced, if a
+     * sync of the log ever failed or if the connection timed out waiting
+     *
+     * @throw std::runtime_error if the sync failed
+     * @throw std::system_error with ETIMEDOUT if a deadline passed
+     */
+    void check_synced();
+
+    /**
+     * @brief Hand the deferred response over to its handler, freed once completed
+     */
+    void abandon_response();
+
+    /**
+     * @brief Destroy the body consumer of the request
+     */
+    void release_consumer();
+
+    /**
+     * @brief Set a deadline
+     *
+     * @param d the deadline
+     * @param timeout the time from now, zero leaves the deadline unset
+     */
+    void set_deadline(deadline d, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Clear a deadline
+     *
+     * @param d the deadline
+     */
+    void clear_deadline(deadline d);
+
+    /**
+     * @brief Arm the timer at the nearest deadline
+     */
+    void update_timer();
+
+    /**
+     * @brief Throw if a deadline has passed
+     *
+     * @throw std::system_error with ETIMEDOUT
+     */
+    void check_timeout() const;
+
+    static constexpr auto deadline_count = static_cast<size_t>(deadline::count);
+
+    list_hook                      list_hook_{ };                  ///< the list hook
+    status                         status_{ status::running };     ///< the status
+    server                        &server_;                        ///< the server
+    uint64_t                       deadlines_[deadline_count]{ };  ///< the deadlines in milliseconds, 0 if unset
+    const char                    *timed_out_{ nullptr };          ///< the passed deadline, nullptr if not timed out
+    std::chrono::milliseconds      idle_timeout_{ };               ///< the read idle timeout, keep-alive between requests
+    std::string                    last_uri_{ };                   ///< the uri of the request served last, kept when profiling the stack
+    const router::route           *route_{ nullptr };              ///< the route of the request, nullptr if not found
+    body_consumer                 *consumer_{ nullptr };           ///< the body consumer of the request, nullptr if none
+    http_response::producer        producer_{ };                   ///< the producer of the streamed response, empty if none
+    std::string                    chunk_{ };                      ///< the chunk being produced, reused across chunks
+    uint64_t                       sync_sequence_{ 0 };            ///< the log record the responses wait for, 0 if none
+    std::unique_ptr<http_response> deferred_{ };                   ///< the response a handler deferred, nullptr if none
+    recv_buffer                    buffer_{ };                     ///< the receive buffer, reused across requests
+    exchange                      *exchange_{ nullptr };           ///< the state of the requests in progress, nullptr while idle
+    stage                          stage_{ stage::idle };          ///< the stage of the request in progress
+    unsigned                       served_{ 0 };                   ///< the requests served on the connection
+    bool                           started_{ false };              ///< the first byte of the request is received
+    bool                           headers_completed_{ false };    ///< the request header is parsed
+    bool                           keep_alive_{ false };           ///< the connection stays open after the response
+    bool                           syncing_{ false };              ///< the connection is parked until the log is synced
+};
+
+inline void connection_base::clear_deadline(deadline d)
+{
+    auto & expires = deadlines_[static_cast<size_t>(d)];
+    if (expires != 0) {
+        expires = 0;
+        update_timer();
+    }
+}
+
+inline void connection_base::check_timeout() const
+{
+    if (timed_out_) {
+        throw std::system_error{ ETIMEDOUT, std::system_category(), timed_out_ };
+    }
+}
@@ -0,0 +1,120 @@
+#include "connection_pool.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include <system_error>
+
+connection_pool::connection_pool(size_t stack_size, size_t object_size, size_t high_water)
+    : page_size_{ static_cast<size_t>(sysconf(_SC_PAGESIZE)) }
+    , object_size_{ object_size }
+    , high_water_{ high_water }
+#ifdef MADV_FREE
+    , advice_{ MADV_FREE }
+#else
+    , advice_{ MADV_DONTNEED }
+#endif
+{
+    resize(stack_size);
+    free_.reserve(high_water_);
+}
+
+connection_pool::~connection_pool()
+{
+    trim(0);
+}
+
+void connection_pool::resize(size_t stack_size)
+{
+    // align stack size to page size, the released regions are kept if it is unchanged
+    auto const page_mask = page_size_ - 1;
+    auto const aligned = (stack_size + page_mask) & ~page_mask;
+    if (aligned == stack_size_) {
+        return;
+    }
+
+    // the released regions have the old size
+    trim(0);
+    stack_size_ = aligned;
+    region_size_ = region_size(stack_size_);
+    kept_size_ = region_size_ - page_size_ - stack_size_;
+    stats_.stack.store(stack_size_, std::memory_order_relaxed);
+}
+
+void connection_pool::set_high_water(size_t n)
+{
+    high_water_ = n;
+    trim(high_water_);
+}
+
+void * connection_pool::acquire()
+{
+    // reuse a released region, the guard page is still in place
+    if (!free_.empty()) {
+        auto const stack = free_.back();
+        free_.pop_back();
+        stats_.hits.fetch_add(1, std::memory_order_relaxed);
+        stats_.mapped.fetch_sub(region_size_, std::memory_order_relaxed);
+        stats_.resident.fetch_sub(kept_size_, std::memory_order_relaxed);
+        return stack;
+    }
+
+    // allocate memory
+    auto const mem = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw std::system_error{ errno, std::system_category(), "cannot allocate memory" };
+    }
+
+    // set guard page unreadable and unwritable
+    if (mprotect(mem, page_size_, PROT_NONE) < 0) {
+        munmap(mem, region_size_);
+        throw std::system_error{ errno, std::system_category(), "cannot set guard page unreadable and unwritable" };
+    }
+
+    stats_.misses.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<char *>(mem) + page_size_;
+}
+
+void connection_pool::release(void * stack, size_t stack_size)
+{
+    if (stack_size != stack_size_ || free_.size() >= high_water_) {
+        unmap(stack, stack_size);
+        return;
+    }
+
+    // hand the stack pages back to the kernel, the mapping stays
+    if (madvise(stack, stack_size_, advice_) < 0 && errno == EINVAL && advice_ != MADV_DONTNEED) {
+        // MADV_FREE is not supported by the kernel
+        advice_ = MADV_DONTNEED;
+        madvise(stack, stack_size_, advice_);
+    }
+
+    // only the pages of the object above the stack stay resident
+    free_.push_back(stack);
+    stats_.mapped.fetch_add(region_size_, std::memory_order_relaxed);
+    stats_.resident.fetch_add(kept_size_, std::memory_order_relaxed);
+}
+
+size_t connection_pool::region_size(size_t stack_size) const
+{
+    // add one page at the top of the stack as guard page, align to page size
+    auto const page_mask = page_size_ - 1;
+    return (page_size_ + stack_size + object_size_ + page_mask) & ~page_mask;
+}
+
+void connection_pool::unmap(void * stack, size_t stack_size) const
+{
+    munmap(static_cast<char *>(stack) - page_size_, region_size(stack_size));
+}
+
+void connection_pool::trim(size_t n)
+{
+    while (free_.size() > n) {
+        unmap(free_.back(), stack_size_);
+        free_.pop_back();
+        stats_.mapped.fetch_sub(region_size_, std::memory_order_relaxed);
+        stats_.resident.fetch_sub(kept_size_, std::memory_order_relaxed);
+    }
+}
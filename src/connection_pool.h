@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The pool of connection regions
+ *
+ * A region is a guard page, the coroutine stack and the connection object, mapped
+ * once and reused across connections. Released regions are kept on a freelist up to
+ * the high-water mark, their stack pages are handed back to the kernel with
+ * MADV_FREE (MADV_DONTNEED on kernels without it) while the mapping and the guard
+ * page stay in place. Regions beyond the high-water mark are unmapped.
+ *
+ * The pool is owned by one event dispatcher thread, only the counters may be read
+ * from other threads.
+ */
+class connection_pool
+{
+public:
+    /**
+     * @brief The pool counters, readable from any thread
+     */
+    struct statistics
+    {
+        std::atomic<uint64_t> hits{ 0 };      ///< the regions taken from the freelist
+        std::atomic<uint64_t> misses{ 0 };    ///< the regions mapped because the freelist was empty
+        std::atomic<uint64_t> mapped{ 0 };    ///< the bytes mapped by the regions on the freelist
+        std::atomic<uint64_t> resident{ 0 };  ///< the bytes of the regions on the freelist not handed back to the kernel
+        std::atomic<uint64_t> stack{ 0 };     ///< the stack size of the regions acquired next
+    };
+
+    /**
+     * @brief Construct a new connection pool object
+     *
+     * @param stack_size the stack size, rounded up to the page size
+     * @param object_size the size of the object placed above the stack
+     * @param high_water the number of released regions kept on the freelist
+     */
+    connection_pool(size_t stack_size, size_t object_size, size_t high_water);
+
+    /**
+     * @brief Destroy the connection pool object, unmaps the regions on the freelist
+     */
+    ~connection_pool();
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    connection_pool(const connection_pool &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const connection_pool &) = delete;
+
+    /**
+     * @brief Get the stack size
+     */
+    size_t stack_size() const;
+
+    /**
+     * @brief Set the stack size of the regions acquired afterwards
+     *
+     * @param stack_size the stack size, rounded up to the page size
+     */
+    void resize(size_t stack_size);
+
+    /**
+     * @brief Get the number of released regions kept on the freelist
+     */
+    size_t high_water() const;
+
+    /**
+     * @brief Set the number of released regions kept on the freelist, the extra ones are unmapped
+     *
+     * @param n the number of regions
+     */
+    void set_high_water(size_t n);
+
+    /**
+     * @brief Get the pool counters
+     */
+    const statistics & stats() const;
+
+    /**
+     * @brief Acquire a region
+     *
+     * @return void* the bottom of the stack, the object lives at the top of the stack
+     * @throw std::system_error if the region cannot be mapped
+     */
+    void * acquire();
+
+    /**
+     * @brief Release a region, the object must have been destroyed
+     *
+     * @param stack the bottom of the stack returned by acquire
+     * @param stack_size the stack size of the region
+     */
+    void release(void * stack, size_t stack_size);
+
+private:
+    /**
+     * @brief Get the region size of a stack size
+     *
+     * @param stack_size the stack size
+     * @return size_t the region size, guard page included
+     */
+    size_t region_size(size_t stack_size) const;
+
+    /**
+     * @brief Unmap a region
+     *
+     * @param stack the bottom of the stack
+     * @param stack_size the stack size of the region
+     */
+    void unmap(void * stack, size_t stack_size) const;
+
+    /**
+     * @brief Unmap the regions on the freelist beyond \b n
+     *
+     * @param n the number of regions to keep
+     */
+    void trim(size_t n);
+
+    size_t              page_size_{ 0 };     ///< the page size
+    size_t              object_size_{ 0 };   ///< the object size
+    size_t              stack_size_{ 0 };    ///< the stack size
+    size_t              region_size_{ 0 };   ///< the region size, guard page included
+    size_t              kept_size_{ 0 };     ///< the bytes of a released region left resident, above the stack
+    size_t              high_water_{ 0 };    ///< the freelist capacity
+    int                 advice_{ 0 };        ///< the madvise advice for released stacks
+    std::vector<void *> free_{ };            ///< the released stacks
+    statistics          stats_{ };           ///< the pool counters
+};
+
+inline size_t connection_pool::stack_size() const
+{
+    return stack_size_;
+}
+
+inline size_t connection_pool::high_water() const
+{
+    return high_water_;
+}
+
+inline const connection_pool::statistics & connection_pool::stats() const
+{
+    return stats_;
+}
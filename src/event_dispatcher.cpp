@@ -1,10 +1,17 @@
 #include "event_dispatcher.h"
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <cerrno>
 
+#include <iostream>
+#include <system_error>
+
+#include "io_uring_poller.h"
+
 io_listener::~io_listener()
 {
     if (fd_ >= 0) {
@@ -26,39 +33,89 @@ io_listener & io_listener::operator=(io_listener && other) noexcept
     return *this;
 }
 
-event_dispatcher::event_dispatcher()
-    : epfd_{ epoll_create1(EPOLL_CLOEXEC) }
+thread_local event_dispatcher * event_dispatcher::current_{ nullptr };
+
+namespace {
+
+constexpr auto task_batch = 256;  ///< the most posted tasks run per loop iteration
+
+}
+
+event_dispatcher::notifier::notifier()
+    : io_listener{ eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }
 {
+    if (fd() < 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot create eventfd" };
+    }
 }
 
-event_dispatcher::~event_dispatcher()
+void event_dispatcher::notifier::notify()
 {
-    if (epfd_ >= 0) {
-        close(epfd_);
+    // only the first notification after a drain writes the eventfd
+    if (!pending_.exchange(true)) {
+        uint64_t const one = 1;
+        auto const n = write(fd(), &one, sizeof one);
+        (void)n;
     }
 }
 
-event_dispatcher & event_dispatcher::operator=(event_dispatcher && other) noexcept
+void event_dispatcher::notifier::clear()
 {
-    if (this != &other) {
-        if (epfd_ >= 0) {
-            close(epfd_);
+    pending_.store(false);
+}
+
+void event_dispatcher::notifier::on_read()
+{
+    uint64_t count;
+    auto const n = read(fd(), &count, sizeof count);
+    (void)n;
+}
+
+void event_dispatcher::notifier::on_write()
+{
+}
+
+event_dispatcher::event_dispatcher(backend b)
+{
+    // try io_uring first
+    if (b != backend::epoll) {
+        try {
+            uring_ = std::make_unique<io_uring_poller>();
+        } catch (std::system_error const & e) {
+            if (b == backend::io_uring) {
+                std::cerr << "io_uring unavailable, falling back to epoll: " << e.what() << std::endl;
+            }
         }
+    }
 
-        epfd_ = other.epfd_;
-        other.epfd_ = -1;
+    // fall back to epoll
+    if (!uring_) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
     }
 
-    return *this;
+    // subscribe the wakeup notifier
+    notifier_ = std::make_unique<notifier>();
+    subscribe(*notifier_, readable);
+}
+
+event_dispatcher::~event_dispatcher()
+{
+    if (epfd_ >= 0) {
+        close(epfd_);
+    }
 }
 
 void event_dispatcher::run()
 {
-    running_ = true;
+    running_.store(true, std::memory_order_relaxed);
+    current_ = this;
 
     epoll_event events[64];
-    while (running_) {
-        auto const n = epoll_wait(epfd_, events, sizeof(events) / sizeof(events[0]), 50);
+    while (running_.load(std::memory_order_relaxed)) {
+        // wait until the nearest timer, forever if none is armed, only poll if the
+        // dispatcher thread posted tasks
+        auto const timeout = local_ ? 0 : timers_.next_timeout(now());
+        auto const n = wait(events, sizeof(events) / sizeof(events[0]), timeout);
         if (n < 0) {
             if (errno == EINTR) {
                 continue;
@@ -69,39 +126,127 @@ void event_dispatcher::run()
         for (auto i = 0; i < n; ++i) {
             auto const ev = events[i];
             auto const listener = static_cast<io_listener *>(ev.data.ptr);
-            if (ev.events & EPOLLIN) {
+
+            // an error or a hang up wakes both directions, the next read or write reports it
+            auto const broken = ev.events & (EPOLLERR | EPOLLHUP);
+            if ((ev.events & EPOLLIN) || broken) {
                 listener->on_read();
             }
 
-            if (ev.events & EPOLLOUT) {
+            if ((ev.events & EPOLLOUT) || broken) {
                 listener->on_write();
             }
         }
 
+        // the receives and sends completed in this iteration
+        if (uring_) {
+            uring_->complete();
+        }
+
+        timers_.advance(now());
+
+        run_tasks();
+
         for (auto & l : on_loop_list_) {
             l.on_loop();
         }
     }
+
+    current_ = nullptr;
+}
+
+void event_dispatcher::run_tasks()
+{
+    // tasks posted from now on write the eventfd again
+    notifier_->clear();
+
+    for (auto i = 0; i < task_batch; ++i) {
+        auto const t = tasks_.pop();
+        if (!t) {
+            // a task pushed by another thread and not linked yet writes the eventfd
+            local_ = false;
+            return;
+        }
+
+        t->on_run();
+    }
+
+    // the batch is full, come back after the next io events
+    notifier_->notify();
+}
+
+int event_dispatcher::wait(epoll_event * events, int max, int timeout)
+{
+    if (uring_) {
+        return uring_->wait(events, max, timeout);
+    }
+
+    return epoll_wait(epfd_, events, max, timeout);
 }
 
 bool event_dispatcher::subscribe(io_listener & listener, int e)
 {
     epoll_event ev;
     ev.events = EPOLLET;
-    ev.events |= (e & readable ? EPOLLIN : 0);
-    ev.events |= (e & writable ? EPOLLOUT : 0);
+    ev.events |= (e & readable) ? uint32_t{ EPOLLIN } : 0u;
+    ev.events |= (e & writable) ? uint32_t{ EPOLLOUT } : 0u;
+    ev.events |= (e & exclusive) ? uint32_t{ EPOLLEXCLUSIVE } : 0u;
     ev.data.ptr = &listener;
 
+    if (uring_) {
+        return (e & listening) && !(e & exclusive)
+            ? uring_->add_acceptor(listener.fd(), &listener)
+            : uring_->add(listener.fd(), ev.events, &listener);
+    }
+
     auto const err = epoll_ctl(epfd_, EPOLL_CTL_ADD, listener.fd(), &ev);
     return err == 0;
 }
 
+int event_dispatcher::accept(io_listener & listener)
+{
+    if (uring_) {
+        return uring_->accept(listener.fd());
+    }
+
+    return accept4(listener.fd(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
 bool event_dispatcher::unsubscribe(io_listener & listener)
 {
+    if (uring_) {
+        return uring_->remove(listener.fd());
+    }
+
     auto const err = epoll_ctl(epfd_, EPOLL_CTL_DEL, listener.fd(), nullptr);
     return err == 0;
 }
 
+bool event_dispatcher::completes_io() const
+{
+    return uring_ && uring_->provides_buffers();
+}
+
+void event_dispatcher::receive(io_listener & listener, io_request & r)
+{
+    uring_->receive(listener.fd(), r);
+}
+
+void event_dispatcher::receive(io_listener & listener, void * buf, size_t len, io_request & r)
+{
+    uring_->receive(listener.fd(), buf, len, r);
+}
+
+void event_dispatcher::send(io_listener & listener, const msghdr & msg, io_request & r)
+{
+    uring_->send(listener.fd(), msg, r);
+}
+
+void event_dispatcher::cancel(io_request & r)
+{
+    uring_->cancel(r);
+}
+
 bool event_dispatcher::subscribe(loop_listener &listener)
 {
     for (auto & l : on_loop_list_) {
@@ -1,9 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/list_hook.hpp>
 
+#include "task_queue.h"
+#include "timer_wheel.h"
+
+struct epoll_event;
+struct msghdr;
+
 class event_dispatcher;
+class io_request;
+class io_uring_poller;
 
 /**
  * @brief The io listener
@@ -117,10 +131,45 @@ private:
  */
 class event_dispatcher
 {
-public:
-
+    /**
+     * @brief The wakeup notifier, an eventfd subscribed to the dispatcher
+     */
+    class notifier
+        : public io_listener
+    {
+    public:
+        /**
+         * @brief Construct a new notifier object
+         *
+         * @throw std::system_error if the eventfd cannot be created
+         */
+        notifier();
+
+        /**
+         * @brief Wake up the dispatcher, may be called from any thread
+         */
+        void notify();
+
+        /**
+         * @brief Re-enable the wakeup, called by the dispatcher before it drains the tasks
+         */
+        void clear();
+
+    protected:
+        /**
+         * @brief The on read callback
+         */
+        void on_read() override;
+
+        /**
+         * @brief The on write callback
+         */
+        void on_write() override;
+
+    private:
+        std::atomic<bool> pending_{ false };  ///< whether a wakeup is pending
+    };
 
-private:
     using on_loop_list = boost::intrusive::list
         < loop_listener
         , boost::intrusive::member_hook
@@ -131,12 +180,24 @@ private:
         >;
 
 public:
-    enum { readable = 1, writable = 2 };
+    enum { readable = 1, writable = 2, exclusive = 4, listening = 8 };
+
+    /**
+     * @brief The readiness notification backend
+     */
+    enum class backend
+    {
+        automatic,  ///< io_uring if the kernel supports it, otherwise epoll
+        epoll,      ///< epoll_wait
+        io_uring    ///< multishot poll requests on an io_uring
+    };
 
     /**
      * @brief Construct a new event dispatcher object
+     *
+     * @param b the backend, falls back to epoll if io_uring is not available
      */
-    event_dispatcher();
+    explicit event_dispatcher(backend b = backend::automatic);
 
     /**
      * @brief Destroy the event dispatcher object
@@ -144,19 +205,15 @@ public:
     ~event_dispatcher();
 
     /**
-     * @brief Move constructor
-     *
-     * @param other the other event dispatcher object
+     * @brief Move constructor is deleted, the subscribed listeners, the armed timers and
+     * the posted tasks refer to the dispatcher
      */
-    event_dispatcher(event_dispatcher && other) noexcept;
+    event_dispatcher(event_dispatcher &&) = delete;
 
     /**
-     * @brief Move assignment
-     *
-     * @param other the other event dispatcher object
-     * @return event_dispatcher& the reference to this object
+     * @brief Move assignment is deleted
      */
-    event_dispatcher & operator=(event_dispatcher && other) noexcept;
+    void operator=(event_dispatcher &&) = delete;
 
     /**
      * @brief Copy constructor is deleted
@@ -185,25 +242,64 @@ public:
     bool operator!() const;
 
     /**
-     * @brief Run the event dispatcher
+     * @brief Get the backend in use
+     */
+    backend get_backend() const;
+
+    /**
+     * @brief Run the event dispatcher, it is the dispatcher of the calling thread until it stops
      */
     void run();
 
     /**
-     * @brief Stop the event dispatcher
+     * @brief Get the dispatcher running on the calling thread
+     *
+     * @return event_dispatcher* the dispatcher, nullptr if none runs on the thread
+     */
+    static event_dispatcher * current();
+
+    /**
+     * @brief Stop the event dispatcher, may be called from any thread
      */
     void stop();
 
+    /**
+     * @brief Post a task to run on the dispatcher thread, may be called from any thread
+     *
+     * The dispatcher wakes up at once and runs the posted tasks in batches after the io
+     * events of the loop iteration. A task posted on the dispatcher thread does not write
+     * the eventfd, it runs in the same iteration, or the next one does not block.
+     *
+     * @param t the task, must stay alive until its on_run is called
+     */
+    void post(task & t);
+
     /**
      * @brief Subscribe the io listener
      *
      * @param listener the io listener
-     * @param e the event
+     * @param e the event, \b exclusive wakes only one of the dispatchers sharing the file,
+     *          \b listening marks a listening socket whose connections are taken with
+     *          accept, the backend may accept them ahead unless the socket is shared and
+     *          \b exclusive, a multishot accept would take the connections of every sharer,
+     *          0 subscribes a socket used with io_request objects only, see completes_io
      * @return true if the io listener is subscribed
      * @return false if the io listener is not subscribed
      */
     bool subscribe(io_listener & listener, int e);
 
+    /**
+     * @brief Take a connection of a listening socket subscribed as \b listening
+     *
+     * With io_uring the connections are accepted by the kernel as they come and taken
+     * here without a system call, with epoll this is accept4.
+     *
+     * @param listener the io listener of the listening socket
+     * @return int the connection, non-blocking and close-on-exec, -1 with errno set if
+     *         none is pending (EAGAIN) or accepting failed
+     */
+    int accept(io_listener & listener);
+
     /**
      * @brief Unsubscribe the io listener
      *
@@ -213,6 +309,50 @@ public:
      */
     bool unsubscribe(io_listener & listener);
 
+    /**
+     * @brief Check if sockets can be received from and sent to with io_request objects,
+     * the io_uring backend registered its buffer ring
+     */
+    bool completes_io() const;
+
+    /**
+     * @brief Receive from a socket into a buffer of the ring, completes_io must be true
+     *
+     * The request is submitted with the next wait, on_complete is called after the io
+     * events of the loop iteration it completes in.
+     *
+     * @param listener the io listener of the socket
+     * @param r the request, completes with -ENOBUFS if no buffer is left
+     */
+    void receive(io_listener & listener, io_request & r);
+
+    /**
+     * @brief Receive from a socket into a buffer of the caller, completes_io must be true
+     *
+     * @param listener the io listener of the socket
+     * @param buf the buffer, must stay valid until the request completes
+     * @param len the buffer length
+     * @param r the request
+     */
+    void receive(io_listener & listener, void * buf, size_t len, io_request & r);
+
+    /**
+     * @brief Send a message to a socket, completes_io must be true
+     *
+     * @param listener the io listener of the socket
+     * @param msg the message, it and its data must stay valid until the request completes
+     * @param r the request
+     */
+    void send(io_listener & listener, const msghdr & msg, io_request & r);
+
+    /**
+     * @brief Cancel a pending request, it completes with -ECANCELED or its result if it
+     * was done already
+     *
+     * @param r the request
+     */
+    void cancel(io_request & r);
+
     /**
      * @brief Subscribe the loop listener
      *
@@ -231,10 +371,54 @@ public:
      */
     bool unsubscribe(loop_listener & listener);
 
+    /**
+     * @brief Arm the timer, re-arming an armed timer moves its expiry
+     *
+     * @param listener the timer listener
+     * @param timeout the time from now until the timer fires
+     */
+    void arm(timer_listener & listener, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Cancel the timer
+     *
+     * @param listener the timer listener
+     */
+    void cancel(timer_listener & listener);
+
+    /**
+     * @brief Get the monotonic time the timers are based on
+     *
+     * @return uint64_t the time in milliseconds
+     */
+    static uint64_t now();
+
 private:
-    bool         running_{ false };  ///< the running flag
-    int          epfd_{ -1 };        ///< the epoll file descriptor
-    on_loop_list on_loop_list_{ };   ///< the loop listener list
+    /**
+     * @brief Wait for io events
+     *
+     * @param events the events array
+     * @param max the capacity of the events array
+     * @param timeout the timeout in milliseconds, -1 to wait forever
+     * @return int the number of events, -1 on error
+     */
+    int wait(epoll_event * events, int max, int timeout);
+
+    /**
+     * @brief Run the posted tasks
+     */
+    void run_tasks();
+
+    std::atomic<bool>                running_{ false };  ///< the running flag
+    int                              epfd_{ -1 };        ///< the epoll file descriptor
+    std::unique_ptr<io_uring_poller> uring_{ };          ///< the io_uring poller, replaces epoll if set
+    on_loop_list                     on_loop_list_{ };   ///< the loop listener list
+    timer_wheel                      timers_{ now() };   ///< the timers
+    task_queue                       tasks_{ };          ///< the posted tasks
+    std::unique_ptr<notifier>        notifier_{ };       ///< the wakeup notifier of the posted tasks
+    bool                             local_{ false };    ///< a task was posted on the dispatcher thread, the next wait does not block
+
+    static thread_local event_dispatcher *current_;  ///< the dispatcher running on the thread
 };
 
 inline io_listener::io_listener(int fd)
@@ -263,23 +447,57 @@ inline int io_listener::fd() const
     return fd_;
 }
 
-inline event_dispatcher::event_dispatcher(event_dispatcher && other) noexcept
-    : epfd_{ other.epfd_ }
+inline void event_dispatcher::stop()
 {
-    other.epfd_ = -1;
+    running_.store(false, std::memory_order_relaxed);
+    notifier_->notify();
 }
 
-inline void event_dispatcher::stop()
+inline void event_dispatcher::post(task & t)
+{
+    tasks_.push(t);
+
+    // the dispatcher thread runs the tasks before it waits again
+    if (current_ == this) {
+        local_ = true;
+        return;
+    }
+
+    notifier_->notify();
+}
+
+inline void event_dispatcher::arm(timer_listener & listener, std::chrono::milliseconds timeout)
+{
+    timers_.arm(listener, now() + timeout.count());
+}
+
+inline void event_dispatcher::cancel(timer_listener & listener)
+{
+    timer_wheel::cancel(listener);
+}
+
+inline event_dispatcher * event_dispatcher::current()
+{
+    return current_;
+}
+
+inline uint64_t event_dispatcher::now()
+{
+    auto const since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch).count();
+}
+
+inline event_dispatcher::backend event_dispatcher::get_backend() const
 {
-    running_ = false;
+    return uring_ ? backend::io_uring : backend::epoll;
 }
 
 inline event_dispatcher::operator bool() const
 {
-    return epfd_ >= 0;
+    return epfd_ >= 0 || uring_;
 }
 
 inline bool event_dispatcher::operator!() const
 {
-    return epfd_ < 0;
+    return epfd_ < 0 && !uring_;
 }
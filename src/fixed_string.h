@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+/**
+ * @brief A string with its storage inline, for values of a known bounded length
+ *
+ * @tparam N the capacity
+ */
+template <size_t N>
+class fixed_string
+{
+public:
+    /**
+     * @brief Replace the content
+     *
+     * @param s the new content
+     * @return true if \b s fits
+     * @return false if \b s is longer than the capacity, the content is left empty
+     */
+    bool assign(std::string_view s);
+
+    /**
+     * @brief Get the content
+     */
+    std::string_view view() const;
+
+    bool empty() const;
+
+    size_t size() const;
+
+private:
+    char   data_[N];    ///< the characters
+    size_t size_{ 0 };  ///< the length
+};
+
+template <size_t N>
+inline bool fixed_string<N>::assign(std::string_view s)
+{
+    if (s.size() > N) {
+        size_ = 0;
+        return false;
+    }
+
+    memcpy(data_, s.data(), s.size());
+    size_ = s.size();
+    return true;
+}
+
+template <size_t N>
+inline std::string_view fixed_string<N>::view() const
+{
+    return { data_, size_ };
+}
+
+template <size_t N>
+inline bool fixed_string<N>::empty() const
+{
+    return size_ == 0;
+}
+
+template <size_t N>
+inline size_t fixed_string<N>::size() const
+{
+    return size_;
+}
@@ -0,0 +1,55 @@
+#include "frame_pool.h"
+
+#include <new>
+
+thread_local frame_pool::free_lists frame_pool::free_;
+
+frame_pool::free_lists::~free_lists()
+{
+    for (auto & list : lists) {
+        while (list.head) {
+            auto const block = list.head;
+            list.head = block->next;
+            ::operator delete(block);
+        }
+    }
+}
+
+void * frame_pool::allocate(size_t size)
+{
+    if (size == 0 || size > max_size) {
+        return ::operator new(size);
+    }
+
+    // reuse a released block of the size class
+    auto const index = (size - 1) / granularity;
+    auto & list = free_.lists[index];
+    if (list.head) {
+        auto const block = list.head;
+        list.head = block->next;
+        --list.count;
+        return block;
+    }
+
+    return ::operator new((index + 1) * granularity);
+}
+
+void frame_pool::deallocate(void * p, size_t size) noexcept
+{
+    if (size == 0 || size > max_size) {
+        ::operator delete(p);
+        return;
+    }
+
+    auto const index = (size - 1) / granularity;
+    auto & list = free_.lists[index];
+    if (list.count >= max_free) {
+        ::operator delete(p);
+        return;
+    }
+
+    auto const block = static_cast<free_block *>(p);
+    block->next = list.head;
+    list.head = block;
+    ++list.count;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief The per thread pool of small blocks, backs the stackless coroutine frames,
+ * the stackless connections and their receive buffers
+ *
+ * Blocks are rounded up to a 64 byte size class, each class keeps a freelist of up to
+ * max_free released blocks threaded through the blocks themselves. Blocks larger than
+ * the largest class go to the global allocator. A block must be released on the
+ * thread that allocated it, a connection never leaves its reactor thread.
+ */
+class frame_pool
+{
+public:
+    static constexpr size_t granularity = 64;  ///< the size class step
+    static constexpr size_t max_size = 4096;   ///< the largest pooled block
+    static constexpr size_t max_free = 1024;   ///< the released blocks kept per size class
+
+    /**
+     * @brief Allocate a block
+     *
+     * @param size the block size
+     * @return void* the block
+     * @throw std::bad_alloc if the block cannot be allocated
+     */
+    static void * allocate(size_t size);
+
+    /**
+     * @brief Release a block
+     *
+     * @param p the block
+     * @param size the size the block was allocated with
+     */
+    static void deallocate(void * p, size_t size) noexcept;
+
+private:
+    static constexpr size_t class_count = max_size / granularity;
+
+    /**
+     * @brief The released block, links the freelist
+     */
+    struct free_block
+    {
+        free_block *next;  ///< the next released block
+    };
+
+    /**
+     * @brief The freelist of a size class
+     */
+    struct free_list
+    {
+        free_block *head{ nullptr };  ///< the last released block
+        size_t      count{ 0 };       ///< the number of released blocks
+    };
+
+    /**
+     * @brief The freelists of the calling thread
+     */
+    struct free_lists
+    {
+        ~free_lists();
+
+        free_list lists[class_count]{ };  ///< the freelists per size class
+    };
+
+    static thread_local free_lists free_;  ///< the freelists of the thread
+};
@@ -1,6 +1,10 @@
 #include "http_request.h"
 #include "llhttp.h"
 
+#include <strings.h>
+
+#include "body_consumer.h"
+
 const llhttp_settings_t http_request::settings_ = {
     .on_message_begin                  = &http_request::on_message_begin,
     .on_url                            = &http_request::on_url,
@@ -32,11 +36,84 @@ int http_request::on_message_begin(llhttp_t *parser)
     return HPE_OK;
 }
 
+std::string_view http_request::header(std::string_view name) const
+{
+    // the well-known headers are indexed while parsing
+    auto const id = identify(name);
+    if (id != known_header::count) {
+        return header(id);
+    }
+
+    for (size_t i = 0; i < header_count_; ++i) {
+        auto const n = view(headers_[i].name);
+        if (n.size() == name.size() && strncasecmp(n.data(), name.data(), n.size()) == 0) {
+            return view(headers_[i].value);
+        }
+    }
+
+    return { };
+}
+
+http_request::known_header http_request::identify(std::string_view name)
+{
+    // the well-known names differ in length, one comparison tells
+    auto const is = [name](const char *known) {
+        return strncasecmp(name.data(), known, name.size()) == 0;
+    };
+
+    switch (name.size()) {
+    case 4:  return is("host") ? known_header::host : known_header::count;
+    case 6:  return is("expect") ? known_header::expect : known_header::count;
+    case 10: return is("connection") ? known_header::connection : known_header::count;
+    case 12: return is("content-type") ? known_header::content_type : known_header::count;
+    case 14: return is("content-length") ? known_header::content_length : known_header::count;
+    case 17: return is("transfer-encoding") ? known_header::transfer_encoding : known_header::count;
+    default: return known_header::count;
+    }
+}
+
+bool http_request::expects_continue() const
+{
+    auto const expect = header(known_header::expect);
+    return expect.size() == 12 && strncasecmp(expect.data(), "100-continue", 12) == 0;
+}
+
+bool http_request::extend(token &t, const char *data, size_t size) const
+{
+    auto const offset = static_cast<uint32_t>(data - buffer_.origin());
+    if (t.size == 0) {
+        t.offset = offset;
+        t.size = static_cast<uint32_t>(size);
+        return true;
+    }
+
+    if (t.offset + t.size == offset) {
+        t.size += static_cast<uint32_t>(size);
+        return true;
+    }
+
+    return false;
+}
+
+void http_request::end_header()
+{
+    // index the first occurrence of a well-known header
+    auto const id = identify(view(headers_[header_count_].name));
+    if (id != known_header::count) {
+        auto & known = known_[static_cast<size_t>(id)];
+        if (known == 0) {
+            known = static_cast<uint8_t>(header_count_ + 1);
+        }
+    }
+
+    in_value_ = false;
+    ++header_count_;
+}
+
 int http_request::on_url(llhttp_t *parser, const char *data, size_t size)
 {
     auto & request = *static_cast<http_request *>(parser->data);
-    request.url_.append(data, size);
-    return HPE_OK;
+    return request.extend(request.url_, data, size) ? HPE_OK : -1;
 }
 
 int http_request::on_status(llhttp_t *parser, const char *data, size_t size)
@@ -56,12 +133,25 @@ int http_request::on_version(llhttp_t *parser, const char *data, size_t size)
 
 int http_request::on_field_header(llhttp_t *parser, const char *data, size_t size)
 {
-    return HPE_OK;
+    auto & request = *static_cast<http_request *>(parser->data);
+
+    // a name after a value starts the next header
+    if (request.in_value_) {
+        request.end_header();
+    }
+
+    if (request.header_count_ == max_headers) {
+        return -1;
+    }
+
+    return request.extend(request.headers_[request.header_count_].name, data, size) ? HPE_OK : -1;
 }
 
 int http_request::on_field_value(llhttp_t *parser, const char *data, size_t size)
 {
-    return HPE_OK;
+    auto & request = *static_cast<http_request *>(parser->data);
+    request.in_value_ = true;
+    return request.extend(request.headers_[request.header_count_].value, data, size) ? HPE_OK : -1;
 }
 
 int http_request::on_chunk_extension_name(llhttp_t *parser, const char *data, size_t size)
@@ -76,13 +166,69 @@ int http_request::on_chunk_extension_value(llhttp_t *parser, const char *data, s
 
 int http_request::on_headers_complete(llhttp_t *parser)
 {
+    auto & request = *static_cast<http_request *>(parser->data);
+
+    // count the last header
+    if (request.in_value_) {
+        request.end_header();
+    }
+
+    request.is_headers_completed_ = true;
+
+    // the listener finds the route, its body limit and its body consumer
+    if (request.listener_) {
+        request.rejected_ = request.listener_->on_headers(request);
+        if (request.rejected_ != 0) {
+            return -1;
+        }
+    }
+
+    // reject a declared body over the limit before receiving it
+    if (request.body_limit_ != 0 && (parser->flags & F_CONTENT_LENGTH) && parser->content_length > request.body_limit_) {
+        request.rejected_ = 413;
+        return -1;
+    }
+
     return HPE_OK;
 }
 
 int http_request::on_body(llhttp_t *parser, const char *data, size_t size)
 {
     auto & request = *static_cast<http_request *>(parser->data);
-    request.body_.append(data, size);
+
+    // a chunked body is checked as it arrives
+    request.body_size_ += size;
+    if (request.body_limit_ != 0 && request.body_size_ > request.body_limit_) {
+        request.rejected_ = 413;
+        return -1;
+    }
+
+    // a streamed body is handed over and not kept
+    if (request.consumer_) {
+        if (request.streamed_offset_ == 0) {
+            request.streamed_offset_ = static_cast<uint32_t>(data - request.buffer_.origin());
+        }
+
+        if (!request.consumer_->on_body({ data, size })) {
+            request.rejected_ = 400;
+            return -1;
+        }
+
+        return HPE_OK;
+    }
+
+    if (request.is_body_copied_) {
+        request.body_copy_.append(data, size);
+        return HPE_OK;
+    }
+
+    // the chunks of a chunked body are not contiguous, copy them
+    if (!request.extend(request.body_, data, size)) {
+        request.body_copy_.assign(request.view(request.body_));
+        request.body_copy_.append(data, size);
+        request.is_body_copied_ = true;
+    }
+
     return HPE_OK;
 }
 
@@ -90,7 +236,9 @@ int http_request::on_message_complete(llhttp_t *parser)
 {
     auto & request = *static_cast<http_request *>(parser->data);
     request.is_completed_ = true;
-    return HPE_OK;
+
+    // stop parsing, the data after the request belongs to the next one
+    return HPE_PAUSED;
 }
 
 int http_request::on_url_complete(llhttp_t *parser)
@@ -120,6 +268,9 @@ int http_request::on_header_field_complete(llhttp_t *parser)
 
 int http_request::on_header_value_complete(llhttp_t *parser)
 {
+    // an empty value has no data callback
+    auto & request = *static_cast<http_request *>(parser->data);
+    request.in_value_ = true;
     return HPE_OK;
 }
 
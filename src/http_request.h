@@ -1,12 +1,86 @@
 #pragma once
 
+#include <sys/types.h>
+
 #include <llhttp.h>
 #include <string>
+#include <string_view>
+
+#include "recv_buffer.h"
+
+class body_consumer;
+class http_request;
+
+/**
+ * @brief The receiver of the parsed request header
+ */
+class request_listener
+{
+public:
+    /**
+     * @brief Called once the request header is parsed, before any body data, may set the
+     * body limit and the body consumer of the request
+     *
+     * @param request the request
+     * @return unsigned 0 to accept the request, otherwise the status it is rejected with
+     */
+    virtual unsigned on_headers(http_request &request) = 0;
 
+protected:
+    ~request_listener() = default;
+};
+
+/**
+ * @brief The http request, parsed in place from the receive buffer of the connection
+ *
+ * The url, the headers and the body are views into the receive buffer, kept as offsets
+ * from the origin of the request so they survive the buffer moving the request. A body
+ * split into several chunks is the only part copied.
+ */
 class http_request
 {
+    /**
+     * @brief The range of a token, relative to the origin of the request
+     */
+    struct token
+    {
+        uint32_t offset{ 0 };  ///< the offset from the origin
+        uint32_t size{ 0 };    ///< the token size
+    };
+
+    /**
+     * @brief The header, a name and a value
+     */
+    struct header_token
+    {
+        token name{ };   ///< the header name
+        token value{ };  ///< the header value
+    };
+
 public:
-    http_request();
+    static constexpr size_t max_headers = 32;  ///< the headers kept, a request with more fails to parse
+
+    /**
+     * @brief The headers identified while parsing, looked up without comparing names
+     */
+    enum class known_header : uint8_t
+    {
+        host,
+        expect,
+        connection,
+        content_type,
+        content_length,
+        transfer_encoding,
+        count
+    };
+
+    /**
+     * @brief Construct a new http request object
+     *
+     * @param buffer the receive buffer the request is parsed from
+     * @param listener the receiver of the parsed header, nullptr if none
+     */
+    explicit http_request(const recv_buffer &buffer, request_listener *listener = nullptr);
 
     ~http_request() = default;
 
@@ -18,11 +92,118 @@ public:
 
     void operator=(http_request &&) = delete;
 
-    int parse(const char *data, size_t size);
+    /**
+     * @brief Parse the unparsed data of the receive buffer, stops at the end of the request
+     *
+     * @return ssize_t the number of bytes consumed, the rest belongs to the next request, -1 on
+     * error or if the request is rejected
+     */
+    ssize_t parse();
+
+    /**
+     * @brief Get the status the request is rejected with
+     *
+     * @return unsigned the status, 0 if the request is not rejected
+     */
+    unsigned rejected() const;
+
+    /**
+     * @brief Limit the body size, a larger body is rejected with 413, set from the listener
+     *
+     * @param max the largest body size, 0 for unlimited
+     */
+    void set_body_limit(size_t max);
+
+    /**
+     * @brief Stream the body to a consumer instead of keeping it, set from the listener
+     *
+     * @param consumer the consumer
+     */
+    void set_body_consumer(body_consumer *consumer);
+
+    /**
+     * @brief Get the offset of the streamed body from the origin, the receive buffer may
+     * drop the parsed data past it
+     *
+     * @return size_t the offset, 0 if no body data has been streamed
+     */
+    size_t streamed_body_offset() const;
+
+    /**
+     * @brief Check if the client waits for 100 Continue before sending the body
+     */
+    bool expects_continue() const;
 
     bool is_completed() const;
 
-    const std::string &url() const;
+    /**
+     * @brief Check if the connection may stay open after the request, per the version and Connection header
+     */
+    bool should_keep_alive() const;
+
+    /**
+     * @brief Get the request method
+     */
+    llhttp_method_t method() const;
+
+    uint8_t http_major() const;
+
+    uint8_t http_minor() const;
+
+    bool is_headers_completed() const;
+
+    /**
+     * @brief Get the url
+     */
+    std::string_view url() const;
+
+    /**
+     * @brief Get the body
+     */
+    std::string_view body() const;
+
+    /**
+     * @brief Get a header value
+     *
+     * @param name the header name, compared case-insensitively
+     * @return std::string_view the first value, empty if the header is missing
+     */
+    std::string_view header(std::string_view name) const;
+
+    /**
+     * @brief Get a well-known header value
+     *
+     * @param id the header
+     * @return std::string_view the first value, empty if the header is missing
+     */
+    std::string_view header(known_header id) const;
+
+    /**
+     * @brief Identify a well-known header name
+     *
+     * @param name the header name, compared case-insensitively
+     * @return known_header the header, known_header::count if the name is not a well-known one
+     */
+    static known_header identify(std::string_view name);
+
+    /**
+     * @brief Get the number of headers
+     */
+    size_t header_count() const;
+
+    /**
+     * @brief Get the name of a header
+     *
+     * @param i the header index
+     */
+    std::string_view header_name(size_t i) const;
+
+    /**
+     * @brief Get the value of a header
+     *
+     * @param i the header index
+     */
+    std::string_view header_value(size_t i) const;
 
 protected:
     static int on_message_begin(llhttp_t *parser);
@@ -72,15 +253,56 @@ protected:
     static int on_reset(llhttp_t *parser);
 
 private:
-    llhttp_t    parser_{ };
-    std::string url_{ };
-    std::string body_{ };
-    bool        is_completed_{ false };
+    static constexpr auto known_count = static_cast<size_t>(known_header::count);
+
+    /**
+     * @brief Extend a token with a parsed fragment
+     *
+     * @param t the token
+     * @param data the fragment
+     * @param size the fragment size
+     * @return true if the fragment follows the token in the buffer
+     * @return false if the fragment is not contiguous with the token
+     */
+    bool extend(token &t, const char *data, size_t size) const;
+
+    /**
+     * @brief Count the header being parsed, indexes it if it is a well-known one
+     */
+    void end_header();
+
+    /**
+     * @brief Get the view of a token
+     *
+     * @param t the token
+     */
+    std::string_view view(const token &t) const;
+
+    llhttp_t           parser_{ };                     ///< the parser
+    const recv_buffer &buffer_;                        ///< the receive buffer
+    request_listener  *listener_{ nullptr };           ///< the receiver of the parsed header
+    body_consumer     *consumer_{ nullptr };           ///< the body consumer, nullptr if the body is kept
+    uint64_t           body_size_{ 0 };                ///< the body bytes parsed
+    size_t             body_limit_{ 0 };               ///< the largest body size, 0 for unlimited
+    uint32_t           streamed_offset_{ 0 };          ///< the streamed body offset, 0 if none
+    unsigned           rejected_{ 0 };                 ///< the rejection status, 0 if accepted
+    token              url_{ };                        ///< the url
+    token              body_{ };                       ///< the body, while it is contiguous
+    std::string        body_copy_{ };                  ///< the body, once it is split into chunks
+    header_token       headers_[max_headers]{ };       ///< the headers
+    size_t             header_count_{ 0 };             ///< the number of headers
+    uint8_t            known_[known_count]{ };         ///< the well-known header indexes plus one, 0 if missing
+    bool               in_value_{ false };             ///< the parser is in a header value
+    bool               is_body_copied_{ false };       ///< the body is held in body_copy_
+    bool               is_completed_{ false };         ///< the request is parsed
+    bool               is_headers_completed_{ false }; ///< the request header is parsed
 
     static const llhttp_settings_t settings_;
 };
 
-inline http_request::http_request()
+inline http_request::http_request(const recv_buffer &buffer, request_listener *listener)
+    : buffer_{ buffer }
+    , listener_{ listener }
 {
     // initialize parser
     llhttp_init(&parser_, HTTP_REQUEST, &settings_);
@@ -89,14 +311,41 @@ inline http_request::http_request()
     parser_.data = this;
 }
 
-inline int http_request::parse(const char *data, size_t size)
+inline ssize_t http_request::parse()
 {
+    auto const data = buffer_.unparsed();
+    auto const size = buffer_.unparsed_size();
     auto const err = llhttp_execute(&parser_, data, size);
-    if (err != HPE_OK) {
-        return -1;
+    if (err == HPE_OK) {
+        return static_cast<ssize_t>(size);
+    }
+
+    // paused at the end of the request, a pipelined request may follow
+    if (err == HPE_PAUSED) {
+        return llhttp_get_error_pos(&parser_) - data;
     }
 
-    return 0;
+    return -1;
+}
+
+inline unsigned http_request::rejected() const
+{
+    return rejected_;
+}
+
+inline void http_request::set_body_limit(size_t max)
+{
+    body_limit_ = max;
+}
+
+inline void http_request::set_body_consumer(body_consumer *consumer)
+{
+    consumer_ = consumer;
+}
+
+inline size_t http_request::streamed_body_offset() const
+{
+    return streamed_offset_;
 }
 
 inline bool http_request::is_completed() const
@@ -104,7 +353,63 @@ inline bool http_request::is_completed() const
     return is_completed_;
 }
 
-inline const std::string &http_request::url() const
+inline bool http_request::should_keep_alive() const
+{
+    return llhttp_should_keep_alive(&parser_) != 0;
+}
+
+inline llhttp_method_t http_request::method() const
+{
+    return static_cast<llhttp_method_t>(parser_.method);
+}
+
+inline uint8_t http_request::http_major() const
+{
+    return parser_.http_major;
+}
+
+inline uint8_t http_request::http_minor() const
+{
+    return parser_.http_minor;
+}
+
+inline bool http_request::is_headers_completed() const
+{
+    return is_headers_completed_;
+}
+
+inline std::string_view http_request::url() const
+{
+    return view(url_);
+}
+
+inline std::string_view http_request::body() const
+{
+    return is_body_copied_ ? std::string_view{ body_copy_ } : view(body_);
+}
+
+inline std::string_view http_request::header(known_header id) const
+{
+    auto const i = known_[static_cast<size_t>(id)];
+    return i != 0 ? view(headers_[i - 1].value) : std::string_view{ };
+}
+
+inline size_t http_request::header_count() const
+{
+    return header_count_;
+}
+
+inline std::string_view http_request::header_name(size_t i) const
+{
+    return view(headers_[i].name);
+}
+
+inline std::string_view http_request::header_value(size_t i) const
+{
+    return view(headers_[i].value);
+}
+
+inline std::string_view http_request::view(const token &t) const
 {
-    return url_;
+    return { buffer_.origin() + t.offset, t.size };
 }
\ No newline at end of file
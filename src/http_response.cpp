@@ -0,0 +1,79 @@
+#include "http_response.h"
+
+#include <charconv>
+
+std::string_view http_response::reason(unsigned status)
+{
+    switch (status) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 415: return "Unsupported Media Type";
+    case 417: return "Expectation Failed";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default:  return "Unknown";
+    }
+}
+
+void http_response::serialize_header(std::string &out, connection_header connection) const
+{
+    char num[20];
+
+    // a body written into the send buffer ends where the header block starts
+    auto const body_size = output_offset_ != std::string::npos ? output_->size() - output_offset_ : body_.size();
+
+    // status line
+    out.append("HTTP/1.1 ");
+    auto const status = std::to_chars(num, num + sizeof num, status_);
+    out.append(num, status.ptr);
+    out.push_back(' ');
+    out.append(reason(status_));
+    out.append("\r\n");
+
+    // content length, a streamed body is sent in chunks
+    if (producer_) {
+        out.append("Transfer-Encoding: chunked\r\n");
+    } else {
+        out.append("Content-Length: ");
+        auto const length = std::to_chars(num, num + sizeof num, body_size);
+        out.append(num, length.ptr);
+        out.append("\r\n");
+    }
+
+    // extra headers
+    for (size_t i = 0; i < header_count_; ++i) {
+        out.append(headers_[i].name);
+        out.append(": ");
+        out.append(headers_[i].value);
+        out.append("\r\n");
+    }
+
+    switch (connection) {
+    case connection_header::close:      out.append("Connection: close\r\n"); break;
+    case connection_header::keep_alive: out.append("Connection: keep-alive\r\n"); break;
+    default:                            break;
+    }
+
+    out.append("\r\n");
+}
@@ -1,10 +1,68 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <utility>
+
+class http_response;
+
+/**
+ * @brief The listener of a deferred response, the connection the response is sent on
+ */
+class response_listener
+{
+public:
+    /**
+     * @brief Take over a response its handler deferred
+     *
+     * @param response the response, moved from
+     * @return http_response* the response the handler completes later
+     */
+    virtual http_response * on_response_deferred(http_response && response) = 0;
+
+    /**
+     * @brief The handler completed the deferred response
+     */
+    virtual void on_response_completed() = 0;
+
+protected:
+    ~response_listener() = default;
+};
 
 class http_response
 {
+    /**
+     * @brief The extra header, views of the caller's name and value
+     */
+    struct header
+    {
+        std::string_view name{ };   ///< the header name
+        std::string_view value{ };  ///< the header value
+    };
+
 public:
+    static constexpr size_t max_headers = 8;  ///< the extra headers a response may carry
+
+    /**
+     * @brief The producer of a streamed body, appends the next chunk to \b chunk and returns
+     * false once the body is complete
+     */
+    using producer = std::function<bool(std::string &chunk)>;
+
+    /**
+     * @brief The Connection header line of a response
+     */
+    enum class connection_header
+    {
+        none,        ///< no header, the connection stays open by http/1.1 default
+        close,       ///< Connection: close
+        keep_alive,  ///< Connection: keep-alive, sent to http/1.0 clients
+        count
+    };
+
     /**
      * @brief Construct a new http response object
      */
@@ -25,6 +83,58 @@ public:
      */
     const std::string &body() const;
 
+    /**
+     * @brief get the buffer to write the body into, the connection's send buffer once the
+     * response is bound to it, the body otherwise
+     *
+     * The body is everything appended to the buffer after the first call until the
+     * handler returns, the buffer must not be modified otherwise.
+     */
+    std::string &output();
+
+    /**
+     * @brief bind the response to the send buffer, done by the connection before calling
+     * the handler
+     *
+     * @param out the send buffer
+     */
+    void bind(std::string &out);
+
+    /**
+     * @brief set the listener of a deferred response, done by the connection before calling
+     * the handler
+     *
+     * @param listener the connection
+     */
+    void listen(response_listener &listener);
+
+    /**
+     * @brief defer the response, the handler returns without it and completes it later on
+     * the connection's thread, the connection waits for it without blocking its event loop
+     *
+     * The responses of the requests pipelined after this one are queued once it is complete.
+     *
+     * @return http_response* the response to fill and complete, this one is left empty
+     */
+    http_response *defer();
+
+    /**
+     * @brief complete a deferred response, the connection sends it
+     */
+    void complete();
+
+    /**
+     * @brief check if the response is deferred and not complete yet
+     */
+    bool is_deferred() const;
+
+    /**
+     * @brief get the offset of the body written into the bound send buffer
+     *
+     * @return size_t the offset, npos if the body is not in the send buffer
+     */
+    size_t output_offset() const;
+
     /**
      * @brief get the response status
      */
@@ -35,9 +145,75 @@ public:
      */
     void status(unsigned status);
 
+    /**
+     * @brief stream the body with chunked transfer encoding, the connection calls the
+     * producer for the next chunk once the previous one is written, the body is ignored
+     *
+     * @param p the producer
+     */
+    void stream(producer p);
+
+    /**
+     * @brief check if the body is streamed
+     */
+    bool is_streamed() const;
+
+    /**
+     * @brief get the producer of the streamed body
+     */
+    producer &body_producer();
+
+    /**
+     * @brief make the response wait for a record of the commit log, the connection sends it
+     * once the record is on stable storage
+     *
+     * @param sequence the sequence number of the record, the last one the handler logged
+     */
+    void wait_for(uint64_t sequence);
+
+    /**
+     * @brief get the sequence number of the log record the response waits for, 0 if none
+     */
+    uint64_t log_sequence() const;
+
+    /**
+     * @brief add a header, the name and value are not copied and must stay valid until the
+     * handler has returned, string literals or storage owned by the handler's user data
+     *
+     * @param name the header name
+     * @param value the header value
+     * @return true if the header is added
+     * @return false if the response already carries max_headers extra headers
+     */
+    bool add_header(std::string_view name, std::string_view value);
+
+    /**
+     * @brief append the status line and the header block to \b out
+     *
+     * @param out the output
+     * @param connection the Connection header line
+     */
+    void serialize_header(std::string &out, connection_header connection) const;
+
+    /**
+     * @brief get the reason phrase of a status code
+     *
+     * @param status the status code
+     * @return std::string_view the reason phrase, "Unknown" for unlisted codes
+     */
+    static std::string_view reason(unsigned status);
+
 private:
-    std::string body_{};
-    unsigned    status_{ 0 };
+    std::string         body_{};
+    std::string       * output_{ nullptr };
+    response_listener * listener_{ nullptr };
+    bool                deferred_{ false };
+    size_t              output_offset_{ std::string::npos };
+    producer            producer_{ };
+    unsigned            status_{ 0 };
+    header              headers_[max_headers]{ };
+    size_t              header_count_{ 0 };
+    uint64_t            log_sequence_{ 0 };
 };
 
 inline std::string &http_response::body()
@@ -50,6 +226,53 @@ inline const std::string &http_response::body() const
     return body_;
 }
 
+inline std::string &http_response::output()
+{
+    if (!output_) {
+        return body_;
+    }
+
+    if (output_offset_ == std::string::npos) {
+        output_offset_ = output_->size();
+    }
+
+    return *output_;
+}
+
+inline void http_response::bind(std::string &out)
+{
+    output_ = &out;
+}
+
+inline void http_response::listen(response_listener &listener)
+{
+    listener_ = &listener;
+}
+
+inline http_response *http_response::defer()
+{
+    auto const deferred = listener_->on_response_deferred(std::move(*this));
+    deferred->deferred_ = true;
+    deferred_ = true;
+    return deferred;
+}
+
+inline void http_response::complete()
+{
+    deferred_ = false;
+    listener_->on_response_completed();
+}
+
+inline bool http_response::is_deferred() const
+{
+    return deferred_;
+}
+
+inline size_t http_response::output_offset() const
+{
+    return output_offset_;
+}
+
 inline unsigned http_response::status() const
 {
     return status_;
@@ -59,3 +282,38 @@ inline void http_response::status(unsigned status)
 {
     status_ = status;
 }
+
+inline void http_response::stream(producer p)
+{
+    producer_ = std::move(p);
+}
+
+inline bool http_response::is_streamed() const
+{
+    return static_cast<bool>(producer_);
+}
+
+inline http_response::producer & http_response::body_producer()
+{
+    return producer_;
+}
+
+inline void http_response::wait_for(uint64_t sequence)
+{
+    log_sequence_ = sequence;
+}
+
+inline uint64_t http_response::log_sequence() const
+{
+    return log_sequence_;
+}
+
+inline bool http_response::add_header(std::string_view name, std::string_view value)
+{
+    if (header_count_ == max_headers) {
+        return false;
+    }
+
+    headers_[header_count_++] = header{ name, value };
+    return true;
+}
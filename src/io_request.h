@@ -0,0 +1,76 @@
+#pragma once
+
+class io_uring_poller;
+
+/**
+ * @brief A receive or a send completed by the io_uring backend
+ *
+ * The request object is the user data of its submission entry, it must stay alive and
+ * is not submitted again until on_complete is called, a cancelled request completes too.
+ */
+class io_request
+{
+    friend io_uring_poller;
+
+public:
+    io_request() = default;
+
+    virtual ~io_request() = default;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    io_request(const io_request &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const io_request &) = delete;
+
+    /**
+     * @brief Check if the request is submitted and not completed yet
+     */
+    bool pending() const;
+
+    /**
+     * @brief Get the result of the completed request
+     *
+     * @return int the bytes received or sent, 0 if the peer closed the connection, -errno
+     * on error
+     */
+    int result() const;
+
+    /**
+     * @brief Get the received data
+     *
+     * @return const char* the buffer of the ring the data was received into, valid until
+     * on_complete returns, nullptr if it was received into the buffer of the request
+     */
+    const char * data() const;
+
+protected:
+    /**
+     * @brief The on complete callback, called on the event dispatcher thread
+     */
+    virtual void on_complete() = 0;
+
+private:
+    const char *data_{ nullptr };    ///< the buffer of the ring holding the received data
+    int         result_{ 0 };        ///< the result
+    bool        pending_{ false };   ///< the request is submitted
+};
+
+inline bool io_request::pending() const
+{
+    return pending_;
+}
+
+inline int io_request::result() const
+{
+    return result_;
+}
+
+inline const char * io_request::data() const
+{
+    return data_;
+}
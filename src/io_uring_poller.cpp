@@ -0,0 +1,560 @@
+#include "io_uring_poller.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace {
+
+constexpr uint64_t accept_bit = uint64_t{ 1 } << 63;   ///< tags the user data of the accept requests
+constexpr uint64_t remove_bit = uint64_t{ 1 } << 62;   ///< tags the user data of the cancel requests
+constexpr uint64_t request_bit = uint64_t{ 1 } << 61;  ///< tags the user data of the io_request objects
+constexpr uint16_t buffer_group = 0;                   ///< the group of the buffer ring
+
+inline int io_uring_setup(unsigned entries, io_uring_params * params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+inline int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                          const void * arg, size_t arg_size)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+inline int io_uring_register(int fd, unsigned opcode, void * arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/**
+ * @brief Pack a file descriptor and its subscription generation into the user data
+ */
+inline uint64_t make_user_data(int fd, uint32_t generation)
+{
+    return (uint64_t{ static_cast<uint32_t>(fd) } << 32) | generation;
+}
+
+/**
+ * @brief Get the file descriptor of the user data
+ */
+inline size_t user_data_fd(uint64_t user_data)
+{
+    return static_cast<size_t>((user_data & ~(accept_bit | remove_bit)) >> 32);
+}
+
+template <typename T>
+inline T * ring_offset(void * ring, unsigned offset)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+
+}
+
+io_uring_poller::io_uring_poller(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+
+    // create the ring
+    ring_fd_ = io_uring_setup(entries, &params);
+    if (ring_fd_ < 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot setup io_uring" };
+    }
+
+    // the wait timeout needs IORING_FEAT_EXT_ARG, the single mapping keeps the setup simple
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring_fd_);
+        throw std::system_error{ ENOSYS, std::system_category(), "io_uring lacks required features" };
+    }
+
+    // map the submission and completion rings
+    auto const sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    auto const cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring_size_ = std::max<size_t>(sq_size, cq_size);
+    ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (ring_ == MAP_FAILED) {
+        auto const err = errno;
+        close(ring_fd_);
+        throw std::system_error{ err, std::system_category(), "cannot map io_uring rings" };
+    }
+
+    // map the submission entries
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    auto const sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        auto const err = errno;
+        munmap(ring_, ring_size_);
+        close(ring_fd_);
+        throw std::system_error{ err, std::system_category(), "cannot map io_uring submission entries" };
+    }
+
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    // locate the ring fields
+    sq_head_ = ring_offset<unsigned>(ring_, params.sq_off.head);
+    sq_tail_ = ring_offset<unsigned>(ring_, params.sq_off.tail);
+    sq_mask_ = *ring_offset<unsigned>(ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+    cq_head_ = ring_offset<unsigned>(ring_, params.cq_off.head);
+    cq_tail_ = ring_offset<unsigned>(ring_, params.cq_off.tail);
+    cq_mask_ = *ring_offset<unsigned>(ring_, params.cq_off.ring_mask);
+    cqes_ = ring_offset<io_uring_cqe>(ring_, params.cq_off.cqes);
+
+    // entries are submitted in order, map the submission array one to one
+    auto const array = ring_offset<unsigned>(ring_, params.sq_off.array);
+    for (auto i = 0u; i < sq_entries_; ++i) {
+        array[i] = i;
+    }
+
+    setup_buffers();
+}
+
+io_uring_poller::~io_uring_poller()
+{
+    // the connections accepted ahead and never taken
+    for (auto const & s : slots_) {
+        for (auto i = s.taken; i < s.accepted.size(); ++i) {
+            close(s.accepted[i]);
+        }
+    }
+
+    if (buf_ring_) {
+        io_uring_buf_reg reg{ };
+        reg.bgid = buffer_group;
+        io_uring_register(ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(buf_ring_, buffer_count * sizeof(io_uring_buf) + buffer_count * buffer_size);
+    }
+
+    munmap(sqes_, sqes_size_);
+    munmap(ring_, ring_size_);
+    close(ring_fd_);
+}
+
+bool io_uring_poller::add(int fd, uint32_t events, void * ptr)
+{
+    if (fd < 0) {
+        return false;
+    }
+
+    if (static_cast<size_t>(fd) >= slots_.size()) {
+        slots_.resize(fd + 1);
+    }
+
+    auto & s = slots_[fd];
+    if (s.ptr) {
+        return false;
+    }
+
+    s.ptr = ptr;
+    s.events = events & (EPOLLIN | EPOLLOUT | EPOLLEXCLUSIVE);
+    if (s.events != 0) {
+        arm(fd);
+    }
+
+    return true;
+}
+
+bool io_uring_poller::add_acceptor(int fd, void * ptr)
+{
+    if (fd < 0) {
+        return false;
+    }
+
+    if (static_cast<size_t>(fd) >= slots_.size()) {
+        slots_.resize(fd + 1);
+    }
+
+    auto & s = slots_[fd];
+    if (s.ptr) {
+        return false;
+    }
+
+    s.ptr = ptr;
+    s.events = EPOLLIN;
+    s.accepting = true;
+    arm(fd);
+    return true;
+}
+
+int io_uring_poller::accept(int fd)
+{
+    if (fd < 0 || static_cast<size_t>(fd) >= slots_.size() || !slots_[fd].accepting) {
+        return accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    }
+
+    // the connections accepted ahead come first, then the error that ended the accepts
+    auto & s = slots_[fd];
+    if (s.taken < s.accepted.size()) {
+        auto const conn = s.accepted[s.taken++];
+        if (s.taken == s.accepted.size()) {
+            s.accepted.clear();
+            s.taken = 0;
+        }
+
+        return conn;
+    }
+
+    errno = s.error ? s.error : EAGAIN;
+    s.error = 0;
+    return -1;
+}
+
+bool io_uring_poller::remove(int fd)
+{
+    if (fd < 0 || static_cast<size_t>(fd) >= slots_.size() || !slots_[fd].ptr) {
+        return false;
+    }
+
+    // cancel the armed request, its late completions are dropped by the generation check,
+    // a socket used with io_request objects only has none
+    auto & s = slots_[fd];
+    if (s.events != 0) {
+        cancel(user_data(fd));
+    }
+
+    // the connections accepted ahead are not taken any more
+    for (auto i = s.taken; i < s.accepted.size(); ++i) {
+        close(s.accepted[i]);
+    }
+
+    s.ptr = nullptr;
+    s.accepting = false;
+    s.error = 0;
+    s.taken = 0;
+    s.accepted.clear();
+    ++s.generation;
+    return true;
+}
+
+void io_uring_poller::receive(int fd, io_request & r)
+{
+    auto const sqe = submit(r);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = buffer_size;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+}
+
+void io_uring_poller::receive(int fd, void * buf, size_t len, io_request & r)
+{
+    auto const sqe = submit(r);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+}
+
+void io_uring_poller::send(int fd, const msghdr & msg, io_request & r)
+{
+    auto const sqe = submit(r);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+void io_uring_poller::cancel(io_request & r)
+{
+    if (r.pending_) {
+        cancel(reinterpret_cast<uint64_t>(&r) | request_bit);
+    }
+}
+
+void io_uring_poller::complete()
+{
+    // on_complete may submit the request again, it is done with the buffer once it returns
+    for (auto i = 0u; i < completed_.size(); ++i) {
+        completed_[i].request->on_complete();
+    }
+
+    auto recycled = false;
+    for (auto const & c : completed_) {
+        if (c.buffer >= 0) {
+            recycle(static_cast<unsigned>(c.buffer));
+            recycled = true;
+        }
+    }
+
+    // publish the buffers given back once
+    if (recycled) {
+        auto & tail = static_cast<io_uring_buf_ring *>(buf_ring_)->tail;
+        std::atomic_ref<uint16_t>{ tail }.store(buf_tail_, std::memory_order_release);
+    }
+
+    completed_.clear();
+}
+
+int io_uring_poller::wait(epoll_event * events, int max, int timeout)
+{
+    // re-arm the polls completed in the previous round, now that they have been dispatched
+    for (auto const user_data : rearm_) {
+        auto const fd = static_cast<int>(user_data_fd(user_data));
+        auto const & s = slots_[fd];
+        if (s.ptr && s.generation == static_cast<uint32_t>(user_data)) {
+            arm(fd);
+        }
+    }
+
+    rearm_.clear();
+
+    // submit the queued requests and wait for completions in one system call
+    __kernel_timespec ts{ };
+    io_uring_getevents_arg arg{ };
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000LL;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    auto const to_submit = flush();
+    auto const ret = io_uring_enter(ring_fd_, to_submit, timeout == 0 ? 0 : 1,
+                                    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+    if (ret < 0 && errno != ETIME && errno != EBUSY) {
+        return -1;
+    }
+
+    return reap(events, max);
+}
+
+int io_uring_poller::reap(epoll_event * events, int max)
+{
+    auto n = 0;
+    auto head = *cq_head_;
+    auto const tail = std::atomic_ref<unsigned>{ *cq_tail_ }.load(std::memory_order_acquire);
+    while (head != tail && n < max) {
+        auto const & cqe = cqes_[head & cq_mask_];
+        ++head;
+
+        // a request being woken cannot be cancelled, it would keep its file open, cancel it
+        // again until it is gone, an io_request being woken completes anyway
+        if (cqe.user_data & remove_bit) {
+            if (cqe.res == -EALREADY && !(cqe.user_data & request_bit)) {
+                cancel(cqe.user_data & ~remove_bit);
+            }
+
+            continue;
+        }
+
+        // the request completed, on_complete is called once the events are dispatched
+        if (cqe.user_data & request_bit) {
+            auto const r = reinterpret_cast<io_request *>(cqe.user_data & ~request_bit);
+            completion c{ r, -1 };
+            r->data_ = nullptr;
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                c.buffer = static_cast<int>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                r->data_ = buffers_ + c.buffer * buffer_size;
+            }
+
+            r->result_ = cqe.res;
+            r->pending_ = false;
+            completed_.push_back(c);
+            continue;
+        }
+
+        // skip the completions of the removed subscriptions, closing what they accepted
+        auto const fd = user_data_fd(cqe.user_data);
+        if (fd >= slots_.size() || !slots_[fd].ptr || slots_[fd].generation != static_cast<uint32_t>(cqe.user_data)) {
+            if ((cqe.user_data & accept_bit) && cqe.res >= 0) {
+                close(cqe.res);
+            }
+
+            continue;
+        }
+
+        auto & s = slots_[fd];
+        if (cqe.user_data & accept_bit) {
+            if (accepted(s, cqe)) {
+                events[n].events = EPOLLIN;
+                events[n].data.ptr = s.ptr;
+                ++n;
+            }
+
+            continue;
+        }
+
+        if (cqe.res < 0) {
+            // the kernel is too old for exclusive poll, wake every poller instead
+            if (cqe.res == -EINVAL && (s.events & EPOLLEXCLUSIVE)) {
+                s.events &= ~EPOLLEXCLUSIVE;
+                rearm_.push_back(cqe.user_data);
+                continue;
+            }
+
+            // the kernel is too old for multishot poll, use one shot polls from now on
+            if (cqe.res == -EINVAL && multishot_) {
+                multishot_ = false;
+                rearm_.push_back(cqe.user_data);
+                continue;
+            }
+
+            // the poll failed and is finished, arm it again unless the file is gone, and
+            // wake the listener in the directions it waits for so its own recv or send
+            // reports the error instead of waiting for an event that never comes
+            if (cqe.res != -EBADF) {
+                rearm_.push_back(cqe.user_data);
+            }
+
+            events[n].events = (s.events & (EPOLLIN | EPOLLOUT)) | EPOLLERR;
+            events[n].data.ptr = s.ptr;
+            ++n;
+            continue;
+        }
+
+        // the poll is finished, arm it again after the events are dispatched
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            rearm_.push_back(cqe.user_data);
+        }
+
+        events[n].events = static_cast<uint32_t>(cqe.res);
+        events[n].data.ptr = s.ptr;
+        ++n;
+    }
+
+    std::atomic_ref<unsigned>{ *cq_head_ }.store(head, std::memory_order_release);
+    return n;
+}
+
+io_uring_sqe * io_uring_poller::get_sqe()
+{
+    // the submission queue is full, hand the queued entries to the kernel first
+    auto const head = std::atomic_ref<unsigned>{ *sq_head_ }.load(std::memory_order_acquire);
+    if (sq_local_tail_ - head >= sq_entries_) {
+        io_uring_enter(ring_fd_, flush(), 0, 0, nullptr, 0);
+    }
+
+    auto const sqe = &sqes_[sq_local_tail_ & sq_mask_];
+    ++sq_local_tail_;
+    memset(sqe, 0, sizeof *sqe);
+    return sqe;
+}
+
+bool io_uring_poller::accepted(slot & s, const io_uring_cqe & cqe)
+{
+    // the kernel is too old for multishot accept, poll the socket and accept on readiness
+    if (cqe.res == -EINVAL) {
+        s.accepting = false;
+        rearm_.push_back(cqe.user_data);
+        return false;
+    }
+
+    // wake the listener once for all the completions it has not taken yet
+    auto const idle = s.taken == s.accepted.size() && s.error == 0;
+    if (cqe.res >= 0) {
+        s.accepted.push_back(cqe.res);
+    } else {
+        s.error = -cqe.res;
+    }
+
+    // the accepts are finished, by an error or an overflow, arm them again after the
+    // listener took the connections unless the socket is gone
+    if (!(cqe.flags & IORING_CQE_F_MORE) && cqe.res != -EBADF) {
+        rearm_.push_back(cqe.user_data);
+    }
+
+    return idle;
+}
+
+void io_uring_poller::cancel(uint64_t target)
+{
+    auto const sqe = get_sqe();
+    sqe->opcode = target & (accept_bit | request_bit) ? IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = target | remove_bit;
+}
+
+uint64_t io_uring_poller::user_data(int fd) const
+{
+    auto const & s = slots_[fd];
+    auto const data = make_user_data(fd, s.generation);
+    return s.accepting ? data | accept_bit : data;
+}
+
+void io_uring_poller::arm(int fd)
+{
+    auto const & s = slots_[fd];
+    auto const sqe = get_sqe();
+    if (s.accepting) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = user_data(fd);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = s.events;
+    sqe->len = multishot_ && !(s.events & EPOLLEXCLUSIVE) ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = user_data(fd);
+}
+
+void io_uring_poller::setup_buffers()
+{
+    // the ring and the buffers share one mapping, the ring fills the first page
+    auto const ring_size = buffer_count * sizeof(io_uring_buf);
+    auto const size = ring_size + buffer_count * buffer_size;
+    auto const ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ring == MAP_FAILED) {
+        return;
+    }
+
+    // the kernel is too old for provided buffer rings, receives use the buffer of the caller
+    io_uring_buf_reg reg{ };
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = buffer_count;
+    reg.bgid = buffer_group;
+    if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, size);
+        return;
+    }
+
+    buf_ring_ = ring;
+    buffers_ = static_cast<char *>(ring) + ring_size;
+    for (auto i = 0u; i < buffer_count; ++i) {
+        recycle(i);
+    }
+
+    auto & tail = static_cast<io_uring_buf_ring *>(buf_ring_)->tail;
+    std::atomic_ref<uint16_t>{ tail }.store(buf_tail_, std::memory_order_release);
+}
+
+io_uring_sqe * io_uring_poller::submit(io_request & r)
+{
+    auto const sqe = get_sqe();
+    sqe->user_data = reinterpret_cast<uint64_t>(&r) | request_bit;
+    r.data_ = nullptr;
+    r.result_ = 0;
+    r.pending_ = true;
+    return sqe;
+}
+
+void io_uring_poller::recycle(unsigned id)
+{
+    // the entry is published with the tail, the ring is indexed as an array since the
+    // flexible bufs member of io_uring_buf_ring is misplaced when compiled as C++
+    auto & buf = static_cast<io_uring_buf *>(buf_ring_)[buf_tail_ & (buffer_count - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers_ + id * buffer_size);
+    buf.len = buffer_size;
+    buf.bid = static_cast<uint16_t>(id);
+    ++buf_tail_;
+}
+
+unsigned io_uring_poller::flush()
+{
+    std::atomic_ref<unsigned>{ *sq_tail_ }.store(sq_local_tail_, std::memory_order_release);
+    return sq_local_tail_ - std::atomic_ref<unsigned>{ *sq_head_ }.load(std::memory_order_acquire);
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <sys/epoll.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "io_request.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct msghdr;
+
+/**
+ * @brief The io_uring readiness poller
+ *
+ * Keeps the readiness model of epoll, every subscribed file descriptor is armed with
+ * a multishot IORING_OP_POLL_ADD, so registering, removing and waiting are batched
+ * into a single io_uring_enter per loop iteration. A listening socket is armed with a
+ * multishot IORING_OP_ACCEPT instead, the kernel accepts its connections as they come
+ * and the listener takes them from the slot without a system call.
+ *
+ * A socket subscribed without events is not polled, it is received from and sent to
+ * with io_request objects. A receive picks a buffer of the ring registered with the
+ * kernel once data arrives, so a pending receive holds no memory, and the buffer goes
+ * back to the ring once the request completed. The receives and the sends queued in a
+ * loop iteration are submitted together by the io_uring_enter of the next wait.
+ *
+ * Completions carry the file descriptor and a generation number instead of the
+ * listener pointer, a completion posted for a removed subscription is dropped, and
+ * the connection it accepted, if any, is closed. The completion of an io_request
+ * carries the request, which outlives it.
+ */
+class io_uring_poller
+{
+    /**
+     * @brief The subscription of a file descriptor
+     */
+    struct slot
+    {
+        void            *ptr{ nullptr };     ///< the user pointer, nullptr if not subscribed
+        uint32_t         events{ 0 };        ///< the poll events
+        uint32_t         generation{ 0 };    ///< the generation of the subscription
+        bool             accepting{ false }; ///< connections are accepted by the ring
+        int              error{ 0 };         ///< the error that ended the accepts, 0 if none
+        size_t           taken{ 0 };         ///< the accepted connections already taken
+        std::vector<int> accepted{ };        ///< the connections accepted by the ring
+    };
+
+    /**
+     * @brief A completed io_request, dispatched after the events
+     */
+    struct completion
+    {
+        io_request *request{ nullptr };  ///< the request
+        int         buffer{ -1 };        ///< the buffer of the ring holding its data, -1 if none
+    };
+
+public:
+    static constexpr unsigned buffer_count = 256;   ///< the buffers of the ring, a power of 2
+    static constexpr size_t   buffer_size = 4096;   ///< the size of a buffer of the ring
+
+    /**
+     * @brief Construct a new io_uring poller object
+     *
+     * @param entries the number of submission queue entries
+     * @throw std::system_error if io_uring is not available
+     */
+    explicit io_uring_poller(unsigned entries = 256);
+
+    /**
+     * @brief Destroy the io_uring poller object
+     */
+    ~io_uring_poller();
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    io_uring_poller(const io_uring_poller &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const io_uring_poller &) = delete;
+
+    /**
+     * @brief Arm the poll of a file descriptor
+     *
+     * @param fd the file descriptor
+     * @param events the epoll events, EPOLLIN, EPOLLOUT or EPOLLEXCLUSIVE, none for a socket
+     * used with io_request objects only
+     * @param ptr the user pointer reported with the events
+     * @return true if the file descriptor is armed
+     * @return false if the file descriptor is already armed
+     */
+    bool add(int fd, uint32_t events, void * ptr);
+
+    /**
+     * @brief Arm the multishot accept of a listening socket
+     *
+     * Falls back to a poll for EPOLLIN if the kernel cannot accept ahead.
+     *
+     * @param fd the listening socket
+     * @param ptr the user pointer reported with EPOLLIN once connections are accepted
+     * @return true if the socket is armed
+     * @return false if the socket is already armed
+     */
+    bool add_acceptor(int fd, void * ptr);
+
+    /**
+     * @brief Take a connection of a listening socket
+     *
+     * @param fd the listening socket
+     * @return int the connection, non-blocking and close-on-exec, -1 with errno set if
+     *         none is pending (EAGAIN) or accepting failed
+     */
+    int accept(int fd);
+
+    /**
+     * @brief Cancel the poll of a file descriptor
+     *
+     * @param fd the file descriptor
+     * @return true if the file descriptor is cancelled
+     * @return false if the file descriptor is not armed
+     */
+    bool remove(int fd);
+
+    /**
+     * @brief Check if receives can pick a buffer of the ring, the kernel registered it
+     */
+    bool provides_buffers() const;
+
+    /**
+     * @brief Queue a receive into a buffer of the ring
+     *
+     * @param fd the socket
+     * @param r the request, completes with -ENOBUFS if the ring is empty
+     */
+    void receive(int fd, io_request & r);
+
+    /**
+     * @brief Queue a receive into a buffer of the caller
+     *
+     * @param fd the socket
+     * @param buf the buffer, must stay valid until the request completes
+     * @param len the buffer length
+     * @param r the request
+     */
+    void receive(int fd, void * buf, size_t len, io_request & r);
+
+    /**
+     * @brief Queue a sendmsg
+     *
+     * @param fd the socket
+     * @param msg the message, it and its data must stay valid until the request completes
+     * @param r the request
+     */
+    void send(int fd, const msghdr & msg, io_request & r);
+
+    /**
+     * @brief Queue the cancellation of a pending request, it completes with -ECANCELED or
+     * its result if it was done already
+     *
+     * @param r the request
+     */
+    void cancel(io_request & r);
+
+    /**
+     * @brief Call on_complete on the requests completed by the last wait, their buffers go
+     * back to the ring afterwards
+     */
+    void complete();
+
+    /**
+     * @brief Submit the pending requests and wait for events
+     *
+     * @param events the events array, same layout as epoll_wait
+     * @param max the capacity of the events array
+     * @param timeout the timeout in milliseconds, -1 to wait forever
+     * @return int the number of events, -1 on error with errno set
+     */
+    int wait(epoll_event * events, int max, int timeout);
+
+private:
+    /**
+     * @brief Get a free submission queue entry, flushing the queue if it is full
+     */
+    io_uring_sqe * get_sqe();
+
+    /**
+     * @brief Collect the posted completions
+     *
+     * @param events the events array
+     * @param max the capacity of the events array
+     * @return int the number of events
+     */
+    int reap(epoll_event * events, int max);
+
+    /**
+     * @brief Queue the poll request of a slot
+     *
+     * @param fd the file descriptor
+     */
+    void arm(int fd);
+
+    /**
+     * @brief Queue the cancellation of an armed request
+     *
+     * @param target the user data of the request
+     */
+    void cancel(uint64_t target);
+
+    /**
+     * @brief Get the user data of the request armed for a slot
+     *
+     * @param fd the file descriptor
+     */
+    uint64_t user_data(int fd) const;
+
+    /**
+     * @brief Record an accept completion
+     *
+     * @param s the slot of the listening socket
+     * @param cqe the completion
+     * @return true if the listener is to be woken
+     */
+    bool accepted(slot & s, const io_uring_cqe & cqe);
+
+    /**
+     * @brief Publish the queued submission entries to the kernel
+     *
+     * @return unsigned the number of entries to submit
+     */
+    unsigned flush();
+
+    /**
+     * @brief Register the buffer ring, receives need a buffer of the caller if it fails
+     */
+    void setup_buffers();
+
+    /**
+     * @brief Queue a request
+     *
+     * @param r the request
+     * @return io_uring_sqe* the submission entry, its user data set
+     */
+    io_uring_sqe * submit(io_request & r);
+
+    /**
+     * @brief Give a buffer back to the ring
+     *
+     * @param id the buffer id
+     */
+    void recycle(unsigned id);
+
+    int                 ring_fd_{ -1 };        ///< the io_uring file descriptor
+    void               *ring_{ nullptr };      ///< the mapped sq/cq rings
+    size_t              ring_size_{ 0 };       ///< the size of the mapped rings
+    io_uring_sqe       *sqes_{ nullptr };      ///< the mapped submission entries
+    size_t              sqes_size_{ 0 };       ///< the size of the mapped submission entries
+    unsigned           *sq_head_{ nullptr };   ///< the submission queue head
+    unsigned           *sq_tail_{ nullptr };   ///< the submission queue tail
+    unsigned            sq_mask_{ 0 };         ///< the submission queue mask
+    unsigned            sq_entries_{ 0 };      ///< the submission queue size
+    unsigned            sq_local_tail_{ 0 };   ///< the tail of the not yet published entries
+    unsigned           *cq_head_{ nullptr };   ///< the completion queue head
+    unsigned           *cq_tail_{ nullptr };   ///< the completion queue tail
+    unsigned            cq_mask_{ 0 };         ///< the completion queue mask
+    io_uring_cqe       *cqes_{ nullptr };      ///< the completion queue entries
+    bool                multishot_{ true };    ///< whether the kernel supports multishot poll
+    std::vector<slot>   slots_{ };               ///< the subscriptions indexed by file descriptor
+    std::vector<uint64_t> rearm_{ };           ///< the finished polls to arm after dispatching
+    std::vector<completion> completed_{ };     ///< the completed requests to dispatch
+    void               *buf_ring_{ nullptr };  ///< the buffer ring shared with the kernel, nullptr if not registered
+    char               *buffers_{ nullptr };   ///< the buffers of the ring
+    uint16_t            buf_tail_{ 0 };        ///< the tail of the buffer ring
+};
+
+inline bool io_uring_poller::provides_buffers() const
+{
+    return buf_ring_ != nullptr;
+}
@@ -0,0 +1,246 @@
+#include "ipam.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+bool ipv4_prefix::parse(std::string_view text, ipv4_prefix & prefix)
+{
+    auto const slash = text.find('/');
+    auto const address = text.substr(0, slash);
+    char buffer[INET_ADDRSTRLEN];
+    if (address.empty() || address.size() >= sizeof buffer) {
+        return false;
+    }
+
+    memcpy(buffer, address.data(), address.size());
+    buffer[address.size()] = '\0';
+    in_addr addr;
+    if (inet_pton(AF_INET, buffer, &addr) != 1) {
+        return false;
+    }
+
+    int length = 32;
+    if (slash != std::string_view::npos) {
+        auto const digits = text.substr(slash + 1);
+        auto const [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), length);
+        if (ec != std::errc{ } || end != digits.data() + digits.size() || digits.empty() || length < 0 || length > 32) {
+            return false;
+        }
+    }
+
+    prefix.address = ntohl(addr.s_addr);
+    prefix.length = length;
+    return true;
+}
+
+ipam::ipam(const ipv4_prefix & default_range)
+    : default_range_{ default_range }
+    , default_slots_{ size_t{ 1 } << (24 - default_range.length) }
+{
+}
+
+ipam::result ipam::request_pool(std::string_view pool, ipv4_prefix & created)
+{
+    if (!pool.empty()) {
+        ipv4_prefix network;
+        if (!ipv4_prefix::parse(pool, network) || network.length < min_length || (network.address & (network.size() - 1)) != 0) {
+            return result::invalid;
+        }
+
+        if (overlaps(network)) {
+            return result::overlaps;
+        }
+
+        add(network, address_bitmap::npos);
+        created = network;
+        return result::ok;
+    }
+
+    // the lowest free /24 of the default range, the ones overlapping a requested pool are
+    // held while searching and handed back after
+    std::vector<size_t> skipped;
+    ipv4_prefix network{ 0, 24 };
+    auto slot = default_slots_.allocate();
+    while (slot != address_bitmap::npos) {
+        network.address = default_range_.address + static_cast<uint32_t>(slot << 8);
+        if (!overlaps(network)) {
+            break;
+        }
+
+        skipped.push_back(slot);
+        slot = default_slots_.allocate();
+    }
+
+    for (auto const s : skipped) {
+        default_slots_.release(s);
+    }
+
+    if (slot == address_bitmap::npos) {
+        return result::exhausted;
+    }
+
+    add(network, slot);
+    created = network;
+    return result::ok;
+}
+
+ipam::result ipam::release_pool(std::string_view pool_id)
+{
+    ipv4_prefix network;
+    if (!ipv4_prefix::parse(pool_id, network)) {
+        return result::invalid;
+    }
+
+    for (auto it = pools_.begin(); it != pools_.end(); ++it) {
+        if (it->network.address == network.address && it->network.length == network.length) {
+            if (it->slot != address_bitmap::npos) {
+                default_slots_.release(it->slot);
+            }
+
+            pools_.erase(it);
+            return result::ok;
+        }
+    }
+
+    return result::not_found;
+}
+
+ipam::result ipam::request_address(std::string_view pool_id, std::string_view address, ipv4_prefix & allocated)
+{
+    auto const p = find(pool_id);
+    if (!p) {
+        return result::not_found;
+    }
+
+    size_t offset;
+    if (address.empty()) {
+        offset = p->addresses.allocate();
+        if (offset == address_bitmap::npos) {
+            return result::exhausted;
+        }
+    } else {
+        ipv4_prefix requested;
+        if (!ipv4_prefix::parse(address, requested)) {
+            return result::invalid;
+        }
+
+        // the network and broadcast addresses are marked in the bitmap and read as in use,
+        // they are outside the usable range instead
+        offset = requested.address - p->network.address;
+        if (offset >= p->network.size() || (p->reserved != 0 && (offset == 0 || offset == p->network.size() - 1))) {
+            return result::invalid;
+        }
+
+        if (!p->addresses.allocate(offset)) {
+            return result::in_use;
+        }
+    }
+
+    allocated.address = p->network.address + static_cast<uint32_t>(offset);
+    allocated.length = p->network.length;
+    return result::ok;
+}
+
+ipam::result ipam::release_address(std::string_view pool_id, std::string_view address)
+{
+    auto const p = find(pool_id);
+    if (!p) {
+        return result::not_found;
+    }
+
+    ipv4_prefix released;
+    if (!ipv4_prefix::parse(address, released)) {
+        return result::invalid;
+    }
+
+    auto const offset = static_cast<size_t>(released.address - p->network.address);
+    if (offset >= p->network.size() || (p->reserved != 0 && (offset == 0 || offset == p->network.size() - 1))) {
+        return result::not_found;
+    }
+
+    return p->addresses.release(offset) ? result::ok : result::not_found;
+}
+
+const char * ipam::message(result r)
+{
+    switch (r) {
+    case result::ok:
+        return "ok";
+    case result::invalid:
+        return "invalid pool or address";
+    case result::overlaps:
+        return "pool overlaps an existing pool";
+    case result::not_found:
+        return "pool or address not found";
+    case result::in_use:
+        return "address in use";
+    case result::exhausted:
+        return "no free pool or address";
+    }
+
+    return "unknown error";
+}
+
+size_t ipam::address_count() const
+{
+    size_t count = 0;
+    for (auto const & p : pools_) {
+        count += p.addresses.used() - p.reserved;
+    }
+
+    return count;
+}
+
+size_t ipam::memory() const
+{
+    auto bytes = default_slots_.memory();
+    for (auto const & p : pools_) {
+        bytes += p.addresses.memory();
+    }
+
+    return bytes;
+}
+
+ipam::pool * ipam::find(std::string_view pool_id)
+{
+    ipv4_prefix network;
+    if (!ipv4_prefix::parse(pool_id, network)) {
+        return nullptr;
+    }
+
+    for (auto & p : pools_) {
+        if (p.network.address == network.address && p.network.length == network.length) {
+            return &p;
+        }
+    }
+
+    return nullptr;
+}
+
+bool ipam::overlaps(const ipv4_prefix & network) const
+{
+    // two aligned networks overlap when the shorter prefix covers the other's address
+    for (auto const & p : pools_) {
+        auto const length = std::min(p.network.length, network.length);
+        auto const mask = length == 0 ? 0 : ~uint32_t{ 0 } << (32 - length);
+        if ((p.network.address & mask) == (network.address & mask)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ipam::add(const ipv4_prefix & network, size_t slot)
+{
+    pools_.push_back(pool{ network, address_bitmap{ network.size() }, 0, slot });
+    auto & p = pools_.back();
+    if (network.length <= 30) {
+        p.addresses.allocate(0);
+        p.addresses.allocate(network.size() - 1);
+        p.reserved = 2;
+    }
+}
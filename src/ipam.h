@@ -0,0 +1,180 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "address_bitmap.h"
+
+/**
+ * @brief An ipv4 network, the address in host byte order and the prefix length
+ */
+struct ipv4_prefix
+{
+    /**
+     * @brief Parse an address with or without a prefix, "10.0.0.0/24" or "10.0.0.5"
+     *
+     * @param text the text
+     * @param prefix the parsed address, the prefix is 32 when missing
+     * @return true if \b text is well-formed
+     */
+    static bool parse(std::string_view text, ipv4_prefix & prefix);
+
+    /**
+     * @brief Get the number of addresses the prefix covers
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the address in network byte order
+     */
+    in_addr addr() const;
+
+    uint32_t address{ 0 };  ///< the address, host byte order
+    int      length{ 32 };  ///< the prefix length
+};
+
+/**
+ * @brief The ipv4 address manager of the docker ipam driver api
+ *
+ * A pool keeps its addresses in a hierarchical bitmap, the lowest free address is found
+ * with one word per level and allocating or releasing touches one word per level, so the
+ * cost does not grow with the pool size or its fill. The network and broadcast addresses
+ * of pools larger than a /31 are never handed out.
+ *
+ * A pool request naming no pool gets the next free /24 of the default range. The pool id
+ * is the network in cidr form. The pools are few and looked up linearly. The ipam is not
+ * thread safe, the callers hold a mutex.
+ */
+class ipam
+{
+public:
+    /**
+     * @brief The outcome of a request
+     */
+    enum class result
+    {
+        ok,         ///< done
+        invalid,    ///< a malformed pool or address
+        overlaps,   ///< the pool overlaps an existing one
+        not_found,  ///< the pool or address is unknown
+        in_use,     ///< the address is allocated already
+        exhausted,  ///< no free pool or address is left
+    };
+
+    static constexpr int min_length = 8;  ///< the largest pool, a /8
+
+    /**
+     * @brief Construct a new ipam object
+     *
+     * @param default_range the range the default /24 pools are carved from, a /16 to /24
+     */
+    explicit ipam(const ipv4_prefix & default_range = { 0xac1e0000, 16 });
+
+    /**
+     * @brief Create a pool
+     *
+     * @param pool the requested pool in cidr form, empty for a default pool
+     * @param created the pool created
+     * @return result ok, invalid, overlaps or exhausted
+     */
+    result request_pool(std::string_view pool, ipv4_prefix & created);
+
+    /**
+     * @brief Remove a pool with its addresses
+     *
+     * @param pool_id the pool id
+     * @return result ok, invalid or not_found
+     */
+    result release_pool(std::string_view pool_id);
+
+    /**
+     * @brief Allocate an address of a pool
+     *
+     * @param pool_id the pool id
+     * @param address the requested address, empty for the lowest free one
+     * @param allocated the address allocated, with the pool prefix length
+     * @return result ok, invalid, not_found, in_use or exhausted
+     */
+    result request_address(std::string_view pool_id, std::string_view address, ipv4_prefix & allocated);
+
+    /**
+     * @brief Release an address of a pool
+     *
+     * @param pool_id the pool id
+     * @param address the address, with or without a prefix length
+     * @return result ok, invalid or not_found
+     */
+    result release_address(std::string_view pool_id, std::string_view address);
+
+    /**
+     * @brief Get the text of a result
+     */
+    static const char * message(result r);
+
+    /**
+     * @brief Get the number of pools
+     */
+    size_t pool_count() const;
+
+    /**
+     * @brief Get the number of allocated addresses in all pools
+     */
+    size_t address_count() const;
+
+    /**
+     * @brief Get the bytes held by the pool bitmaps
+     */
+    size_t memory() const;
+
+private:
+    /**
+     * @brief A pool and its addresses
+     */
+    struct pool
+    {
+        ipv4_prefix    network;    ///< the pool network
+        address_bitmap addresses;  ///< the allocated addresses, the offset from the network
+        size_t         reserved;   ///< the network and broadcast addresses marked in the bitmap
+        size_t         slot;       ///< the index in the default range, address_bitmap::npos if requested
+    };
+
+    /**
+     * @brief Find a pool by its id
+     *
+     * @return pool* the pool, nullptr if unknown
+     */
+    pool * find(std::string_view pool_id);
+
+    /**
+     * @brief Check if a network overlaps an existing pool
+     */
+    bool overlaps(const ipv4_prefix & network) const;
+
+    /**
+     * @brief Add a pool
+     */
+    void add(const ipv4_prefix & network, size_t slot);
+
+    ipv4_prefix       default_range_;  ///< the range of the default pools
+    address_bitmap    default_slots_;  ///< the /24 of the default range handed out
+    std::vector<pool> pools_{ };       ///< the pools
+};
+
+inline size_t ipv4_prefix::size() const
+{
+    return size_t{ 1 } << (32 - length);
+}
+
+inline in_addr ipv4_prefix::addr() const
+{
+    return in_addr{ htonl(address) };
+}
+
+inline size_t ipam::pool_count() const
+{
+    return pools_.size();
+}
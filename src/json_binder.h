@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "fixed_string.h"
+#include "json_parser.h"
+
+/**
+ * @brief The position of a value in a json document, the member names and the array
+ * indexes leading to it from the root
+ */
+class json_path
+{
+    template <typename Target>
+    friend class json_binder;
+
+public:
+    static constexpr size_t max_depth = 8;  ///< the deepest position tracked
+    static constexpr size_t max_key = 64;   ///< the longest member name tracked
+
+    /**
+     * @brief Get the number of segments
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the member name of a segment
+     *
+     * @param i the segment index
+     * @return std::string_view the name, empty for an array element
+     */
+    std::string_view key(size_t i) const;
+
+    /**
+     * @brief Check the path
+     *
+     * @param segments the member names and array indexes, from the root
+     * @return true if the path has exactly these segments
+     */
+    template <typename... Segments>
+    bool is(Segments... segments) const;
+
+    /**
+     * @brief Check the beginning of the path
+     *
+     * @param segments the member names and array indexes, from the root
+     * @return true if the path begins with these segments
+     */
+    template <typename... Segments>
+    bool starts_with(Segments... segments) const;
+
+private:
+    /**
+     * @brief The member name or array index of one level
+     */
+    struct segment
+    {
+        fixed_string<max_key> key{ };          ///< the member name of an object level
+        size_t                index{ 0 };      ///< the element index of an array level
+        bool                  array{ false };  ///< the level is an array
+    };
+
+    bool match(size_t i, std::string_view key) const;
+
+    bool match(size_t i, int index) const;
+
+    segment segments_[max_depth]{ };  ///< the levels
+    size_t  depth_{ 0 };              ///< the nesting depth, may exceed max_depth
+};
+
+/**
+ * @brief The json handler binding scalar values to a target by their path
+ *
+ * The target has a bool set(const json_path &, std::string_view) member called for every
+ * string, number and literal found no deeper than json_path::max_depth, it returns false
+ * to reject the document. Nothing is allocated, the target keeps what it needs.
+ *
+ * @tparam Target the target type
+ */
+template <typename Target>
+class json_binder final
+    : public json_handler
+{
+public:
+    /**
+     * @brief Get the target
+     */
+    Target &target();
+
+    bool on_object_begin() override;
+
+    bool on_object_end() override;
+
+    bool on_array_begin() override;
+
+    bool on_array_end() override;
+
+    bool on_key(std::string_view key) override;
+
+    bool on_string(std::string_view value) override;
+
+    bool on_number(std::string_view value) override;
+
+    bool on_literal(std::string_view value) override;
+
+private:
+    /**
+     * @brief Enter an object or an array
+     */
+    void push(bool array);
+
+    /**
+     * @brief Leave an object or an array
+     */
+    void pop();
+
+    /**
+     * @brief Pass a scalar to the target
+     */
+    bool set(std::string_view value);
+
+    /**
+     * @brief Move to the next element of an enclosing array
+     */
+    void next();
+
+    Target    target_{ };  ///< the target
+    json_path path_{ };    ///< the current position
+};
+
+inline size_t json_path::size() const
+{
+    return depth_ < max_depth ? depth_ : max_depth;
+}
+
+inline std::string_view json_path::key(size_t i) const
+{
+    return segments_[i].array ? std::string_view{ } : segments_[i].key.view();
+}
+
+template <typename... Segments>
+inline bool json_path::is(Segments... segments) const
+{
+    return depth_ == sizeof...(Segments) && starts_with(segments...);
+}
+
+template <typename... Segments>
+inline bool json_path::starts_with(Segments... segments) const
+{
+    size_t i = 0;
+    return depth_ >= sizeof...(Segments) && sizeof...(Segments) <= max_depth && (match(i++, segments) && ...);
+}
+
+inline bool json_path::match(size_t i, std::string_view key) const
+{
+    return !segments_[i].array && segments_[i].key.view() == key;
+}
+
+inline bool json_path::match(size_t i, int index) const
+{
+    return segments_[i].array && segments_[i].index == static_cast<size_t>(index);
+}
+
+template <typename Target>
+inline Target & json_binder<Target>::target()
+{
+    return target_;
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_object_begin()
+{
+    push(false);
+    return true;
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_object_end()
+{
+    pop();
+    return true;
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_array_begin()
+{
+    push(true);
+    return true;
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_array_end()
+{
+    pop();
+    return true;
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_key(std::string_view key)
+{
+    if (path_.depth_ <= json_path::max_depth) {
+        path_.segments_[path_.depth_ - 1].key.assign(key);
+    }
+
+    return true;
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_string(std::string_view value)
+{
+    return set(value);
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_number(std::string_view value)
+{
+    return set(value);
+}
+
+template <typename Target>
+inline bool json_binder<Target>::on_literal(std::string_view value)
+{
+    return set(value);
+}
+
+template <typename Target>
+inline void json_binder<Target>::push(bool array)
+{
+    if (path_.depth_ < json_path::max_depth) {
+        auto & s = path_.segments_[path_.depth_];
+        s.key.assign({ });
+        s.index = 0;
+        s.array = array;
+    }
+
+    ++path_.depth_;
+}
+
+template <typename Target>
+inline void json_binder<Target>::pop()
+{
+    --path_.depth_;
+    next();
+}
+
+template <typename Target>
+inline bool json_binder<Target>::set(std::string_view value)
+{
+    auto const ok = path_.depth_ > json_path::max_depth || target_.set(path_, value);
+    next();
+    return ok;
+}
+
+template <typename Target>
+inline void json_binder<Target>::next()
+{
+    if (path_.depth_ != 0 && path_.depth_ <= json_path::max_depth) {
+        auto & s = path_.segments_[path_.depth_ - 1];
+        if (s.array) {
+            ++s.index;
+        }
+    }
+}
@@ -0,0 +1,441 @@
+#include "json_parser.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool json_parser::feed(std::string_view data, json_handler &handler)
+{
+    auto p = data.data();
+    auto const end = p + data.size();
+
+    // the first byte of the token in this fragment
+    auto token = p;
+
+    while (p < end) {
+        switch (state_) {
+        case state::string: {
+            auto const q = scan_string(p, end);
+
+            // a surrogate pair is two adjacent escapes
+            if (high_surrogate_ != 0 && (q != p || (q < end && *q != '\\'))) {
+                state_ = state::error;
+                return false;
+            }
+
+            if (q == end) {
+                if (!save({ token, static_cast<size_t>(end - token) })) {
+                    return false;
+                }
+
+                p = end;
+            } else if (*q == '"') {
+                if (!emit({ token, static_cast<size_t>(q - token) }, handler)) {
+                    return false;
+                }
+
+                p = q + 1;
+            } else if (*q == '\\') {
+                if (!save({ token, static_cast<size_t>(q - token) })) {
+                    return false;
+                }
+
+                state_ = state::escape;
+                p = q + 1;
+            } else {
+                // an unescaped control character
+                state_ = state::error;
+                return false;
+            }
+            break;
+        }
+        case state::escape: {
+            auto const c = *p++;
+            if (high_surrogate_ != 0 && c != 'u') {
+                state_ = state::error;
+                return false;
+            }
+
+            char unescaped;
+            switch (c) {
+            case '"':  unescaped = '"'; break;
+            case '\\': unescaped = '\\'; break;
+            case '/':  unescaped = '/'; break;
+            case 'b':  unescaped = '\b'; break;
+            case 'f':  unescaped = '\f'; break;
+            case 'n':  unescaped = '\n'; break;
+            case 'r':  unescaped = '\r'; break;
+            case 't':  unescaped = '\t'; break;
+            case 'u':
+                state_ = state::unicode;
+                hex_count_ = 0;
+                code_unit_ = 0;
+                continue;
+            default:
+                state_ = state::error;
+                return false;
+            }
+
+            if (!save({ &unescaped, 1 })) {
+                return false;
+            }
+
+            state_ = state::string;
+            token = p;
+            break;
+        }
+        case state::unicode: {
+            auto const c = *p++;
+            uint32_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                state_ = state::error;
+                return false;
+            }
+
+            code_unit_ = code_unit_ << 4 | digit;
+            if (++hex_count_ < 4) {
+                break;
+            }
+
+            auto ok = true;
+            if (high_surrogate_ != 0) {
+                // the low half of a surrogate pair
+                ok = code_unit_ >= 0xdc00 && code_unit_ <= 0xdfff
+                    && save_code_point(0x10000 + ((high_surrogate_ - 0xd800) << 10) + (code_unit_ - 0xdc00));
+                high_surrogate_ = 0;
+            } else if (code_unit_ >= 0xd800 && code_unit_ <= 0xdbff) {
+                high_surrogate_ = code_unit_;
+            } else {
+                ok = (code_unit_ < 0xdc00 || code_unit_ > 0xdfff) && save_code_point(code_unit_);
+            }
+
+            if (!ok) {
+                state_ = state::error;
+                return false;
+            }
+
+            state_ = state::string;
+            token = p;
+            break;
+        }
+        case state::number:
+        case state::literal: {
+            auto const number = state_ == state::number;
+            while (p < end && (number ? is_number_char(*p) : (*p >= 'a' && *p <= 'z'))) {
+                ++p;
+            }
+
+            // the token may continue in the next fragment
+            if (p == end) {
+                if (!save({ token, static_cast<size_t>(end - token) })) {
+                    return false;
+                }
+
+                break;
+            }
+
+            // the character ending the token is parsed in the next state
+            if (!emit({ token, static_cast<size_t>(p - token) }, handler)) {
+                return false;
+            }
+            break;
+        }
+        case state::error:
+            return false;
+        default: {
+            auto const c = *p++;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                break;
+            }
+
+            auto ok = false;
+            switch (state_) {
+            case state::first_value:
+                ok = c == ']' ? end_container(true, handler) : begin_value(c, handler);
+                break;
+            case state::value:
+                ok = begin_value(c, handler);
+                break;
+            case state::first_key:
+            case state::key:
+                if (c == '"') {
+                    in_key_ = true;
+                    state_ = state::string;
+                    ok = true;
+                } else {
+                    ok = c == '}' && state_ == state::first_key && end_container(false, handler);
+                }
+                break;
+            case state::colon:
+                ok = c == ':';
+                state_ = state::value;
+                break;
+            case state::after_value: {
+                auto const array = (arrays_ >> (depth_ - 1) & 1) != 0;
+                if (c == ',') {
+                    state_ = array ? state::value : state::key;
+                    ok = true;
+                } else {
+                    ok = (c == ']' || c == '}') && end_container(c == ']', handler);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            if (!ok) {
+                state_ = state::error;
+                return false;
+            }
+
+            // a string token starts after the quote, a number or a literal at its first character
+            token = state_ == state::string ? p : p - 1;
+            if (p == end && (state_ == state::number || state_ == state::literal) && !save({ token, 1 })) {
+                return false;
+            }
+            break;
+        }
+        }
+    }
+
+    return true;
+}
+
+bool json_parser::finish(json_handler &handler)
+{
+    // a number or a literal is the whole document
+    if (state_ == state::number || state_ == state::literal) {
+        emit({ }, handler);
+    }
+
+    return state_ == state::done;
+}
+
+bool json_parser::begin_value(char c, json_handler &handler)
+{
+    switch (c) {
+    case '{':
+    case '[':
+        if (depth_ == max_depth) {
+            return false;
+        }
+
+        if (c == '[') {
+            arrays_ |= uint64_t{ 1 } << depth_;
+        } else {
+            arrays_ &= ~(uint64_t{ 1 } << depth_);
+        }
+
+        ++depth_;
+        state_ = c == '[' ? state::first_value : state::first_key;
+        return c == '[' ? handler.on_array_begin() : handler.on_object_begin();
+    case '"':
+        in_key_ = false;
+        state_ = state::string;
+        return true;
+    case 't':
+    case 'f':
+    case 'n':
+        state_ = state::literal;
+        return true;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            state_ = state::number;
+            return true;
+        }
+
+        return false;
+    }
+}
+
+void json_parser::end_value()
+{
+    state_ = depth_ == 0 ? state::done : state::after_value;
+}
+
+bool json_parser::end_container(bool array, json_handler &handler)
+{
+    if (depth_ == 0 || ((arrays_ >> (depth_ - 1) & 1) != 0) != array) {
+        return false;
+    }
+
+    --depth_;
+    end_value();
+    return array ? handler.on_array_end() : handler.on_object_end();
+}
+
+bool json_parser::emit(std::string_view data, json_handler &handler)
+{
+    // a split or escaped token is completed in the scratch buffer
+    if (copied_) {
+        if (!save(data)) {
+            return false;
+        }
+
+        data = { scratch_, scratch_size_ };
+    }
+
+    scratch_size_ = 0;
+    copied_ = false;
+
+    auto ok = false;
+    switch (state_) {
+    case state::string:
+        if (in_key_) {
+            state_ = state::colon;
+            ok = handler.on_key(data);
+        } else {
+            end_value();
+            ok = handler.on_string(data);
+        }
+        break;
+    case state::number:
+        end_value();
+        ok = is_valid_number(data) && handler.on_number(data);
+        break;
+    case state::literal:
+        end_value();
+        ok = (data == "true" || data == "false" || data == "null") && handler.on_literal(data);
+        break;
+    default:
+        break;
+    }
+
+    if (!ok) {
+        state_ = state::error;
+    }
+
+    return ok;
+}
+
+bool json_parser::save(std::string_view data)
+{
+    copied_ = true;
+    if (data.size() > max_token - scratch_size_) {
+        state_ = state::error;
+        return false;
+    }
+
+    memcpy(scratch_ + scratch_size_, data.data(), data.size());
+    scratch_size_ += data.size();
+    return true;
+}
+
+bool json_parser::save_code_point(uint32_t cp)
+{
+    char utf8[4];
+    size_t size;
+    if (cp < 0x80) {
+        utf8[0] = static_cast<char>(cp);
+        size = 1;
+    } else if (cp < 0x800) {
+        utf8[0] = static_cast<char>(0xc0 | cp >> 6);
+        utf8[1] = static_cast<char>(0x80 | (cp & 0x3f));
+        size = 2;
+    } else if (cp < 0x10000) {
+        utf8[0] = static_cast<char>(0xe0 | cp >> 12);
+        utf8[1] = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        utf8[2] = static_cast<char>(0x80 | (cp & 0x3f));
+        size = 3;
+    } else {
+        utf8[0] = static_cast<char>(0xf0 | cp >> 18);
+        utf8[1] = static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+        utf8[2] = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        utf8[3] = static_cast<char>(0x80 | (cp & 0x3f));
+        size = 4;
+    }
+
+    return save({ utf8, size });
+}
+
+const char * json_parser::scan_string(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    // compare sixteen bytes at once, a byte not above 0x1f is a control character
+    auto const quote = _mm_set1_epi8('"');
+    auto const backslash = _mm_set1_epi8('\\');
+    auto const control = _mm_set1_epi8(0x1f);
+    while (end - p >= 16) {
+        auto const chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto const special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        auto const mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+
+        p += 16;
+    }
+#endif
+
+    for (; p < end; ++p) {
+        auto const c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\' || c < 0x20) {
+            return p;
+        }
+    }
+
+    return end;
+}
+
+bool json_parser::is_number_char(char c)
+{
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+bool json_parser::is_valid_number(std::string_view n)
+{
+    auto p = n.begin();
+    auto const end = n.end();
+    auto const digits = [&p, end] {
+        auto const start = p;
+        while (p != end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+
+        return p != start;
+    };
+
+    // -?(0|[1-9][0-9]*)
+    if (p != end && *p == '-') {
+        ++p;
+    }
+
+    if (p != end && *p == '0') {
+        ++p;
+    } else if (!digits()) {
+        return false;
+    }
+
+    // (\.[0-9]+)?
+    if (p != end && *p == '.') {
+        ++p;
+        if (!digits()) {
+            return false;
+        }
+    }
+
+    // ([eE][+-]?[0-9]+)?
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p != end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+
+        if (!digits()) {
+            return false;
+        }
+    }
+
+    return p == end;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief The receiver of the json parser events
+ *
+ * The views passed to the handler are only valid during the call. A handler returning
+ * false stops the parser with an error.
+ */
+class json_handler
+{
+public:
+    virtual bool on_object_begin() = 0;
+
+    virtual bool on_object_end() = 0;
+
+    virtual bool on_array_begin() = 0;
+
+    virtual bool on_array_end() = 0;
+
+    /**
+     * @brief An object member name, unescaped
+     */
+    virtual bool on_key(std::string_view key) = 0;
+
+    /**
+     * @brief A string value, unescaped
+     */
+    virtual bool on_string(std::string_view value) = 0;
+
+    /**
+     * @brief A number value, as written
+     */
+    virtual bool on_number(std::string_view value) = 0;
+
+    /**
+     * @brief A true, false or null value, as written
+     */
+    virtual bool on_literal(std::string_view value) = 0;
+
+protected:
+    ~json_handler() = default;
+};
+
+/**
+ * @brief The incremental sax json parser
+ *
+ * The document is fed in fragments as they arrive, events are passed to the handler as
+ * soon as a token is complete. A token lying in one fragment without escapes is passed as
+ * a view of the fragment, a token split across fragments or holding escapes is unescaped
+ * into a fixed scratch buffer. The parser allocates nothing, strings are scanned sixteen
+ * bytes at a time for the quote, the backslash and the control characters.
+ */
+class json_parser
+{
+public:
+    static constexpr size_t max_depth = 64;     ///< the deepest nesting of objects and arrays
+    static constexpr size_t max_token = 1024;   ///< the longest token split across fragments or escaped
+
+    /**
+     * @brief Parse a fragment of the document
+     *
+     * @param data the fragment
+     * @param handler the event handler
+     * @return true if the fragment is valid so far
+     * @return false on a syntax error, a token or nesting over the limits, or a handler error
+     */
+    bool feed(std::string_view data, json_handler &handler);
+
+    /**
+     * @brief End the document
+     *
+     * @param handler the event handler, receives a number ending the document
+     * @return true if the document is complete and valid
+     */
+    bool finish(json_handler &handler);
+
+    /**
+     * @brief Find the first quote, backslash or control character of a string, the
+     * characters a json string must escape
+     *
+     * @param p the first byte
+     * @param end the end of the data
+     * @return const char* the character found, \b end if none
+     */
+    static const char *scan_string(const char *p, const char *end);
+
+private:
+    enum class state : uint8_t
+    {
+        value,          ///< a value is expected
+        first_value,    ///< a value or the end of an empty array is expected
+        first_key,      ///< a member name or the end of an empty object is expected
+        key,            ///< a member name is expected
+        colon,          ///< the colon after a member name is expected
+        after_value,    ///< a comma or the end of the container is expected
+        string,         ///< in a string
+        escape,         ///< after a backslash in a string
+        unicode,        ///< in the hex digits of a \u escape
+        number,         ///< in a number
+        literal,        ///< in true, false or null
+        done,           ///< the document is complete, only whitespace may follow
+        error           ///< the document is invalid
+    };
+
+    /**
+     * @brief Start a value at a character
+     *
+     * @return true if the character starts a value
+     */
+    bool begin_value(char c, json_handler &handler);
+
+    /**
+     * @brief End a value, the state goes to after_value or done
+     */
+    void end_value();
+
+    /**
+     * @brief End an object or an array
+     *
+     * @param array true for an array
+     */
+    bool end_container(bool array, json_handler &handler);
+
+    /**
+     * @brief Emit the string, the key or the number kept in the scratch buffer or in the fragment
+     *
+     * @param data the tail of the token in the current fragment
+     */
+    bool emit(std::string_view data, json_handler &handler);
+
+    /**
+     * @brief Append to the scratch buffer
+     *
+     * @return false if the token is too long
+     */
+    bool save(std::string_view data);
+
+    /**
+     * @brief Append a code point to the scratch buffer as utf-8
+     */
+    bool save_code_point(uint32_t cp);
+
+    static bool is_number_char(char c);
+
+    static bool is_valid_number(std::string_view n);
+
+    char     scratch_[max_token];        ///< the split or escaped token
+    size_t   scratch_size_{ 0 };         ///< the token bytes in the scratch buffer
+    bool     copied_{ false };           ///< the token is in the scratch buffer
+    bool     in_key_{ false };           ///< the string is a member name
+    state    state_{ state::value };     ///< the parser state
+    uint8_t  hex_count_{ 0 };            ///< the hex digits read of a \u escape
+    uint32_t code_unit_{ 0 };            ///< the \u escape being read
+    uint32_t high_surrogate_{ 0 };       ///< the pending high surrogate, 0 if none
+    size_t   depth_{ 0 };                ///< the nesting depth
+    uint64_t arrays_{ 0 };               ///< the container kinds by depth, a set bit for an array
+};
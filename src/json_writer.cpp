@@ -0,0 +1,130 @@
+#include "json_writer.h"
+
+#include <arpa/inet.h>
+
+#include "json_parser.h"
+
+namespace {
+
+/**
+ * @brief Write an octet in decimal
+ *
+ * @return char* the end of the digits
+ */
+char * write_octet(char *p, unsigned v)
+{
+    if (v >= 100) {
+        *p++ = static_cast<char>('0' + v / 100);
+        v %= 100;
+        *p++ = static_cast<char>('0' + v / 10);
+    } else if (v >= 10) {
+        *p++ = static_cast<char>('0' + v / 10);
+    }
+
+    *p++ = static_cast<char>('0' + v % 10);
+    return p;
+}
+
+/**
+ * @brief Write a slash and a prefix length if there is one
+ *
+ * @return char* the end of the prefix
+ */
+char * write_prefix(char *p, int prefix)
+{
+    if (prefix >= 0 && prefix <= 128) {
+        *p++ = '/';
+        p = write_octet(p, static_cast<unsigned>(prefix));
+    }
+
+    return p;
+}
+
+}
+
+json_writer &json_writer::ipv4(const in_addr &addr, int prefix)
+{
+    // "255.255.255.255/32"
+    char text[20];
+    auto const octets = reinterpret_cast<const uint8_t *>(&addr.s_addr);
+    auto p = text;
+    *p++ = '"';
+    for (auto i = 0; i < 4; ++i) {
+        if (i != 0) {
+            *p++ = '.';
+        }
+
+        p = write_octet(p, octets[i]);
+    }
+
+    p = write_prefix(p, prefix);
+    *p++ = '"';
+    return raw({ text, static_cast<size_t>(p - text) });
+}
+
+json_writer &json_writer::ipv6(const in6_addr &addr, int prefix)
+{
+    // the zero run compression is left to inet_ntop, it writes into the stack
+    char text[INET6_ADDRSTRLEN + 6];
+    text[0] = '"';
+    inet_ntop(AF_INET6, &addr, text + 1, INET6_ADDRSTRLEN);
+    auto p = text + 1 + std::char_traits<char>::length(text + 1);
+    p = write_prefix(p, prefix);
+    *p++ = '"';
+    return raw({ text, static_cast<size_t>(p - text) });
+}
+
+json_writer &json_writer::mac(const uint8_t (&mac)[6])
+{
+    static constexpr char hex[] = "0123456789abcdef";
+
+    // "xx:xx:xx:xx:xx:xx"
+    char text[19];
+    auto p = text;
+    *p++ = '"';
+    for (auto i = 0; i < 6; ++i) {
+        if (i != 0) {
+            *p++ = ':';
+        }
+
+        *p++ = hex[mac[i] >> 4];
+        *p++ = hex[mac[i] & 0xf];
+    }
+
+    *p++ = '"';
+    return raw({ text, static_cast<size_t>(p - text) });
+}
+
+void json_writer::escape(std::string_view s)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+
+    // the runs without special characters are found sixteen bytes at a time and copied whole
+    auto p = s.data();
+    auto const end = p + s.size();
+    while (p < end) {
+        auto const q = json_parser::scan_string(p, end);
+        out_.append(p, q);
+        if (q == end) {
+            break;
+        }
+
+        auto const c = static_cast<unsigned char>(*q);
+        switch (c) {
+        case '"':  out_.append("\\\"", 2); break;
+        case '\\': out_.append("\\\\", 2); break;
+        case '\b': out_.append("\\b", 2); break;
+        case '\f': out_.append("\\f", 2); break;
+        case '\n': out_.append("\\n", 2); break;
+        case '\r': out_.append("\\r", 2); break;
+        case '\t': out_.append("\\t", 2); break;
+        default: {
+            char const u[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            out_.append(u, sizeof u);
+            break;
+        }
+        }
+
+        p = q + 1;
+    }
+}
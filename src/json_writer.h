@@ -0,0 +1,220 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * @brief The json serializer appending to a buffer
+ *
+ * The document is written as the calls are made, with no intermediate strings. Writing
+ * into http_response::output() puts the body straight into the connection's send buffer,
+ * whose capacity is kept across responses. The commas are placed by the writer, the
+ * nesting is the caller's duty.
+ */
+class json_writer
+{
+public:
+    /**
+     * @brief Construct a new json writer object
+     *
+     * @param out the buffer appended to
+     */
+    explicit json_writer(std::string &out);
+
+    json_writer &begin_object();
+
+    json_writer &end_object();
+
+    json_writer &begin_array();
+
+    json_writer &end_array();
+
+    /**
+     * @brief Write a member name known at compile time, it must not need escaping
+     *
+     * @param name the name literal
+     */
+    template <size_t N>
+    json_writer &key(const char (&name)[N]);
+
+    /**
+     * @brief Write a member name, escaped
+     *
+     * @param name the name
+     */
+    json_writer &key(std::string_view name);
+
+    /**
+     * @brief Write a string value, escaped
+     *
+     * @param value the value
+     */
+    json_writer &string(std::string_view value);
+
+    /**
+     * @brief Write an integer value
+     *
+     * @param value the value
+     */
+    template <typename Integer>
+    json_writer &number(Integer value);
+
+    json_writer &boolean(bool value);
+
+    json_writer &null();
+
+    /**
+     * @brief Write an ipv4 address as a string
+     *
+     * @param addr the address
+     * @param prefix the prefix length appended after a slash, negative for none
+     */
+    json_writer &ipv4(const in_addr &addr, int prefix = -1);
+
+    /**
+     * @brief Write an ipv6 address as a string, in the rfc 5952 text form
+     *
+     * @param addr the address
+     * @param prefix the prefix length appended after a slash, negative for none
+     */
+    json_writer &ipv6(const in6_addr &addr, int prefix = -1);
+
+    /**
+     * @brief Write a mac address as a string, colon separated lowercase hex
+     *
+     * @param mac the address
+     */
+    json_writer &mac(const uint8_t (&mac)[6]);
+
+    /**
+     * @brief Write a value already serialized
+     *
+     * @param json the value
+     */
+    json_writer &raw(std::string_view json);
+
+private:
+    /**
+     * @brief Put the comma before a member or an element, except the first one
+     */
+    void separate();
+
+    /**
+     * @brief Append the characters of a string, escaped
+     */
+    void escape(std::string_view s);
+
+    std::string & out_;               ///< the buffer
+    bool          comma_{ false };    ///< the next member or element follows another one
+};
+
+inline json_writer::json_writer(std::string &out)
+    : out_{ out }
+{
+}
+
+inline void json_writer::separate()
+{
+    if (comma_) {
+        out_.push_back(',');
+    }
+}
+
+inline json_writer &json_writer::begin_object()
+{
+    separate();
+    out_.push_back('{');
+    comma_ = false;
+    return *this;
+}
+
+inline json_writer &json_writer::end_object()
+{
+    out_.push_back('}');
+    comma_ = true;
+    return *this;
+}
+
+inline json_writer &json_writer::begin_array()
+{
+    separate();
+    out_.push_back('[');
+    comma_ = false;
+    return *this;
+}
+
+inline json_writer &json_writer::end_array()
+{
+    out_.push_back(']');
+    comma_ = true;
+    return *this;
+}
+
+template <size_t N>
+inline json_writer &json_writer::key(const char (&name)[N])
+{
+    // the quoted name and the colon are copied with a length known at compile time
+    separate();
+    out_.push_back('"');
+    out_.append(name, N - 1);
+    out_.append("\":", 2);
+    comma_ = false;
+    return *this;
+}
+
+inline json_writer &json_writer::key(std::string_view name)
+{
+    separate();
+    out_.push_back('"');
+    escape(name);
+    out_.append("\":", 2);
+    comma_ = false;
+    return *this;
+}
+
+inline json_writer &json_writer::string(std::string_view value)
+{
+    separate();
+    out_.push_back('"');
+    escape(value);
+    out_.push_back('"');
+    comma_ = true;
+    return *this;
+}
+
+template <typename Integer>
+inline json_writer &json_writer::number(Integer value)
+{
+    static_assert(std::is_integral_v<Integer>, "an integer is expected");
+
+    separate();
+    char digits[24];
+    auto const end = std::to_chars(digits, digits + sizeof digits, value).ptr;
+    out_.append(digits, end);
+    comma_ = true;
+    return *this;
+}
+
+inline json_writer &json_writer::boolean(bool value)
+{
+    return raw(value ? "true" : "false");
+}
+
+inline json_writer &json_writer::null()
+{
+    return raw("null");
+}
+
+inline json_writer &json_writer::raw(std::string_view json)
+{
+    separate();
+    out_.append(json);
+    comma_ = true;
+    return *this;
+}
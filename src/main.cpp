@@ -1,9 +1,35 @@
 #include "event_dispatcher.h"
+#include "ipam.h"
+#include "json_writer.h"
+#include "netns_cache.h"
+#include "network_links.h"
+#include "plugin_api.h"
+#include "reactor.h"
+#include "rtnetlink.h"
 #include "server.h"
+#include "state_log.h"
+#include "state_store.h"
+#include "veth_pool.h"
+#include "worker_pool.h"
 
-#include <cassert>
+#include <net/if.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
 
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 inline bool is_all_digit(const char * str)
 {
@@ -16,136 +42,1104 @@ inline bool is_all_digit(const char * str)
     return true;
 }
 
+/**
+ * @brief Get the cpus this process is allowed to run on
+ *
+ * @return std::vector<int> the cpu indexes
+ */
+inline std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus;
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0) {
+        for (auto i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &set)) {
+                cpus.push_back(i);
+            }
+        }
+    }
+
+    return cpus;
+}
+
+/**
+ * @brief Print the connection counters of each reactor
+ *
+ * @param reactors the reactors
+ */
+inline void print_stats(const std::vector<std::unique_ptr<reactor>> & reactors)
+{
+    for (auto const & r : reactors) {
+        auto const & stats = r->get_server().stats();
+        auto const accepted = stats.accepted.load(std::memory_order_relaxed);
+        auto const closed = stats.closed.load(std::memory_order_relaxed);
+        auto const & pool = r->get_server().pool().stats();
+        std::cout << "reactor " << r->id()
+                  << ": accepted " << accepted
+                  << ", active " << accepted - closed
+                  << ", closed " << closed
+                  << ", pool hits " << pool.hits.load(std::memory_order_relaxed)
+                  << ", misses " << pool.misses.load(std::memory_order_relaxed)
+                  << ", mapped " << pool.mapped.load(std::memory_order_relaxed) << " bytes"
+                  << ", resident " << pool.resident.load(std::memory_order_relaxed) << " bytes"
+                  << ", stack " << pool.stack.load(std::memory_order_relaxed) << " bytes" << std::endl;
+
+        // the veth pool and the sandbox cache are enabled apart, -V 0 keeps the cache
+        if (r->veths().enabled()) {
+            auto const & veths = r->veths().stats();
+            auto const created = veths.created.load(std::memory_order_relaxed);
+            auto const total = veths.refill_total.load(std::memory_order_relaxed);
+            std::cout << "reactor " << r->id()
+                      << ": veth pool hits " << veths.hits.load(std::memory_order_relaxed)
+                      << ", misses " << veths.misses.load(std::memory_order_relaxed)
+                      << ", ready " << veths.ready.load(std::memory_order_relaxed)
+                      << ", created " << created
+                      << ", failed " << veths.failed.load(std::memory_order_relaxed)
+                      << ", refill latency avg " << (created != 0 ? total / created : 0) << " us"
+                      << ", max " << veths.refill_max.load(std::memory_order_relaxed) << " us" << std::endl;
+        }
+
+        if (r->sandboxes().enabled()) {
+            auto const & sandboxes = r->sandboxes().stats();
+            std::cout << "reactor " << r->id()
+                      << ": sandbox cache hits " << sandboxes.hits.load(std::memory_order_relaxed)
+                      << ", misses " << sandboxes.misses.load(std::memory_order_relaxed)
+                      << ", stale " << sandboxes.stale.load(std::memory_order_relaxed)
+                      << ", evicted " << sandboxes.evicted.load(std::memory_order_relaxed)
+                      << ", left " << sandboxes.left.load(std::memory_order_relaxed)
+                      << ", open " << sandboxes.cached.load(std::memory_order_relaxed)
+                      << ", sockets " << sandboxes.clients.load(std::memory_order_relaxed) << std::endl;
+        }
+    }
+}
+
+/**
+ * @brief Print the entries and the memory of the state tables
+ *
+ * @param store the store
+ * @param mutex the mutex guarding the store
+ */
+inline void print_state(const state_store & store, std::mutex & mutex)
+{
+    std::lock_guard<std::mutex> lock{ mutex };
+    auto const print = [](const char * name, const table_memory & m) {
+        std::cout << name << ": entries " << m.entries
+                  << ", capacity " << m.capacity
+                  << ", slots " << m.slots
+                  << ", " << m.bytes << " bytes" << std::endl;
+    };
+
+    print("networks", store.networks_memory());
+    print("endpoints", store.endpoints_memory());
+}
+
+/**
+ * @brief Print the pools and the addresses allocated by the ipam
+ *
+ * @param addresses the ipam
+ * @param mutex the mutex guarding the ipam
+ */
+inline void print_ipam(const ipam & addresses, std::mutex & mutex)
+{
+    std::lock_guard<std::mutex> lock{ mutex };
+    std::cout << "ipam: pools " << addresses.pool_count()
+              << ", addresses " << addresses.address_count()
+              << ", " << addresses.memory() << " bytes" << std::endl;
+}
+
+/**
+ * @brief Print the queue and the run times of the worker pool
+ *
+ * @param workers the pool, nullptr if none
+ */
+inline void print_workers(const worker_pool * workers)
+{
+    if (!workers) {
+        return;
+    }
+
+    auto const & stats = workers->stats();
+    auto const submitted = stats.submitted.load(std::memory_order_relaxed);
+    auto const average = [submitted](uint64_t total) {
+        return submitted != 0 ? total / submitted : 0;
+    };
+
+    std::cout << "workers: threads " << workers->size()
+              << ", busy " << stats.busy.load(std::memory_order_relaxed)
+              << ", queued " << stats.depth.load(std::memory_order_relaxed)
+              << ", max queued " << stats.max_depth.load(std::memory_order_relaxed)
+              << ", jobs " << submitted
+              << ", refused " << stats.refused.load(std::memory_order_relaxed)
+              << ", failed " << stats.failed.load(std::memory_order_relaxed)
+              << ", wait avg " << average(stats.wait_total.load(std::memory_order_relaxed)) << " us"
+              << ", max " << stats.wait_max.load(std::memory_order_relaxed) << " us"
+              << ", run avg " << average(stats.run_total.load(std::memory_order_relaxed)) << " us" << std::endl;
+}
+
+/**
+ * @brief Answer a request whose links could not be set up
+ *
+ * @param response the response
+ * @param what the failed step
+ * @param error the errno
+ */
+inline void link_error(http_response * response, const char * what, int error)
+{
+    std::string message{ what };
+    message += ": ";
+    message += std::system_category().message(error);
+    plugin_error(response, 500, message);
+}
+
+/**
+ * @brief A link queried in a sandbox, its name copied out of the rtnetlink message
+ */
+struct sandbox_link
+{
+    rtnetlink::link_info info{ };  ///< the link, its name cleared
+    link_name            name{ };  ///< the link name
+};
+
+inline void usage(const char * prog)
+{
+    std::cerr << "usage: " << prog << " [-r reactors] [-c] [-b backend] [-I ms] [-H ms] [-T ms] [-K ms] [-M n] [-L bytes] [-P n] [-S pct] [-m model] [-D dir] [-N] [-V low:high] [-C n] [-W threads:queue]"
+              << " <unix socket path | tcp port>\n"
+              << "  -r reactors  number of event loop threads, 0 for one per cpu (default 1)\n"
+              << "  -c           pin each event loop thread to a cpu\n"
+              << "  -b backend   auto, epoll or io_uring (default auto)\n"
+              << "  -I ms        read idle timeout, 0 to disable (default 30000)\n"
+              << "  -H ms        request header timeout, 0 to disable (default 10000)\n"
+              << "  -T ms        request timeout, 0 to disable (default 60000)\n"
+              << "  -K ms        keep-alive idle timeout between requests, 0 to disable (default 60000)\n"
+              << "  -M n         requests served per connection, 0 for unlimited (default 1000)\n"
+              << "  -L bytes     largest request body, 0 for unlimited (default 524288)\n"
+              << "  -P n         released connections kept for reuse per reactor (default 128)\n"
+              << "  -S pct       measure stack usage and size stacks for the percentile, 0 to disable (default 0)\n"
+              << "  -m model     stackful or stackless connections (default stackful)\n"
+              << "  -D dir       persist the networks and endpoints in dir, kept in memory only if unset,\n"
+              << "               the ipam pools and addresses are always kept in memory only\n"
+              << "  -N           create a bridge per network and a veth pair per endpoint\n"
+              << "  -V low:high  veth pairs created ahead per reactor with -N, 0 to disable (default 4:16)\n"
+              << "  -C n         sandbox network namespaces kept open per reactor with -N, 0 to disable (default 64)\n"
+              << "  -W t:q       worker threads running the log syncs and the sandbox opens, and their queue bound, 0 to run them on the loop (default 2:256)" << std::endl;
+}
+
+/**
+ * @brief Print the per uri stack usage, the reactor threads must have been joined
+ *
+ * @param reactors the reactors
+ */
+inline void print_stack_usage(const std::vector<std::unique_ptr<reactor>> & reactors)
+{
+    for (auto const & r : reactors) {
+        auto const profile = r->get_server().stack_usage();
+        if (!profile) {
+            continue;
+        }
+
+        std::cout << "reactor " << r->id() << ": " << profile->samples() << " stack samples, "
+                  << profile->percentile() << "th percentile " << profile->usage() << " bytes"
+                  << ", max " << profile->max() << " bytes"
+                  << ", stack " << r->get_server().pool().stack_size() << " bytes" << std::endl;
+        for (auto const & [uri, usage] : profile->uris()) {
+            std::cout << "  " << (uri.empty() ? "-" : uri.c_str())
+                      << ": requests " << usage.samples
+                      << ", max " << usage.max << " bytes" << std::endl;
+        }
+    }
+}
+
 int main(int argc, char ** argv)
 {
-    // create event dispatcher
-    event_dispatcher dispatcher;
-    assert(dispatcher);
-    std::cout << "dispatcher created" << std::endl;
+    // parse options
+    unsigned reactor_count = 1;
+    bool pin = false;
+    auto backend = event_dispatcher::backend::automatic;
+    server::timeouts timeouts;
+    unsigned max_requests = 1000;
+    size_t max_body = 512 * 1024;
+    const char * state_dir = nullptr;
+    bool plumb = false;
+    size_t veth_low = 4;
+    size_t veth_high = 16;
+    size_t sandbox_cache = 64;
+    size_t worker_threads = 2;
+    size_t worker_queue = 256;
+    size_t pool_size = 128;
+    double stack_percentile = 0;
+    auto model = server::connection_model::stackful;
+    for (int opt; (opt = getopt(argc, argv, "r:cb:I:H:T:K:M:L:P:S:m:D:NV:C:W:")) != -1; ) {
+        switch (opt) {
+        case 'r':
+            reactor_count = static_cast<unsigned>(atoi(optarg));
+            break;
+        case 'c':
+            pin = true;
+            break;
+        case 'b':
+            if (strcmp(optarg, "epoll") == 0) {
+                backend = event_dispatcher::backend::epoll;
+            } else if (strcmp(optarg, "io_uring") == 0) {
+                backend = event_dispatcher::backend::io_uring;
+            } else if (strcmp(optarg, "auto") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'I':
+            timeouts.read_idle = std::chrono::milliseconds{ atoi(optarg) };
+            break;
+        case 'H':
+            timeouts.header = std::chrono::milliseconds{ atoi(optarg) };
+            break;
+        case 'T':
+            timeouts.request = std::chrono::milliseconds{ atoi(optarg) };
+            break;
+        case 'K':
+            timeouts.keep_alive = std::chrono::milliseconds{ atoi(optarg) };
+            break;
+        case 'M':
+            max_requests = static_cast<unsigned>(atoi(optarg));
+            break;
+        case 'L':
+            max_body = static_cast<size_t>(atoll(optarg));
+            break;
+        case 'P':
+            pool_size = static_cast<size_t>(atoi(optarg));
+            break;
+        case 'S':
+            stack_percentile = atof(optarg);
+            break;
+        case 'D':
+            state_dir = optarg;
+            break;
+        case 'N':
+            plumb = true;
+            break;
+        case 'V':
+            veth_low = static_cast<size_t>(atoi(optarg));
+            veth_high = strchr(optarg, ':') ? static_cast<size_t>(atoi(strchr(optarg, ':') + 1)) : veth_low;
+            break;
+        case 'C':
+            sandbox_cache = static_cast<size_t>(atoi(optarg));
+            break;
+        case 'W':
+            worker_threads = static_cast<size_t>(atoi(optarg));
+            if (auto const bound = strchr(optarg, ':')) {
+                worker_queue = static_cast<size_t>(atoi(bound + 1));
+            }
+            break;
+        case 'm':
+            if (strcmp(optarg, "stackless") == 0) {
+                model = server::connection_model::stackless;
+            } else if (strcmp(optarg, "stackful") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (reactor_count == 0) {
+        reactor_count = std::max(1u, std::thread::hardware_concurrency());
+    }
 
-    // create server
-    char server_storage[sizeof(server)] __attribute__((aligned(alignof(server))));
+    // block the signals handled by the main thread, reactor threads inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
-    // init server
-    if (is_all_digit(argv[1])) {
+    // create the first reactor
+    std::vector<std::unique_ptr<reactor>> reactors;
+    auto const address = argv[optind];
+    if (is_all_digit(address)) {
         // init server with port
-        ::new (server_storage) server{ dispatcher, static_cast<unsigned short>(atoi(argv[1])) };
+        reactors.push_back(std::make_unique<reactor>(0, backend, static_cast<unsigned short>(atoi(address))));
     } else {
         // init server with path
-        ::new (server_storage) server{ dispatcher, argv[1] };
+        reactors.push_back(std::make_unique<reactor>(0, backend, address));
     }
 
-    auto & svr = *reinterpret_cast<server *>(server_storage);
-    std::cout << "server created" << std::endl;
+    auto & svr = reactors.front()->get_server();
+    svr.set_timeouts(timeouts);
+    svr.set_max_requests(max_requests);
+    svr.set_max_body_size(max_body);
+    svr.pool().set_high_water(pool_size);
+    svr.set_stack_profiling(stack_percentile);
+    svr.set_model(model);
+    auto const uring = reactors.front()->dispatcher().get_backend() == event_dispatcher::backend::io_uring;
+    std::cout << "server created, " << (uring ? "io_uring" : "epoll") << " backend" << std::endl;
 
     // docker network plugin api, refer: https://github.com/moby/moby/blob/master/libnetwork/docs/remote.md
 
     // handshake
-    // register plugin activate handler
-    svr.register_uri_handler("/Plugin.Activate", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
-        response->status(200);
-        response->body() = R"({"Implements":["NetworkDriver"]})";
-        return true;
-    }, nullptr);
+    // register plugin activate response, polled during plugin discovery
+    svr.register_static_response("/Plugin.Activate", 200, R"({"Implements":["NetworkDriver","IpamDriver"]})", plugin_content_type);
 
     // set capabilities
-    // register network driver get capabilities handler
-    svr.register_uri_handler("/NetworkDriver.GetCapabilities", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
-        response->status(200);
-        response->body() = R"({"Scope":"local"})";
-        return true;
-    }, nullptr);
+    // register network driver get capabilities response
+    svr.register_static_response("/NetworkDriver.GetCapabilities", 200, R"({"Scope":"local"})", plugin_content_type);
+
+    // the networks and endpoints, shared by the reactors
+    state_store store;
+    std::mutex store_mutex;
+
+    // restore the state persisted by the previous run, the responses changing it are sent
+    // once the change is on disk
+    std::unique_ptr<state_log> log;
+    if (state_dir) {
+        auto const start = std::chrono::steady_clock::now();
+        log = std::make_unique<state_log>(state_dir, store, store_mutex);
+        auto const stats = log->load();
+        auto const elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        std::cout << "state loaded in " << elapsed.count() << " ms: "
+                  << stats.networks << " networks, " << stats.endpoints << " endpoints, "
+                  << stats.snapshot << " snapshot bytes, " << stats.replayed << " log records replayed";
+        if (stats.discarded != 0) {
+            std::cout << ", " << stats.discarded << " torn log bytes dropped";
+        }
+
+        std::cout << std::endl;
+        svr.set_commit_log(log.get());
+    }
+
+    // the blocking work runs on the workers, the reactors wait for it without blocking
+    // their loops; destroyed before the log, the queued syncs still run
+    std::unique_ptr<worker_pool> workers;
+    if (worker_threads != 0) {
+        workers = std::make_unique<worker_pool>(worker_threads, worker_queue);
+        svr.set_workers(workers.get());
+    }
+
+    // plumb the links of the networks and endpoints with the rtnetlink client of the
+    // reactor handling the request, the response is sent once the kernel acknowledged them
+    auto const links = [plumb] {
+        return plumb ? rtnetlink::current() : nullptr;
+    };
+
+    // the plumbing of a network is serialized across the reactors
+    network_locks locks;
 
     // create network
     // register network driver create network handler
-    svr.register_uri_handler("/NetworkDriver.CreateNetwork", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
-        response->status(200);
-        response->body() = R"({})";
+    register_plugin_handler<create_network_request>(svr, "/NetworkDriver.CreateNetwork", [&store, &store_mutex, log = log.get(), links, &locks](const create_network_request &request, http_response * response) {
+        std::cout << "request: /NetworkDriver.CreateNetwork " << request.network_id.view() << " " << request.ipv4_pool.view() << std::endl;
+        object_id id;
+        if (!object_id::parse(request.network_id.view(), id)) {
+            plugin_error(response, 400, "invalid network id");
+            return true;
+        }
+
+        auto const add = [&store, &store_mutex, log, id,
+                          ipv4_pool = request.ipv4_pool, ipv4_gateway = request.ipv4_gateway,
+                          ipv6_pool = request.ipv6_pool, ipv6_gateway = request.ipv6_gateway](http_response * response) {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const handle = store.add_network(id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 409, "network exists");
+                return;
+            }
+
+            auto & network = store.network(handle);
+            network.ipv4_pool = ipv4_pool;
+            network.ipv4_gateway = ipv4_gateway;
+            network.ipv6_pool = ipv6_pool;
+            network.ipv6_gateway = ipv6_gateway;
+            if (log) {
+                response->wait_for(log->put_network(network));
+            }
+
+            response->status(200);
+            response->add_header("Content-Type", plugin_content_type);
+            response->body() = R"({})";
+        };
+
+        auto const netlink = links();
+        if (!netlink) {
+            add(response);
+            return true;
+        }
+
+        ipv4_prefix gateway;
+        if (!request.ipv4_gateway.empty() && !ipv4_prefix::parse(request.ipv4_gateway.view(), gateway)) {
+            plugin_error(response, 400, "invalid gateway");
+            return true;
+        }
+
+        // the network is added once its bridge is up, holding the lock of the network from
+        // the check on
+        auto const deferred = response->defer();
+        locks.run(netlink->dispatcher(), id, [&store, &store_mutex, netlink, deferred, add, id, gateway, has_gateway = !request.ipv4_gateway.empty(),
+                       bridge = bridge_name(request.network_id.view())](network_locks::guard & g) {
+            {
+                std::lock_guard<std::mutex> lock{ store_mutex };
+                if (store.find_network(id) != state_store::npos) {
+                    plugin_error(deferred, 409, "network exists");
+                    g.unlock();
+                    deferred->complete();
+                    return;
+                }
+            }
+
+            create_bridge(*netlink, bridge, has_gateway ? &gateway : nullptr, [deferred, &add, &g](int error) {
+                if (error != 0) {
+                    link_error(deferred, "cannot create bridge", error);
+                } else {
+                    add(deferred);
+                }
+
+                g.unlock();
+                deferred->complete();
+            });
+        });
+
         return true;
-    }, nullptr);
+    });
 
     // delete network
     // register network driver delete network handler
-    svr.register_uri_handler("/NetworkDriver.DeleteNetwork", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
-        response->status(200);
-        response->body() = R"({})";
+    register_plugin_handler<delete_network_request>(svr, "/NetworkDriver.DeleteNetwork", [&store, &store_mutex, log = log.get(), links, &locks](const delete_network_request &request, http_response * response) {
+        std::cout << "request: /NetworkDriver.DeleteNetwork " << request.network_id.view() << std::endl;
+        object_id id;
+        if (!object_id::parse(request.network_id.view(), id)) {
+            plugin_error(response, 400, "invalid network id");
+            return true;
+        }
+
+        auto const remove = [&store, &store_mutex, log, id](http_response * response) {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const handle = store.find_network(id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 404, "network not found");
+                return;
+            }
+
+            if (!store.remove_network(handle)) {
+                plugin_error(response, 409, "network has endpoints");
+                return;
+            }
+
+            if (log) {
+                response->wait_for(log->remove_network(id));
+            }
+
+            response->status(200);
+            response->add_header("Content-Type", plugin_content_type);
+            response->body() = R"({})";
+        };
+
+        auto const netlink = links();
+        if (!netlink) {
+            remove(response);
+            return true;
+        }
+
+        // the network is removed once its bridge is gone, the endpoints being created hold
+        // the lock until they are added
+        auto const deferred = response->defer();
+        locks.run(netlink->dispatcher(), id, [&store, &store_mutex, netlink, deferred, remove, id, bridge = bridge_name(request.network_id.view())](network_locks::guard & g) {
+            unsigned status = 0;
+            const char * message = nullptr;
+            {
+                std::lock_guard<std::mutex> lock{ store_mutex };
+                auto const handle = store.find_network(id);
+                if (handle == state_store::npos) {
+                    status = 404;
+                    message = "network not found";
+                } else if (store.network(handle).endpoint_count != 0) {
+                    status = 409;
+                    message = "network has endpoints";
+                }
+            }
+
+            if (status != 0) {
+                plugin_error(deferred, status, message);
+                g.unlock();
+                deferred->complete();
+                return;
+            }
+
+            remove_link(*netlink, bridge, [deferred, &remove, &g](int error) {
+                if (error != 0) {
+                    link_error(deferred, "cannot remove bridge", error);
+                } else {
+                    remove(deferred);
+                }
+
+                g.unlock();
+                deferred->complete();
+            });
+        });
+
         return true;
-    }, nullptr);
+    });
 
     // create endpoint
     // register network driver create endpoint handler
-    svr.register_uri_handler("/NetworkDriver.CreateEndpoint", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
-        response->status(200);
-        response->body() = R"({})";
+    register_plugin_handler<create_endpoint_request>(svr, "/NetworkDriver.CreateEndpoint", [&store, &store_mutex, log = log.get(), links, &locks](const create_endpoint_request &request, http_response * response) {
+        std::cout << "request: /NetworkDriver.CreateEndpoint " << request.endpoint_id.view() << " " << request.address.view() << std::endl;
+        object_id network_id;
+        object_id endpoint_id;
+        if (!object_id::parse(request.network_id.view(), network_id) || !object_id::parse(request.endpoint_id.view(), endpoint_id)) {
+            plugin_error(response, 400, "invalid network or endpoint id");
+            return true;
+        }
+
+        auto const add = [&store, &store_mutex, log, network_id, endpoint_id,
+                          address = request.address, address_ipv6 = request.address_ipv6,
+                          mac_address = request.mac_address](http_response * response) {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const network = store.find_network(network_id);
+            if (network == state_store::npos) {
+                plugin_error(response, 404, "network not found");
+                return;
+            }
+
+            auto const handle = store.add_endpoint(network, endpoint_id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 409, "endpoint exists");
+                return;
+            }
+
+            auto & endpoint = store.endpoint(handle);
+            endpoint.address = address;
+            endpoint.address_ipv6 = address_ipv6;
+            endpoint.mac_address = mac_address;
+            if (log) {
+                response->wait_for(log->put_endpoint(endpoint));
+            }
+
+            response->status(200);
+            response->add_header("Content-Type", plugin_content_type);
+            response->body() = R"({})";
+        };
+
+        auto const netlink = links();
+        if (!netlink) {
+            add(response);
+            return true;
+        }
+
+        // the endpoint is added once its veth pair is on the bridge, holding the lock of the
+        // network so a request for the same endpoint or a removal of the network waits
+        auto const deferred = response->defer();
+        auto const id = request.endpoint_id.view();
+        locks.run(netlink->dispatcher(), network_id, [&store, &store_mutex, netlink, deferred, add, network_id, endpoint_id, bridge = bridge_name(request.network_id.view()),
+                               name = veth_name(id), peer = veth_peer_name(id)](network_locks::guard & g) {
+            unsigned status = 0;
+            const char * message = nullptr;
+            {
+                std::lock_guard<std::mutex> lock{ store_mutex };
+                if (store.find_network(network_id) == state_store::npos) {
+                    status = 404;
+                    message = "network not found";
+                } else if (store.find_endpoint(endpoint_id) != state_store::npos) {
+                    status = 409;
+                    message = "endpoint exists";
+                }
+            }
+
+            if (status != 0) {
+                plugin_error(deferred, status, message);
+                g.unlock();
+                deferred->complete();
+                return;
+            }
+
+            create_veth(*netlink, veth_pool::current(), bridge, name, peer, [deferred, &add, &g](int error) {
+                if (error != 0) {
+                    link_error(deferred, "cannot create veth pair", error);
+                } else {
+                    add(deferred);
+                }
+
+                g.unlock();
+                deferred->complete();
+            });
+        });
+
         return true;
-    }, nullptr);
+    });
 
     // delete endpoint
     // register network driver delete endpoint handler
-    svr.register_uri_handler("/NetworkDriver.DeleteEndpoint", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
-        response->status(200);
-        response->body() = R"({})";
+    register_plugin_handler<endpoint_request>(svr, "/NetworkDriver.DeleteEndpoint", [&store, &store_mutex, log = log.get(), links, &locks](const endpoint_request &request, http_response * response) {
+        std::cout << "request: /NetworkDriver.DeleteEndpoint " << request.endpoint_id.view() << std::endl;
+        object_id network_id;
+        object_id id;
+        if (!object_id::parse(request.network_id.view(), network_id) || !object_id::parse(request.endpoint_id.view(), id)) {
+            plugin_error(response, 400, "invalid network or endpoint id");
+            return true;
+        }
+
+        auto const remove = [&store, &store_mutex, log, id](http_response * response) {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const handle = store.find_endpoint(id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 404, "endpoint not found");
+                return;
+            }
+
+            store.remove_endpoint(handle);
+            if (log) {
+                response->wait_for(log->remove_endpoint(id));
+            }
+
+            response->status(200);
+            response->add_header("Content-Type", plugin_content_type);
+            response->body() = R"({})";
+        };
+
+        auto const netlink = links();
+        if (!netlink) {
+            remove(response);
+            return true;
+        }
+
+        // the endpoint is removed once its veth pair is gone, with the container's end,
+        // holding the lock of the network
+        auto const deferred = response->defer();
+        locks.run(netlink->dispatcher(), network_id, [&store, &store_mutex, netlink, deferred, remove, id, name = veth_name(request.endpoint_id.view())](network_locks::guard & g) {
+            bool found;
+            {
+                std::lock_guard<std::mutex> lock{ store_mutex };
+                found = store.find_endpoint(id) != state_store::npos;
+            }
+
+            if (!found) {
+                plugin_error(deferred, 404, "endpoint not found");
+                g.unlock();
+                deferred->complete();
+                return;
+            }
+
+            remove_link(*netlink, name, [deferred, &remove, &g](int error) {
+                if (error != 0) {
+                    link_error(deferred, "cannot remove veth pair", error);
+                } else {
+                    remove(deferred);
+                }
+
+                g.unlock();
+                deferred->complete();
+            });
+        });
+
         return true;
-    }, nullptr);
+    });
 
     // join
     // register network driver join handler
-    svr.register_uri_handler("/NetworkDriver.Join", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
+    register_plugin_handler<join_request>(svr, "/NetworkDriver.Join", [&store, &store_mutex, log = log.get(), links, workers = workers.get()](const join_request &request, http_response * response) {
+        std::cout << "request: /NetworkDriver.Join " << request.endpoint_id.view() << " " << request.sandbox_key.view() << std::endl;
+        object_id id;
+        if (!object_id::parse(request.endpoint_id.view(), id)) {
+            plugin_error(response, 400, "invalid endpoint id");
+            return true;
+        }
+
+        fixed_string<64> gateway;
+        {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const handle = store.find_endpoint(id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 404, "endpoint not found");
+                return true;
+            }
+
+            auto & endpoint = store.endpoint(handle);
+            endpoint.sandbox_key = request.sandbox_key;
+            endpoint.joined = true;
+            gateway = store.network(endpoint.network).ipv4_gateway;
+            if (log) {
+                response->wait_for(log->put_endpoint(endpoint));
+            }
+        }
+
+        if (links()) {
+            // the daemon moves the container end of the veth pair into the sandbox and
+            // names it "ethN", the containers route through the bridge
+            auto const answer = [peer = veth_peer_name(request.endpoint_id.view()), gateway](http_response * r) {
+                r->status(200);
+                r->add_header("Content-Type", plugin_content_type);
+                json_writer json{ r->output() };
+                json.begin_object()
+                    .key("InterfaceName").begin_object()
+                        .key("SrcName").string(peer.view())
+                        .key("DstPrefix").string("eth")
+                    .end_object();
+                if (!gateway.empty()) {
+                    auto const text = gateway.view();
+                    json.key("Gateway").string(text.substr(0, text.find('/')));
+                }
+
+                json.end_object();
+            };
+
+            // the sandbox is opened with its rtnetlink socket ahead of the endpoint queries,
+            // on a worker as the open and the namespace switches block, a sandbox that cannot
+            // be opened yet is opened again then
+            auto const sandboxes = netns_cache::current();
+            if (!sandboxes || request.sandbox_key.empty() || sandboxes->cached(request.sandbox_key.view())) {
+                answer(response);
+                return true;
+            }
+
+            auto const sandbox = std::make_shared<netns_cache::sandbox>(request.sandbox_key.view());
+            auto const opened = [sandboxes, sandbox, answer](http_response * r) {
+                int error = 0;
+                sandboxes->install(*sandbox, error);
+                answer(r);
+            };
+
+            if (!workers || !workers->offload(response, [sandboxes, sandbox] { sandboxes->open(*sandbox); }, opened)) {
+                sandboxes->open(*sandbox);
+                opened(response);
+            }
+
+            return true;
+        }
+
         response->status(200);
-        response->body() = R"({"InterfaceName":{"SrcName":"ens160","DstPrefix":"eth"}})"; // Docker libNetwork will move host interface
-                                                                                          // with name "ens160" to container, and rename
-                                                                                          // it to "ethN", where N is a index number.
+        response->add_header("Content-Type", plugin_content_type);
+        json_writer json{ response->output() };
+
+        // Docker libNetwork will move host interface with name "ens160" to container, and rename it to "ethN", where N is
+        // a index number.
+        json.begin_object()
+            .key("InterfaceName").begin_object()
+                .key("SrcName").string("ens160")
+                .key("DstPrefix").string("eth")
+            .end_object()
+        .end_object();
         return true;
-    }, nullptr);
+    });
 
     // leave
     // register network driver leave handler
-    svr.register_uri_handler("/NetworkDriver.Leave", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
+    register_plugin_handler<endpoint_request>(svr, "/NetworkDriver.Leave", [&store, &store_mutex, log = log.get(), &reactors](const endpoint_request &request, http_response * response) {
+        std::cout << "request: /NetworkDriver.Leave " << request.endpoint_id.view() << std::endl;
+        object_id id;
+        if (!object_id::parse(request.endpoint_id.view(), id)) {
+            plugin_error(response, 400, "invalid endpoint id");
+            return true;
+        }
+
+        fixed_string<256> sandbox_key;
+        {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const handle = store.find_endpoint(id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 404, "endpoint not found");
+                return true;
+            }
+
+            auto & endpoint = store.endpoint(handle);
+            if (endpoint.joined) {
+                sandbox_key = endpoint.sandbox_key;
+            }
+
+            endpoint.joined = false;
+            if (log) {
+                response->wait_for(log->put_endpoint(endpoint));
+            }
+        }
+
+        // the daemon removes the sandbox once the container left, no reactor keeps it open
+        for (auto const & r : reactors) {
+            r->sandboxes().forget(sandbox_key.view());
+        }
+
         response->status(200);
+        response->add_header("Content-Type", plugin_content_type);
         response->body() = R"({})";
         return true;
-    }, nullptr);
+    });
 
     // endpoint operational info
     // register network driver endpoint operational info handler
-    svr.register_uri_handler("/NetworkDriver.EndpointOperInfo", [](void *, const http_request &request, http_response * response) {
-        std::cout << "request: " << request.url() << std::endl;
+    register_plugin_handler<endpoint_request>(svr, "/NetworkDriver.EndpointOperInfo", [&store, &store_mutex, links, workers = workers.get()](const endpoint_request &request, http_response * response) {
+        object_id id;
+        if (!object_id::parse(request.endpoint_id.view(), id)) {
+            plugin_error(response, 400, "invalid endpoint id");
+            return true;
+        }
+
+        fixed_string<256> sandbox_key;
+        {
+            std::lock_guard<std::mutex> lock{ store_mutex };
+            auto const handle = store.find_endpoint(id);
+            if (handle == state_store::npos) {
+                plugin_error(response, 404, "endpoint not found");
+                return true;
+            }
+
+            auto const & endpoint = store.endpoint(handle);
+            if (endpoint.joined) {
+                sandbox_key = endpoint.sandbox_key;
+            }
+        }
+
+        auto const netlink = links();
+        auto const sandboxes = netns_cache::current();
+        if (!netlink || !sandboxes || sandbox_key.empty()) {
+            response->status(200);
+            response->add_header("Content-Type", plugin_content_type);
+            response->body() = R"({"Value":{}})";
+            return true;
+        }
+
+        // the host end of the veth pair names the index of the container end in the
+        // sandbox, which is asked for the link
+        auto const peer = std::make_shared<rtnetlink::link_info>();
+        auto const deferred = response->defer();
+        netlink->get_link(veth_name(request.endpoint_id.view()).view(), [peer](const rtnetlink::link_info & link) {
+            *peer = link;
+            peer->name = { };
+        });
+
+        netlink->submit([deferred, sandboxes, sandbox_key, peer, workers](int error) {
+            if (error != 0) {
+                link_error(deferred, "cannot query veth pair", error);
+                deferred->complete();
+                return;
+            }
+
+            auto const query = [deferred, sandbox_key, peer](rtnetlink * sandbox, int error) {
+                if (!sandbox) {
+                    deferred->status(200);
+                    deferred->add_header("Content-Type", plugin_content_type);
+                    json_writer json{ deferred->output() };
+                    json.begin_object().key("Value").begin_object().key("SandboxKey").string(sandbox_key.view());
+                    if (error != 0) {
+                        json.key("Error").string(std::system_category().message(error));
+                    }
+
+                    json.end_object().end_object();
+                    deferred->complete();
+                    return;
+                }
+
+                // the link is only recorded, the body is built once the group is acknowledged,
+                // as either the link or the error
+                auto const found = std::make_shared<sandbox_link>();
+                sandbox->get_link(peer->link, [found](const rtnetlink::link_info & link) {
+                    found->info = link;
+                    found->name.assign(link.name);
+                    found->info.name = { };
+                });
+
+                sandbox->submit([deferred, sandbox_key, found](int error) {
+                    if (error != 0) {
+                        link_error(deferred, "cannot query sandbox link", error);
+                        deferred->complete();
+                        return;
+                    }
+
+                    deferred->status(200);
+                    deferred->add_header("Content-Type", plugin_content_type);
+                    json_writer json{ deferred->output() };
+                    json.begin_object()
+                        .key("Value").begin_object()
+                            .key("SandboxKey").string(sandbox_key.view())
+                            .key("Interface").string(found->name.view())
+                            .key("MTU").number(found->info.mtu)
+                            .key("Up").boolean((found->info.flags & IFF_UP) != 0)
+                            .key("Running").boolean((found->info.flags & IFF_RUNNING) != 0)
+                        .end_object()
+                    .end_object();
+                    deferred->complete();
+                });
+            };
+
+            // a sandbox not cached is opened on a worker, the open and the namespace switches block
+            if (peer->link_netnsid < 0) {
+                query(nullptr, 0);
+            } else {
+                sandboxes->client(workers, sandbox_key.view(), query);
+            }
+        });
+
+        return true;
+    });
+
+    // ipam driver, refer: https://github.com/moby/moby/blob/master/libnetwork/docs/ipam.md
+    ipam addresses;
+    std::mutex ipam_mutex;
+
+    // register ipam driver get capabilities response
+    svr.register_static_response("/IpamDriver.GetCapabilities", 200, R"({"RequiresMACAddress":false})", plugin_content_type);
+
+    // register ipam driver get default address spaces response
+    svr.register_static_response("/IpamDriver.GetDefaultAddressSpaces", 200, R"({"LocalDefaultAddressSpace":"local","GlobalDefaultAddressSpace":"global"})", plugin_content_type);
+
+    // request pool
+    // register ipam driver request pool handler
+    register_plugin_handler<request_pool_request>(svr, "/IpamDriver.RequestPool", [&addresses, &ipam_mutex](const request_pool_request &request, http_response * response) {
+        std::cout << "request: /IpamDriver.RequestPool " << request.address_space.view() << " " << request.pool.view() << std::endl;
+        if (request.v6) {
+            plugin_error(response, 400, "ipv6 pools are not supported");
+            return true;
+        }
+
+        ipv4_prefix pool;
+        ipam::result result;
+        {
+            std::lock_guard<std::mutex> lock{ ipam_mutex };
+            result = addresses.request_pool(request.pool.view(), pool);
+        }
+
+        if (result != ipam::result::ok) {
+            plugin_error(response, result == ipam::result::invalid ? 400 : 409, ipam::message(result));
+            return true;
+        }
+
         response->status(200);
-        response->body() = R"({"Value":{}})";
+        response->add_header("Content-Type", plugin_content_type);
+        json_writer json{ response->output() };
+        json.begin_object()
+            .key("PoolID").ipv4(pool.addr(), pool.length)
+            .key("Pool").ipv4(pool.addr(), pool.length)
+            .key("Data").begin_object().end_object()
+        .end_object();
         return true;
-    }, nullptr);
+    });
 
-    // subscribe server io event
-    if (!dispatcher.subscribe(svr, event_dispatcher::readable)) {
-        std::cerr << "cannot subscribe io event for server" << std::endl;
-        return 1;
+    // release pool
+    // register ipam driver release pool handler
+    register_plugin_handler<release_pool_request>(svr, "/IpamDriver.ReleasePool", [&addresses, &ipam_mutex](const release_pool_request &request, http_response * response) {
+        std::cout << "request: /IpamDriver.ReleasePool " << request.pool_id.view() << std::endl;
+        ipam::result result;
+        {
+            std::lock_guard<std::mutex> lock{ ipam_mutex };
+            result = addresses.release_pool(request.pool_id.view());
+        }
+
+        if (result != ipam::result::ok) {
+            plugin_error(response, result == ipam::result::invalid ? 400 : 404, ipam::message(result));
+            return true;
+        }
+
+        response->status(200);
+        response->add_header("Content-Type", plugin_content_type);
+        response->body() = R"({})";
+        return true;
+    });
+
+    // request address
+    // register ipam driver request address handler
+    register_plugin_handler<address_request>(svr, "/IpamDriver.RequestAddress", [&addresses, &ipam_mutex](const address_request &request, http_response * response) {
+        std::cout << "request: /IpamDriver.RequestAddress " << request.pool_id.view() << " " << request.address.view() << std::endl;
+        ipv4_prefix address;
+        ipam::result result;
+        {
+            std::lock_guard<std::mutex> lock{ ipam_mutex };
+            result = addresses.request_address(request.pool_id.view(), request.address.view(), address);
+        }
+
+        if (result != ipam::result::ok) {
+            auto const status = result == ipam::result::invalid ? 400 : result == ipam::result::not_found ? 404 : 409;
+            plugin_error(response, status, ipam::message(result));
+            return true;
+        }
+
+        response->status(200);
+        response->add_header("Content-Type", plugin_content_type);
+        json_writer json{ response->output() };
+        json.begin_object()
+            .key("Address").ipv4(address.addr(), address.length)
+            .key("Data").begin_object().end_object()
+        .end_object();
+        return true;
+    });
+
+    // release address
+    // register ipam driver release address handler
+    register_plugin_handler<address_request>(svr, "/IpamDriver.ReleaseAddress", [&addresses, &ipam_mutex](const address_request &request, http_response * response) {
+        std::cout << "request: /IpamDriver.ReleaseAddress " << request.pool_id.view() << " " << request.address.view() << std::endl;
+        ipam::result result;
+        {
+            std::lock_guard<std::mutex> lock{ ipam_mutex };
+            result = addresses.release_address(request.pool_id.view(), request.address.view());
+        }
+
+        if (result != ipam::result::ok) {
+            plugin_error(response, result == ipam::result::invalid ? 400 : 404, ipam::message(result));
+            return true;
+        }
+
+        response->status(200);
+        response->add_header("Content-Type", plugin_content_type);
+        response->body() = R"({})";
+        return true;
+    });
+
+    // create the other reactors, sharing the listening address and the handlers
+    for (auto i = 1u; i < reactor_count; ++i) {
+        reactors.push_back(std::make_unique<reactor>(i, *reactors.front()));
     }
 
-    // subscribe server loop event
-    if (!dispatcher.subscribe(svr)) {
-        std::cerr << "cannot subscribe loop event for server" << std::endl;
-        return 1;
+    // the veth pools are filled by the reactor threads as they start, the sandboxes are
+    // opened as they are joined
+    if (plumb) {
+        for (auto & r : reactors) {
+            r->veths().set_watermarks(veth_low, veth_high);
+            r->sandboxes().set_capacity(sandbox_cache);
+        }
+    }
+
+    // start reactors
+    auto const cpus = pin ? allowed_cpus() : std::vector<int>{ };
+    for (auto & r : reactors) {
+        r->start(cpus.empty() ? -1 : cpus[r->id() % cpus.size()]);
     }
 
-    // run dispatcher
-    dispatcher.run();
+    std::cout << reactors.size() << " reactor(s) started" << std::endl;
+
+    // wait for signals, SIGUSR1 dumps the counters, SIGINT and SIGTERM stop the server
+    for (;;) {
+        int sig;
+        if (sigwait(&signals, &sig) != 0) {
+            continue;
+        }
+
+        if (sig == SIGUSR1) {
+            print_stats(reactors);
+            print_state(store, store_mutex);
+            print_ipam(addresses, ipam_mutex);
+            print_workers(workers.get());
+            continue;
+        }
+
+        break;
+    }
 
-    // unsubscribe server loop event
-    dispatcher.unsubscribe(static_cast<loop_listener &>(svr));
+    // stop reactors
+    for (auto & r : reactors) {
+        r->stop();
+    }
 
-    // unsubscribe server io event
-    dispatcher.unsubscribe(static_cast<io_listener &>(svr));
+    for (auto & r : reactors) {
+        r->join();
+    }
 
-    // destroy server
-    svr.~server();
+    print_stats(reactors);
+    print_state(store, store_mutex);
+    print_ipam(addresses, ipam_mutex);
+    print_workers(workers.get());
+    print_stack_usage(reactors);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,318 @@
+#include "netns_cache.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+thread_local netns_cache * netns_cache::current_{ nullptr };
+
+/**
+ * @brief The task dropping a sandbox on the thread of its cache, freed once run
+ */
+class netns_cache::forget_task
+    : public task
+{
+public:
+    forget_task(netns_cache & cache, std::string_view path)
+        : cache_{ cache }
+        , path_{ path }
+    {
+    }
+
+    void on_run() override
+    {
+        cache_.evict(path_);
+        delete this;
+    }
+
+private:
+    netns_cache &cache_;  ///< the cache
+    std::string  path_;   ///< the SandboxKey
+};
+
+netns_cache::netns_cache(event_dispatcher & dispatcher)
+    : dispatcher_{ dispatcher }
+{
+}
+
+netns_cache::~netns_cache()
+{
+    detach();
+}
+
+void netns_cache::set_capacity(size_t n)
+{
+    capacity_ = n;
+}
+
+bool netns_cache::attach()
+{
+    // the namespace is per thread, the clients are created from the dispatcher thread
+    home_ = ::open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (home_ < 0) {
+        return false;
+    }
+
+    if (!dispatcher_.subscribe(static_cast<loop_listener &>(*this))) {
+        close(home_);
+        home_ = -1;
+        return false;
+    }
+
+    attached_ = true;
+    current_ = this;
+    return true;
+}
+
+void netns_cache::detach()
+{
+    if (!attached_) {
+        return;
+    }
+
+    while (!entries_.empty()) {
+        drop(std::prev(entries_.end()));
+    }
+
+    retired_.clear();
+    dispatcher_.cancel(*this);
+    dispatcher_.unsubscribe(static_cast<loop_listener &>(*this));
+    close(home_);
+    home_ = -1;
+    attached_ = false;
+    if (current_ == this) {
+        current_ = nullptr;
+    }
+}
+
+netns_cache::sandbox::sandbox(std::string_view path)
+    : path{ path }
+{
+}
+
+netns_cache::sandbox::~sandbox()
+{
+    if (socket >= 0) {
+        close(socket);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+rtnetlink * netns_cache::client(std::string_view path, int & error)
+{
+    if (auto const e = find(path)) {
+        return e->netlink.get();
+    }
+
+    sandbox s{ path };
+    open(s);
+    return install(s, error);
+}
+
+void netns_cache::client(worker_pool * workers, std::string_view path, client_callback done)
+{
+    if (auto const e = find(path)) {
+        done(e->netlink.get(), 0);
+        return;
+    }
+
+    // the sandbox is shared by the job and closed with it if the completion never runs
+    auto const s = std::make_shared<sandbox>(path);
+    auto const opened = [this, s, done] {
+        int error = 0;
+        auto const netlink = install(*s, error);
+        done(netlink, error);
+    };
+
+    if (!workers || !workers->submit(dispatcher_, [this, s] { open(*s); }, opened)) {
+        open(*s);
+        opened();
+    }
+}
+
+rtnetlink * netns_cache::cached(std::string_view path)
+{
+    auto const e = find(path);
+    return e ? e->netlink.get() : nullptr;
+}
+
+void netns_cache::open(sandbox & s) const
+{
+    s.fd = ::open(s.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (s.fd < 0) {
+        s.error = errno;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(s.fd, &st) != 0) {
+        s.error = errno;
+        return;
+    }
+
+    s.dev = st.st_dev;
+    s.ino = st.st_ino;
+
+    // the socket is opened in the sandbox and stays there once the thread is back
+    if (setns(s.fd, CLONE_NEWNET) != 0) {
+        s.error = errno;
+        return;
+    }
+
+    try {
+        s.socket = rtnetlink::open_socket();
+    } catch (const std::system_error & ex) {
+        s.error = ex.code().value();
+    }
+
+    if (setns(home_, CLONE_NEWNET) != 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot return to the thread network namespace" };
+    }
+}
+
+rtnetlink * netns_cache::install(sandbox & s, int & error)
+{
+    stats_.misses.fetch_add(1, std::memory_order_relaxed);
+    if (s.error != 0) {
+        error = s.error;
+        return nullptr;
+    }
+
+    // another request opened the sandbox while this one was on a worker
+    if (auto const e = find(s.path)) {
+        return e->netlink.get();
+    }
+
+    auto netlink = std::make_unique<rtnetlink>(dispatcher_, std::exchange(s.socket, -1));
+    if (!netlink->attach(false)) {
+        error = EIO;
+        return nullptr;
+    }
+
+    stats_.clients.fetch_add(1, std::memory_order_relaxed);
+    auto & e = entries_.emplace_front();
+    e.path = std::move(s.path);
+    e.fd = std::exchange(s.fd, -1);
+    e.dev = s.dev;
+    e.ino = s.ino;
+    e.checked = event_dispatcher::now();
+    e.netlink = std::move(netlink);
+    index_.emplace(e.path, entries_.begin());
+
+    // the least recently used sandboxes beyond the capacity are dropped
+    while (entries_.size() > capacity_) {
+        stats_.evicted.fetch_add(1, std::memory_order_relaxed);
+        drop(std::prev(entries_.end()));
+    }
+
+    stats_.cached.store(entries_.size(), std::memory_order_relaxed);
+    return entries_.front().netlink.get();
+}
+
+void netns_cache::forget(std::string_view path)
+{
+    if (!enabled() || path.empty()) {
+        return;
+    }
+
+    if (current_ == this) {
+        evict(path);
+        return;
+    }
+
+    dispatcher_.post(*new forget_task{ *this, path });
+}
+
+void netns_cache::evict(std::string_view path)
+{
+    if (auto const it = index_.find(path); it != index_.end()) {
+        stats_.left.fetch_add(1, std::memory_order_relaxed);
+        drop(it->second);
+    }
+}
+
+netns_cache::entry * netns_cache::find(std::string_view path)
+{
+    auto const it = index_.find(path);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+
+    // the path is checked once the handle is old enough, a sandbox removed and created
+    // again under the same path is another namespace
+    auto const e = it->second;
+    auto const now = event_dispatcher::now();
+    if (now - e->checked >= revalidate_interval) {
+        struct stat st;
+        if (stat(e->path.c_str(), &st) != 0 || st.st_dev != e->dev || st.st_ino != e->ino) {
+            stats_.stale.fetch_add(1, std::memory_order_relaxed);
+            drop(e);
+            return nullptr;
+        }
+
+        e->checked = now;
+    }
+
+    entries_.splice(entries_.begin(), entries_, e);
+    stats_.hits.fetch_add(1, std::memory_order_relaxed);
+    return &*e;
+}
+
+void netns_cache::on_loop()
+{
+    if (retired_.empty()) {
+        return;
+    }
+
+    // the expired clients are taken out first, their failed callbacks may retire others
+    auto const now = event_dispatcher::now();
+    std::vector<std::unique_ptr<rtnetlink>> expired;
+    std::erase_if(retired_, [now, &expired](retired_client & r) {
+        if (r.netlink->in_flight() == 0) {
+            return true;
+        }
+
+        if (now - r.retired < static_cast<uint64_t>(retire_timeout.count())) {
+            return false;
+        }
+
+        expired.push_back(std::move(r.netlink));
+        return true;
+    });
+
+    for (auto const & netlink : expired) {
+        netlink->abort(ETIMEDOUT);
+    }
+
+    // the loop may go idle, the timer brings it back for the clients still waiting
+    if (!retired_.empty() && !is_armed()) {
+        dispatcher_.arm(*this, retire_timeout);
+    }
+}
+
+void netns_cache::on_timer()
+{
+}
+
+void netns_cache::drop(entry_list::iterator it)
+{
+    // the client may be the one running the callback that dropped it
+    if (it->netlink) {
+        retired_.push_back({ std::move(it->netlink), event_dispatcher::now() });
+    }
+
+    close(it->fd);
+    index_.erase(it->path);
+    entries_.erase(it);
+    stats_.cached.store(entries_.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "event_dispatcher.h"
+#include "rtnetlink.h"
+#include "worker_pool.h"
+
+/**
+ * @brief The cache of the sandbox network namespaces of an event dispatcher thread
+ *
+ * A sandbox is opened once by its SandboxKey path, the handle is kept with the device and
+ * inode of the namespace, and the rtnetlink client of the namespace is created along by
+ * entering it, opening the socket and returning, the socket stays in the sandbox. The
+ * open and the namespace switches block, they run on a worker when a pool is given and
+ * the cache takes the handle and the socket back on the dispatcher thread. The least
+ * recently used sandbox is dropped beyond the capacity.
+ *
+ * A handle is trusted for revalidate_interval after its path was last checked, then the
+ * path is checked with stat, a sandbox path that is gone or names another namespace drops
+ * the handle and opens the path again. A dropped client is destroyed from the loop phase
+ * once its messages are acknowledged, never from the callbacks it may be running; a
+ * client whose namespace went away never gets them, its groups fail with ETIMEDOUT once
+ * it waited retire_timeout and it is destroyed then, a timer wakes an idle loop for it.
+ *
+ * The cache is owned by one event dispatcher thread, only the counters may be read from
+ * other threads.
+ */
+class netns_cache
+    : public loop_listener
+    , public timer_listener
+{
+public:
+    static constexpr uint64_t revalidate_interval = 1000;  ///< the milliseconds a handle is used without checking its path
+    static constexpr std::chrono::milliseconds retire_timeout{ 5000 };  ///< the longest wait of a dropped client for its acknowledgements
+
+    /**
+     * @brief A sandbox opened off the cache, its handle and socket until the cache takes
+     * them, closed with it otherwise
+     */
+    struct sandbox
+    {
+        /**
+         * @brief Construct a new sandbox object, not opened
+         *
+         * @param path the SandboxKey
+         */
+        explicit sandbox(std::string_view path);
+
+        /**
+         * @brief Destroy the sandbox object, the handle and the socket not taken are closed
+         */
+        ~sandbox();
+
+        /**
+         * @brief Copy constructor is deleted
+         */
+        sandbox(const sandbox &) = delete;
+
+        /**
+         * @brief Copy assignment is deleted
+         */
+        void operator=(const sandbox &) = delete;
+
+        std::string path{ };       ///< the SandboxKey
+        int         fd{ -1 };      ///< the namespace handle
+        dev_t       dev{ 0 };      ///< the device of the namespace
+        ino_t       ino{ 0 };      ///< the inode of the namespace
+        int         socket{ -1 };  ///< the rtnetlink socket opened in the namespace
+        int         error{ 0 };    ///< the errno if the sandbox cannot be opened or entered
+    };
+
+    using client_callback = std::function<void(rtnetlink * netlink, int error)>;  ///< called with the client, or nullptr and the errno
+
+    /**
+     * @brief The cache counters, readable from any thread
+     */
+    struct statistics
+    {
+        std::atomic<uint64_t> hits{ 0 };     ///< the lookups served by a cached handle
+        std::atomic<uint64_t> misses{ 0 };   ///< the lookups opening the path
+        std::atomic<uint64_t> stale{ 0 };    ///< the handles dropped because their path changed
+        std::atomic<uint64_t> evicted{ 0 };  ///< the handles dropped beyond the capacity
+        std::atomic<uint64_t> left{ 0 };     ///< the handles dropped as their container left
+        std::atomic<uint64_t> clients{ 0 };  ///< the rtnetlink clients created
+        std::atomic<uint64_t> cached{ 0 };   ///< the cached handles
+    };
+
+    /**
+     * @brief Construct a new netns cache object, disabled until its capacity is set
+     *
+     * @param dispatcher the event dispatcher the clients subscribe to
+     */
+    explicit netns_cache(event_dispatcher & dispatcher);
+
+    /**
+     * @brief Destroy the netns cache object
+     */
+    ~netns_cache() override;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    netns_cache(const netns_cache &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const netns_cache &) = delete;
+
+    /**
+     * @brief Get the cache of the calling thread
+     *
+     * @return netns_cache* the cache, nullptr if the thread has none attached
+     */
+    static netns_cache * current();
+
+    /**
+     * @brief Set the capacity, called before the cache is attached
+     *
+     * @param n the sandboxes kept open, 0 disables the cache
+     */
+    void set_capacity(size_t n);
+
+    /**
+     * @brief Check if the cache is enabled
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Open the namespace of the calling thread, subscribe to the dispatcher and become
+     * the cache of the thread, called on the dispatcher thread
+     *
+     * @return true if attached
+     */
+    bool attach();
+
+    /**
+     * @brief Drop the handles and the clients and unsubscribe, called on the dispatcher thread
+     */
+    void detach();
+
+    /**
+     * @brief Get the rtnetlink client of a sandbox, the sandbox is opened on the calling
+     * thread on first use
+     *
+     * The client may be dropped by the next lookup, it is used right away.
+     *
+     * @param path the SandboxKey
+     * @param error set to the errno if the sandbox cannot be opened or entered
+     * @return rtnetlink* the client, nullptr on error
+     * @throw std::system_error if the thread cannot return to its namespace
+     */
+    rtnetlink * client(std::string_view path, int & error);
+
+    /**
+     * @brief Get the rtnetlink client of a sandbox without blocking the loop, the sandbox
+     * is opened on a worker on first use
+     *
+     * @param workers the pool, nullptr or a full queue opens the sandbox on the calling thread
+     * @param path the SandboxKey
+     * @param done called on the dispatcher thread, before the return if the sandbox is
+     * cached or opened inline
+     * @throw std::system_error if the thread cannot return to its namespace
+     */
+    void client(worker_pool * workers, std::string_view path, client_callback done);
+
+    /**
+     * @brief Get the rtnetlink client of a cached sandbox, nothing is opened
+     *
+     * @param path the SandboxKey
+     * @return rtnetlink* the client, nullptr if the sandbox is not cached
+     */
+    rtnetlink * cached(std::string_view path);
+
+    /**
+     * @brief Open a sandbox and its rtnetlink socket, called on any thread, which enters
+     * the sandbox and returns to the namespace of the dispatcher thread
+     *
+     * @param s the sandbox, its error is set on failure
+     * @throw std::system_error if the thread cannot return to the namespace
+     */
+    void open(sandbox & s) const;
+
+    /**
+     * @brief Take an opened sandbox into the cache, called on the dispatcher thread
+     *
+     * A sandbox cached meanwhile is kept and \b s is closed.
+     *
+     * @param s the sandbox
+     * @param error set to the errno if the sandbox failed to open or its client to attach
+     * @return rtnetlink* the client, nullptr on error
+     */
+    rtnetlink * install(sandbox & s, int & error);
+
+    /**
+     * @brief Drop a sandbox its container left, so the namespace is not kept alive, called
+     * on any thread, the cache of another thread drops it from its own loop
+     *
+     * @param path the SandboxKey
+     */
+    void forget(std::string_view path);
+
+    /**
+     * @brief Get the counters
+     */
+    const statistics & stats() const;
+
+protected:
+    /**
+     * @brief Destroy the retired clients whose messages are acknowledged or that waited too
+     * long, and arm the timer for the others
+     */
+    void on_loop() override;
+
+    /**
+     * @brief The on timer callback, the loop phase that follows destroys the expired clients
+     */
+    void on_timer() override;
+
+private:
+    class forget_task;
+
+    /**
+     * @brief A cached sandbox
+     */
+    struct entry
+    {
+        std::string                path{ };       ///< the SandboxKey
+        int                        fd{ -1 };      ///< the namespace handle
+        dev_t                      dev{ 0 };      ///< the device of the namespace
+        ino_t                      ino{ 0 };      ///< the inode of the namespace
+        uint64_t                   checked{ 0 };  ///< the time in milliseconds the path was last checked
+        std::unique_ptr<rtnetlink> netlink{ };    ///< the client
+    };
+
+    using entry_list = std::list<entry>;
+
+    /**
+     * @brief The client of a dropped entry, waiting for its acknowledgements
+     */
+    struct retired_client
+    {
+        std::unique_ptr<rtnetlink> netlink{ };    ///< the client
+        uint64_t                   retired{ 0 };  ///< the time in milliseconds it was dropped
+    };
+
+    /**
+     * @brief Find a cached sandbox and make it the most recently used, a stale one is dropped
+     *
+     * @param path the SandboxKey
+     * @return entry* the entry, nullptr if not cached
+     */
+    entry * find(std::string_view path);
+
+    /**
+     * @brief Drop a sandbox its container left, called on the dispatcher thread
+     *
+     * @param path the SandboxKey
+     */
+    void evict(std::string_view path);
+
+    /**
+     * @brief Drop an entry, its client is retired
+     *
+     * @param it the entry
+     */
+    void drop(entry_list::iterator it);
+
+    event_dispatcher                                           &dispatcher_;         ///< the event dispatcher
+    size_t                                                      capacity_{ 0 };      ///< the sandboxes kept open
+    int                                                         home_{ -1 };         ///< the namespace of the thread
+    entry_list                                                  entries_{ };         ///< the entries, most recently used first
+    std::unordered_map<std::string_view, entry_list::iterator>  index_{ };           ///< the entries by path
+    std::vector<retired_client>                                 retired_{ };         ///< the clients of the dropped entries
+    bool                                                        attached_{ false };  ///< attached to the thread
+    statistics                                                  stats_{ };           ///< the cache counters
+
+    static thread_local netns_cache *current_;  ///< the cache of the thread
+};
+
+inline netns_cache * netns_cache::current()
+{
+    return current_;
+}
+
+inline bool netns_cache::enabled() const
+{
+    return capacity_ != 0;
+}
+
+inline const netns_cache::statistics & netns_cache::stats() const
+{
+    return stats_;
+}
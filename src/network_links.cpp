@@ -0,0 +1,198 @@
+#include "network_links.h"
+
+#include <cerrno>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "veth_pool.h"
+
+namespace {
+
+/**
+ * @brief Make a link name from a prefix and the first digits of an id
+ */
+link_name make_name(std::string_view prefix, std::string_view id)
+{
+    char text[15];
+    auto const digits = id.substr(0, sizeof text - prefix.size());
+    prefix.copy(text, prefix.size());
+    digits.copy(text + prefix.size(), digits.size());
+
+    link_name name;
+    name.assign({ text, prefix.size() + digits.size() });
+    return name;
+}
+
+thread_local std::vector<std::unique_ptr<network_locks::guard>> guards;        ///< the guards of the thread
+thread_local std::vector<network_locks::guard *>                 spare_guards;  ///< the idle guards of the thread
+
+}
+
+link_name bridge_name(std::string_view network_id)
+{
+    return make_name("tn-", network_id);
+}
+
+link_name veth_name(std::string_view endpoint_id)
+{
+    return make_name("tv-", endpoint_id);
+}
+
+link_name veth_peer_name(std::string_view endpoint_id)
+{
+    return make_name("tp-", endpoint_id);
+}
+
+void create_bridge(rtnetlink & netlink, const link_name & bridge, const ipv4_prefix * gateway, rtnetlink::callback done)
+{
+    netlink.add_bridge(bridge.view());
+    if (!gateway) {
+        netlink.submit(std::move(done));
+        return;
+    }
+
+    // the address needs the index of the new bridge
+    auto const index = std::make_shared<int>(0);
+    netlink.get_link(bridge.view(), [index](const rtnetlink::link_info & link) {
+        *index = link.index;
+    });
+
+    netlink.submit([&netlink, index, address = *gateway, done = std::move(done)](int error) {
+        if (error != 0) {
+            done(error);
+            return;
+        }
+
+        netlink.add_address(*index, address.addr(), address.length);
+        netlink.submit(done);
+    });
+}
+
+void create_veth(rtnetlink & netlink, veth_pool * pool, const link_name & bridge, const link_name & name, const link_name & peer, rtnetlink::callback done)
+{
+    // the host end is enslaved as it is created or renamed, by the index of the bridge
+    auto const index = std::make_shared<int>(0);
+    netlink.get_link(bridge.view(), [index](const rtnetlink::link_info & link) {
+        *index = link.index;
+    });
+
+    veth_pool::pair pair;
+    auto const pooled = pool && pool->take(pair);
+    netlink.submit([&netlink, pool, pooled, pair, index, name, peer, done = std::move(done)](int error) {
+        if (error != 0) {
+            if (pooled) {
+                pool->give_back(pair);
+            }
+
+            done(error);
+            return;
+        }
+
+        if (!pooled) {
+            netlink.add_veth(name.view(), peer.view(), *index, true);
+            netlink.submit(done);
+            return;
+        }
+
+        // the slot is free again once the pair carries the endpoint names, a pair renamed
+        // halfway is deleted by either name of its host end
+        netlink.rename_link(pair.host, name.view(), *index, true);
+        netlink.rename_link(pair.peer, peer.view(), 0, false);
+        netlink.submit([&netlink, pool, pair, name, done](int error) {
+            if (error == 0) {
+                pool->release(pair);
+                done(0);
+                return;
+            }
+
+            netlink.delete_link(name.view());
+            netlink.submit([](int) {
+            });
+
+            netlink.delete_link(pool->host_name(pair).view());
+            netlink.submit([pool, pair, done, error](int) {
+                pool->release(pair);
+                done(error);
+            });
+        });
+    });
+}
+
+void remove_link(rtnetlink & netlink, const link_name & name, rtnetlink::callback done)
+{
+    netlink.delete_link(name.view());
+    netlink.submit([done = std::move(done)](int error) {
+        done(error == ENODEV ? 0 : error);
+    });
+}
+
+network_locks::guard::guard(event_dispatcher & dispatcher)
+    : async_waiter{ dispatcher }
+{
+}
+
+network_locks::guard::~guard()
+{
+    if (lock_) {
+        lock_->cancel(*this);
+    }
+
+    if (destroy_) {
+        destroy_(storage_);
+    }
+}
+
+void network_locks::guard::on_run()
+{
+    // an operation unlocking before it returns is destroyed once it returned
+    running_ = true;
+    invoke_(storage_, *this);
+    running_ = false;
+    if (released_) {
+        recycle();
+    }
+}
+
+void network_locks::guard::unlock()
+{
+    lock_->unlock();
+    lock_ = nullptr;
+    if (running_) {
+        released_ = true;
+    } else {
+        recycle();
+    }
+}
+
+void network_locks::guard::recycle()
+{
+    destroy_(storage_);
+    invoke_ = nullptr;
+    destroy_ = nullptr;
+    released_ = false;
+    spare_guards.push_back(this);
+}
+
+network_locks::guard & network_locks::take(event_dispatcher & dispatcher)
+{
+    // the guards of a thread wake up on the dispatcher it ran when they were created
+    if (spare_guards.empty() || &spare_guards.back()->dispatcher() != &dispatcher) {
+        spare_guards.clear();
+        guards.push_back(std::make_unique<guard>(dispatcher));
+        return *guards.back();
+    }
+
+    auto const g = spare_guards.back();
+    spare_guards.pop_back();
+    return *g;
+}
+
+void network_locks::start(guard & g, const object_id & network)
+{
+    auto & lock = locks_[network.hash() % stripes];
+    g.lock_ = &lock;
+    if (lock.lock(g)) {
+        g.on_run();
+    }
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "async_lock.h"
+#include "fixed_string.h"
+#include "ipam.h"
+#include "rtnetlink.h"
+#include "state_store.h"
+
+class veth_pool;
+
+/**
+ * The links backing the networks and endpoints when the plugin plumbs them: a bridge per
+ * network holding the gateway address, and a veth pair per endpoint whose host end is
+ * enslaved to the bridge and whose peer is moved into the container by the daemon. The
+ * links are named after the first 12 digits of the ids. A veth pair taken from the pool of
+ * the thread is renamed into place instead of created.
+ *
+ * Every step is a group of rtnetlink messages, a step needing a link index is submitted
+ * from the callback of the query, \b done is called once with 0 or the first errno.
+ */
+
+using link_name = fixed_string<15>;  ///< a link name, IFNAMSIZ less the terminator
+
+/**
+ * @brief Get the bridge name of a network, "tn-" and 12 id digits
+ */
+link_name bridge_name(std::string_view network_id);
+
+/**
+ * @brief Get the host end name of an endpoint, "tv-" and 12 id digits
+ */
+link_name veth_name(std::string_view endpoint_id);
+
+/**
+ * @brief Get the container end name of an endpoint, "tp-" and 12 id digits
+ */
+link_name veth_peer_name(std::string_view endpoint_id);
+
+/**
+ * @brief Create the bridge of a network and assign the gateway address
+ *
+ * @param netlink the rtnetlink client
+ * @param bridge the bridge name
+ * @param gateway the gateway address with its prefix length, nullptr if none
+ * @param done the callback
+ */
+void create_bridge(rtnetlink & netlink, const link_name & bridge, const ipv4_prefix * gateway, rtnetlink::callback done);
+
+/**
+ * @brief Create the veth pair of an endpoint, or rename a ready one of the pool, its host end
+ * joins the bridge
+ *
+ * @param netlink the rtnetlink client
+ * @param pool the veth pool of the thread, nullptr if none
+ * @param bridge the bridge name
+ * @param name the host end name
+ * @param peer the container end name
+ * @param done the callback
+ */
+void create_veth(rtnetlink & netlink, veth_pool * pool, const link_name & bridge, const link_name & name, const link_name & peer, rtnetlink::callback done);
+
+/**
+ * @brief Remove a link, a link already gone is not an error
+ *
+ * @param netlink the rtnetlink client
+ * @param name the link name
+ * @param done the callback
+ */
+void remove_link(rtnetlink & netlink, const link_name & name, rtnetlink::callback done);
+
+/**
+ * @brief The locks serializing the plumbing of each network, shared by the reactors
+ *
+ * A handler checks the state, plumbs the links and commits the change while it holds the
+ * lock of the network, so the requests of a network run one after the other in arrival
+ * order whichever reactor handles them, and none sees the links of another half done. A
+ * request waiting for the lock parks without blocking its reactor. The networks are spread
+ * over a fixed set of mutexes by their id hash, networks sharing one are serialized too.
+ *
+ * The operation is kept in a guard taken from a pool of the thread and given back once it
+ * unlocks, a lock allocates nothing once the pool holds as many guards as the operations
+ * the thread runs at a time.
+ */
+class network_locks
+{
+public:
+    static constexpr size_t stripes = 64;          ///< the mutexes the networks are spread over
+    static constexpr size_t operation_size = 512;  ///< the bytes of operation state a guard holds
+
+    /**
+     * @brief An operation holding the lock of its network
+     */
+    class guard
+        : public async_waiter
+    {
+        friend network_locks;
+
+    public:
+        /**
+         * @brief Construct a new guard object, idle
+         *
+         * @param dispatcher the dispatcher the operations run on
+         */
+        explicit guard(event_dispatcher & dispatcher);
+
+        /**
+         * @brief Destroy the guard object, a wait still parked is cancelled and an operation
+         * still held is destroyed, when the thread exits
+         */
+        ~guard() override;
+
+        /**
+         * @brief Run the operation, the lock is held
+         */
+        void on_run() override;
+
+        /**
+         * @brief Release the lock to the next operation of the network, the operation is
+         * destroyed and the guard goes back to the pool once the operation returned, called
+         * once by the operation
+         */
+        void unlock();
+
+    private:
+        using invoker = void (*)(void * op, guard & g);  ///< calls the operation in the storage
+        using destroyer = void (*)(void * op);           ///< destroys the operation in the storage
+
+        /**
+         * @brief Destroy the operation and put the guard back in the pool of the thread
+         */
+        void recycle();
+
+        alignas(std::max_align_t) unsigned char storage_[operation_size];  ///< the operation
+        invoker                                 invoke_{ nullptr };        ///< calls the operation, nullptr if idle
+        destroyer                               destroy_{ nullptr };       ///< destroys the operation, nullptr if idle
+        async_mutex                            *lock_{ nullptr };          ///< the mutex held or waited for, nullptr once unlocked
+        bool                                    running_{ false };         ///< the operation is being called
+        bool                                    released_{ false };        ///< unlocked while the operation was being called
+    };
+
+    network_locks() = default;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    network_locks(const network_locks &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const network_locks &) = delete;
+
+    /**
+     * @brief Run an operation holding the lock of a network, called on the dispatcher thread
+     *
+     * @tparam Op the operation, callable with the guard and at most operation_size bytes
+     * @param dispatcher the dispatcher of the calling thread
+     * @param network the network id
+     * @param op the operation, called on this thread right away if the lock is free, from
+     * the loop once it is handed over otherwise, and calling unlock on its guard once done
+     */
+    template <typename Op>
+    void run(event_dispatcher & dispatcher, const object_id & network, Op && op);
+
+private:
+    /**
+     * @brief Take an idle guard from the pool of the thread
+     *
+     * @param dispatcher the dispatcher of the calling thread
+     */
+    static guard & take(event_dispatcher & dispatcher);
+
+    /**
+     * @brief Lock the mutex of a network for a guard holding its operation
+     *
+     * @param g the guard
+     * @param network the network id
+     */
+    void start(guard & g, const object_id & network);
+
+    async_mutex locks_[stripes];  ///< the mutexes
+};
+
+template <typename Op>
+void network_locks::run(event_dispatcher & dispatcher, const object_id & network, Op && op)
+{
+    using op_type = std::decay_t<Op>;
+    static_assert(sizeof(op_type) <= operation_size && alignof(op_type) <= alignof(std::max_align_t), "the operation does not fit in a guard");
+
+    auto & g = take(dispatcher);
+    new (g.storage_) op_type{ std::forward<Op>(op) };
+    g.invoke_ = [](void * p, guard & g) {
+        (*static_cast<op_type *>(p))(g);
+    };
+
+    g.destroy_ = [](void * p) {
+        static_cast<op_type *>(p)->~op_type();
+    };
+
+    start(g, network);
+}
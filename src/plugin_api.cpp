@@ -0,0 +1,177 @@
+#include "plugin_api.h"
+
+#include "json_writer.h"
+
+bool plugin_options::set(const json_path & path, std::string_view value)
+{
+    if (path.size() != 3 || !path.starts_with("Options", "com.docker.network.generic")) {
+        return true;
+    }
+
+    // the options past max_options are dropped
+    if (count == max_options) {
+        return true;
+    }
+
+    // an option too long for its slot is skipped, the document is still accepted, a name
+    // longer than json_path::max_key reaches here empty
+    auto & option = options[count];
+    if (!path.key(2).empty() && option.key.assign(path.key(2)) && option.value.assign(value)) {
+        ++count;
+    }
+
+    return true;
+}
+
+std::string_view plugin_options::find(std::string_view key) const
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (options[i].key.view() == key) {
+            return options[i].value.view();
+        }
+    }
+
+    return { };
+}
+
+bool create_network_request::set(const json_path & path, std::string_view value)
+{
+    if (path.is("NetworkID")) {
+        return network_id.assign(value);
+    } else if (path.is("IPv4Data", 0, "Pool")) {
+        return ipv4_pool.assign(value);
+    } else if (path.is("IPv4Data", 0, "Gateway")) {
+        return ipv4_gateway.assign(value);
+    } else if (path.is("IPv6Data", 0, "Pool")) {
+        return ipv6_pool.assign(value);
+    } else if (path.is("IPv6Data", 0, "Gateway")) {
+        return ipv6_gateway.assign(value);
+    }
+
+    return options.set(path, value);
+}
+
+bool create_network_request::valid() const
+{
+    return !network_id.empty();
+}
+
+bool delete_network_request::set(const json_path & path, std::string_view value)
+{
+    return !path.is("NetworkID") || network_id.assign(value);
+}
+
+bool delete_network_request::valid() const
+{
+    return !network_id.empty();
+}
+
+bool create_endpoint_request::set(const json_path & path, std::string_view value)
+{
+    if (path.is("NetworkID")) {
+        return network_id.assign(value);
+    } else if (path.is("EndpointID")) {
+        return endpoint_id.assign(value);
+    } else if (path.is("Interface", "Address")) {
+        return address.assign(value);
+    } else if (path.is("Interface", "AddressIPv6")) {
+        return address_ipv6.assign(value);
+    } else if (path.is("Interface", "MacAddress")) {
+        return mac_address.assign(value);
+    }
+
+    return options.set(path, value);
+}
+
+bool create_endpoint_request::valid() const
+{
+    return !network_id.empty() && !endpoint_id.empty();
+}
+
+bool endpoint_request::set(const json_path & path, std::string_view value)
+{
+    if (path.is("NetworkID")) {
+        return network_id.assign(value);
+    } else if (path.is("EndpointID")) {
+        return endpoint_id.assign(value);
+    }
+
+    return true;
+}
+
+bool endpoint_request::valid() const
+{
+    return !network_id.empty() && !endpoint_id.empty();
+}
+
+bool join_request::set(const json_path & path, std::string_view value)
+{
+    if (path.is("NetworkID")) {
+        return network_id.assign(value);
+    } else if (path.is("EndpointID")) {
+        return endpoint_id.assign(value);
+    } else if (path.is("SandboxKey")) {
+        return sandbox_key.assign(value);
+    }
+
+    return options.set(path, value);
+}
+
+bool join_request::valid() const
+{
+    return !network_id.empty() && !endpoint_id.empty();
+}
+
+bool request_pool_request::set(const json_path & path, std::string_view value)
+{
+    if (path.is("AddressSpace")) {
+        return address_space.assign(value);
+    } else if (path.is("Pool")) {
+        return pool.assign(value);
+    } else if (path.is("SubPool")) {
+        return sub_pool.assign(value);
+    } else if (path.is("V6")) {
+        v6 = value == "true";
+    }
+
+    return true;
+}
+
+bool request_pool_request::valid() const
+{
+    return true;
+}
+
+bool release_pool_request::set(const json_path & path, std::string_view value)
+{
+    return !path.is("PoolID") || pool_id.assign(value);
+}
+
+bool release_pool_request::valid() const
+{
+    return !pool_id.empty();
+}
+
+bool address_request::set(const json_path & path, std::string_view value)
+{
+    if (path.is("PoolID")) {
+        return pool_id.assign(value);
+    } else if (path.is("Address")) {
+        return address.assign(value);
+    }
+
+    return true;
+}
+
+bool address_request::valid() const
+{
+    return !pool_id.empty();
+}
+
+void plugin_error(http_response * response, unsigned status, std::string_view message)
+{
+    response->status(status);
+    response->add_header("Content-Type", plugin_content_type);
+    json_writer json{ response->output() };
+    json.begin_object().key("Err").string(message).end_object();
+}
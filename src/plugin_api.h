@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+#include "fixed_string.h"
+#include "http_request.h"
+#include "http_response.h"
+#include "json_binder.h"
+#include "json_parser.h"
+#include "server.h"
+
+/**
+ * The docker remote network driver requests, refer:
+ * https://github.com/moby/moby/blob/master/libnetwork/docs/remote.md
+ *
+ * The request bodies are parsed as they arrive into fixed size structures, the fields
+ * the driver uses are kept and the rest of the document is skipped.
+ */
+
+/**
+ * @brief The content type of the plugin api responses
+ */
+constexpr const char * plugin_content_type = "application/vnd.docker.plugins.v1+json";
+
+using plugin_id = fixed_string<64>;  ///< a network or endpoint id, 64 hex digits
+
+/**
+ * @brief The driver options, the members of com.docker.network.generic
+ */
+struct plugin_options
+{
+    static constexpr size_t max_options = 8;  ///< the options kept, the others are ignored
+
+    /**
+     * @brief A driver option, a scalar value as written
+     */
+    struct option
+    {
+        fixed_string<64>  key{ };    ///< the option name
+        fixed_string<128> value{ };  ///< the option value
+    };
+
+    /**
+     * @brief Keep an option if the path is a member of Options.com.docker.network.generic,
+     * an option whose name or value does not fit is skipped
+     *
+     * @param path the path of the value
+     * @param value the value
+     * @return true, an option never rejects the document
+     */
+    bool set(const json_path & path, std::string_view value);
+
+    /**
+     * @brief Find an option
+     *
+     * @param key the option name
+     * @return std::string_view the value, empty if missing
+     */
+    std::string_view find(std::string_view key) const;
+
+    option options[max_options]{ };  ///< the options
+    size_t count{ 0 };               ///< the number of options
+};
+
+/**
+ * @brief The /NetworkDriver.CreateNetwork request
+ */
+struct create_network_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    plugin_id        network_id{ };    ///< NetworkID
+    fixed_string<64> ipv4_pool{ };     ///< IPv4Data[0].Pool
+    fixed_string<64> ipv4_gateway{ };  ///< IPv4Data[0].Gateway
+    fixed_string<64> ipv6_pool{ };     ///< IPv6Data[0].Pool
+    fixed_string<64> ipv6_gateway{ };  ///< IPv6Data[0].Gateway
+    plugin_options   options{ };       ///< Options.com.docker.network.generic
+};
+
+/**
+ * @brief The /NetworkDriver.DeleteNetwork request
+ */
+struct delete_network_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    plugin_id network_id{ };  ///< NetworkID
+};
+
+/**
+ * @brief The /NetworkDriver.CreateEndpoint request
+ */
+struct create_endpoint_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    plugin_id        network_id{ };    ///< NetworkID
+    plugin_id        endpoint_id{ };   ///< EndpointID
+    fixed_string<64> address{ };       ///< Interface.Address, the ipv4 address and prefix
+    fixed_string<64> address_ipv6{ };  ///< Interface.AddressIPv6
+    fixed_string<32> mac_address{ };   ///< Interface.MacAddress
+    plugin_options   options{ };       ///< Options.com.docker.network.generic
+};
+
+/**
+ * @brief The endpoint requests naming a network and an endpoint only, DeleteEndpoint,
+ * Leave and EndpointOperInfo
+ */
+struct endpoint_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    plugin_id network_id{ };   ///< NetworkID
+    plugin_id endpoint_id{ };  ///< EndpointID
+};
+
+/**
+ * @brief The /NetworkDriver.Join request
+ */
+struct join_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    plugin_id         network_id{ };   ///< NetworkID
+    plugin_id         endpoint_id{ };  ///< EndpointID
+    fixed_string<256> sandbox_key{ };  ///< SandboxKey, the network namespace path
+    plugin_options    options{ };      ///< Options.com.docker.network.generic
+};
+
+/**
+ * @brief The /IpamDriver.RequestPool request
+ */
+struct request_pool_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    fixed_string<64> address_space{ };  ///< AddressSpace
+    fixed_string<64> pool{ };           ///< Pool, empty for a default pool
+    fixed_string<64> sub_pool{ };       ///< SubPool
+    bool             v6{ false };       ///< V6
+};
+
+/**
+ * @brief The /IpamDriver.ReleasePool request
+ */
+struct release_pool_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    fixed_string<64> pool_id{ };  ///< PoolID
+};
+
+/**
+ * @brief The /IpamDriver.RequestAddress and /IpamDriver.ReleaseAddress requests
+ */
+struct address_request
+{
+    bool set(const json_path & path, std::string_view value);
+
+    bool valid() const;
+
+    fixed_string<64> pool_id{ };  ///< PoolID
+    fixed_string<64> address{ };  ///< Address, empty for any address
+};
+
+/**
+ * @brief Answer a plugin request with an error, the daemon reports the Err message
+ *
+ * @param response the response
+ * @param status the status code
+ * @param message the error message
+ */
+void plugin_error(http_response * response, unsigned status, std::string_view message);
+
+/**
+ * @brief The body consumer parsing a plugin request and calling its handler
+ *
+ * @tparam Request the request structure
+ * @tparam Handler the handler, callable as bool(const Request &, http_response *)
+ */
+template <typename Request, typename Handler>
+class plugin_consumer
+{
+public:
+    explicit plugin_consumer(const Handler & handler);
+
+    /**
+     * @brief Parse a body fragment, a malformed body is reported once the request is complete
+     */
+    bool on_body(std::string_view data);
+
+    /**
+     * @brief Call the handler with the parsed request, answers a malformed body with 400
+     */
+    bool operator()(const http_request & request, http_response * response);
+
+private:
+    Handler              handler_;     ///< the handler
+    json_parser          parser_{ };   ///< the parser
+    json_binder<Request> binder_{ };   ///< the binder holding the request
+    bool                 ok_{ true };  ///< the body is valid so far
+};
+
+/**
+ * @brief Register a plugin api handler, the request body is parsed into \b Request as it
+ * arrives
+ *
+ * @tparam Request the request structure
+ * @param svr the server
+ * @param uri the uri
+ * @param handler the handler, callable as bool(const Request &, http_response *)
+ */
+template <typename Request, typename Handler>
+void register_plugin_handler(server & svr, const char * uri, Handler handler);
+
+template <typename Request, typename Handler>
+inline plugin_consumer<Request, Handler>::plugin_consumer(const Handler & handler)
+    : handler_{ handler }
+{
+}
+
+template <typename Request, typename Handler>
+inline bool plugin_consumer<Request, Handler>::on_body(std::string_view data)
+{
+    ok_ = ok_ && parser_.feed(data, binder_);
+    return true;
+}
+
+template <typename Request, typename Handler>
+inline bool plugin_consumer<Request, Handler>::operator()(const http_request &, http_response * response)
+{
+    if (!ok_ || !parser_.finish(binder_) || !binder_.target().valid()) {
+        plugin_error(response, 400, "invalid request body");
+        return true;
+    }
+
+    return handler_(binder_.target(), response);
+}
+
+template <typename Request, typename Handler>
+inline void register_plugin_handler(server & svr, const char * uri, Handler handler)
+{
+    svr.register_body_consumer(uri, HTTP_POST, [handler = std::move(handler)] {
+        return plugin_consumer<Request, Handler>{ handler };
+    });
+}
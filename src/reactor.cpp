@@ -0,0 +1,106 @@
+#include "reactor.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <iostream>
+#include <system_error>
+
+reactor::reactor(unsigned id, event_dispatcher::backend backend, const char * path)
+    : id_{ id }
+    , dispatcher_{ backend }
+    , server_{ dispatcher_, path }
+    , netlink_{ dispatcher_ }
+    , veths_{ id, dispatcher_, netlink_ }
+    , sandboxes_{ dispatcher_ }
+{
+}
+
+reactor::reactor(unsigned id, event_dispatcher::backend backend, unsigned short port)
+    : id_{ id }
+    , dispatcher_{ backend }
+    , server_{ dispatcher_, port }
+    , netlink_{ dispatcher_ }
+    , veths_{ id, dispatcher_, netlink_ }
+    , sandboxes_{ dispatcher_ }
+{
+}
+
+reactor::reactor(unsigned id, reactor & sibling)
+    : id_{ id }
+    , dispatcher_{ sibling.dispatcher_.get_backend() }
+    , server_{ dispatcher_, sibling.server_ }
+    , netlink_{ dispatcher_ }
+    , veths_{ id, dispatcher_, netlink_ }
+    , sandboxes_{ dispatcher_ }
+{
+}
+
+void reactor::start(int cpu)
+{
+    thread_ = std::thread{ [this, cpu] { run(cpu); } };
+}
+
+void reactor::run(int cpu)
+{
+    // pin the thread
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        auto const err = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+        if (err != 0) {
+            std::cerr << "reactor " << id_ << ": cannot pin to cpu " << cpu << ": "
+                      << std::system_category().message(err) << std::endl;
+        }
+    }
+
+    // subscribe server io event, the listening socket may be shared with other reactors
+    if (!dispatcher_.subscribe(server_, server_.listen_events())) {
+        std::cerr << "reactor " << id_ << ": cannot subscribe io event for server" << std::endl;
+        return;
+    }
+
+    // subscribe server loop event
+    if (!dispatcher_.subscribe(server_)) {
+        std::cerr << "reactor " << id_ << ": cannot subscribe loop event for server" << std::endl;
+        dispatcher_.unsubscribe(static_cast<io_listener &>(server_));
+        return;
+    }
+
+    // subscribe the veth pool before the rtnetlink client, its refills are sent in the
+    // iteration they are queued in
+    if (veths_.enabled() && !veths_.attach()) {
+        std::cerr << "reactor " << id_ << ": cannot subscribe veth pool" << std::endl;
+    }
+
+    // subscribe the rtnetlink client after the server, the messages queued by the
+    // connections the server resumes are sent in the same iteration
+    if (!netlink_.attach(true)) {
+        std::cerr << "reactor " << id_ << ": cannot subscribe rtnetlink client" << std::endl;
+    }
+
+    // the clients of the sandboxes subscribe as they are created, after the server
+    if (sandboxes_.enabled() && !sandboxes_.attach()) {
+        std::cerr << "reactor " << id_ << ": cannot open the network namespace of the thread" << std::endl;
+    }
+
+    // run dispatcher
+    dispatcher_.run();
+
+    // drop the sandbox namespaces
+    sandboxes_.detach();
+
+    // unsubscribe rtnetlink client
+    netlink_.detach();
+
+    // unsubscribe veth pool
+    veths_.detach();
+
+    // unsubscribe server loop event
+    dispatcher_.unsubscribe(static_cast<loop_listener &>(server_));
+
+    // unsubscribe server io event, stop retrying a failed accept
+    dispatcher_.unsubscribe(static_cast<io_listener &>(server_));
+    dispatcher_.cancel(server_);
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <thread>
+
+#include "event_dispatcher.h"
+#include "netns_cache.h"
+#include "rtnetlink.h"
+#include "server.h"
+#include "veth_pool.h"
+
+/**
+ * @brief The reactor, an event dispatcher, its server, its rtnetlink client, its veth pool and
+ * its sandbox namespace cache running on a dedicated thread
+ */
+class reactor
+{
+public:
+    /**
+     * @brief Construct a new reactor object listening on a unix socket
+     *
+     * @param id the reactor index
+     * @param backend the event dispatcher backend
+     * @param path the unix socket path
+     */
+    reactor(unsigned id, event_dispatcher::backend backend, const char * path);
+
+    /**
+     * @brief Construct a new reactor object listening on a tcp port
+     *
+     * @param id the reactor index
+     * @param backend the event dispatcher backend
+     * @param port the port number
+     */
+    reactor(unsigned id, event_dispatcher::backend backend, unsigned short port);
+
+    /**
+     * @brief Construct a new reactor object sharing the backend, address and handlers of \b sibling
+     *
+     * @param id the reactor index
+     * @param sibling the reactor to share with
+     */
+    reactor(unsigned id, reactor & sibling);
+
+    /**
+     * @brief Destroy the reactor object, the thread must have been joined
+     */
+    ~reactor() = default;
+
+    /**
+     * @brief Move constructor is deleted
+     */
+    reactor(reactor &&) = delete;
+
+    /**
+     * @brief Move assignment is deleted
+     */
+    void operator=(reactor &&) = delete;
+
+    /**
+     * @brief Get the reactor index
+     */
+    unsigned id() const;
+
+    /**
+     * @brief Get the event dispatcher
+     */
+    const event_dispatcher & dispatcher() const;
+
+    /**
+     * @brief Get the server
+     */
+    server & get_server();
+
+    /**
+     * @brief Get the server
+     */
+    const server & get_server() const;
+
+    /**
+     * @brief Get the rtnetlink client, the handlers reach it with rtnetlink::current()
+     */
+    rtnetlink & netlink();
+
+    /**
+     * @brief Get the veth pool, the handlers reach it with veth_pool::current()
+     */
+    veth_pool & veths();
+
+    /**
+     * @brief Get the veth pool
+     */
+    const veth_pool & veths() const;
+
+    /**
+     * @brief Get the sandbox namespace cache, the handlers reach it with netns_cache::current()
+     */
+    netns_cache & sandboxes();
+
+    /**
+     * @brief Get the sandbox namespace cache
+     */
+    const netns_cache & sandboxes() const;
+
+    /**
+     * @brief Start the reactor thread
+     *
+     * @param cpu the cpu to pin the thread to, or -1 to leave it unpinned
+     */
+    void start(int cpu);
+
+    /**
+     * @brief Ask the reactor thread to stop, may be called from any thread
+     */
+    void stop();
+
+    /**
+     * @brief Wait for the reactor thread to exit
+     */
+    void join();
+
+private:
+    /**
+     * @brief The reactor thread entry
+     *
+     * @param cpu the cpu to pin the thread to, or -1 to leave it unpinned
+     */
+    void run(int cpu);
+
+    unsigned         id_{ 0 };        ///< the reactor index
+    event_dispatcher dispatcher_{ };  ///< the event dispatcher
+    server           server_;         ///< the server
+    rtnetlink        netlink_;        ///< the rtnetlink client
+    veth_pool        veths_;          ///< the veth pool, attached if enabled
+    netns_cache      sandboxes_;      ///< the sandbox namespace cache, attached if enabled
+    std::thread      thread_{ };      ///< the reactor thread
+};
+
+inline unsigned reactor::id() const
+{
+    return id_;
+}
+
+inline const event_dispatcher & reactor::dispatcher() const
+{
+    return dispatcher_;
+}
+
+inline server & reactor::get_server()
+{
+    return server_;
+}
+
+inline const server & reactor::get_server() const
+{
+    return server_;
+}
+
+inline rtnetlink & reactor::netlink()
+{
+    return netlink_;
+}
+
+inline veth_pool & reactor::veths()
+{
+    return veths_;
+}
+
+inline const veth_pool & reactor::veths() const
+{
+    return veths_;
+}
+
+inline netns_cache & reactor::sandboxes()
+{
+    return sandboxes_;
+}
+
+inline const netns_cache & reactor::sandboxes() const
+{
+    return sandboxes_;
+}
+
+inline void reactor::stop()
+{
+    dispatcher_.stop();
+}
+
+inline void reactor::join()
+{
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
@@ -0,0 +1,73 @@
+#include "recv_buffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "frame_pool.h"
+
+recv_buffer::~recv_buffer()
+{
+    if (data_) {
+        frame_pool::deallocate(data_, capacity_);
+    }
+}
+
+void recv_buffer::discard(size_t offset)
+{
+    auto const to = origin_ + offset;
+    if (to >= begin_) {
+        return;
+    }
+
+    memmove(data_ + to, data_ + begin_, end_ - begin_);
+    end_ -= begin_ - to;
+    begin_ = to;
+}
+
+char * recv_buffer::prepare()
+{
+    // first use, or released while idle
+    if (!data_) {
+        capacity_ = initial_capacity;
+        data_ = static_cast<char *>(frame_pool::allocate(capacity_));
+        return data_ + end_;
+    }
+
+    if (end_ < capacity_) {
+        return data_ + end_;
+    }
+
+    // move the current request to the front, its offsets from the origin stay the same
+    if (origin_ > 0) {
+        memmove(data_, data_ + origin_, end_ - origin_);
+        begin_ -= origin_;
+        end_ -= origin_;
+        origin_ = 0;
+        return data_ + end_;
+    }
+
+    // the current request fills the buffer, grow it
+    if (capacity_ >= max_capacity) {
+        throw std::runtime_error{ "request too large" };
+    }
+
+    auto const capacity = capacity_ * 2;
+    auto const data = static_cast<char *>(frame_pool::allocate(capacity));
+    memcpy(data, data_, end_);
+    frame_pool::deallocate(data_, capacity_);
+    data_ = data;
+    capacity_ = capacity;
+    return data_ + end_;
+}
+
+void recv_buffer::release()
+{
+    if (data_ && origin_ == end_) {
+        frame_pool::deallocate(data_, capacity_);
+        data_ = nullptr;
+        capacity_ = 0;
+        origin_ = 0;
+        begin_ = 0;
+        end_ = 0;
+    }
+}
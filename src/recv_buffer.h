@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief The receive buffer of a connection, reused across requests
+ *
+ * The buffer holds the current request from its first byte, the origin, up to the
+ * received data, the parser reads the unparsed range in place. Making room moves the
+ * current request to the front of the buffer or grows it, the bytes of the current
+ * request keep their offsets from the origin, so the views of a request stay valid
+ * relative to origin(). Memory comes from the frame pool and may be released while
+ * the buffer is empty.
+ */
+class recv_buffer
+{
+public:
+    static constexpr size_t initial_capacity = 4096;  ///< the capacity of the first allocation
+    static constexpr size_t max_capacity = 1 << 20;   ///< the largest request the buffer may hold
+
+    recv_buffer() = default;
+
+    /**
+     * @brief Destroy the recv buffer object
+     */
+    ~recv_buffer();
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    recv_buffer(const recv_buffer &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const recv_buffer &) = delete;
+
+    /**
+     * @brief Get the first byte of the current request
+     */
+    const char * origin() const;
+
+    /**
+     * @brief Get the first unparsed byte
+     */
+    const char * unparsed() const;
+
+    /**
+     * @brief Get the number of unparsed bytes
+     */
+    size_t unparsed_size() const;
+
+    /**
+     * @brief Check if every received byte has been parsed
+     */
+    bool empty() const;
+
+    /**
+     * @brief Mark the parsed bytes
+     *
+     * @param n the number of bytes
+     */
+    void consume(size_t n);
+
+    /**
+     * @brief Drop the parsed bytes past an offset of the current request, the unparsed bytes
+     * move down, a request whose body is streamed keeps only its header
+     *
+     * @param offset the offset from the origin
+     */
+    void discard(size_t offset);
+
+    /**
+     * @brief Start a new request at the first unparsed byte, rewinds an empty buffer
+     */
+    void start_request();
+
+    /**
+     * @brief Make room for received data, moves the current request to the front or grows
+     * the buffer when it is full
+     *
+     * @return char* the free space
+     * @throw std::runtime_error if the current request exceeds max_capacity
+     */
+    char * prepare();
+
+    /**
+     * @brief Get the size of the free space returned by prepare
+     */
+    size_t free_size() const;
+
+    /**
+     * @brief Mark received bytes
+     *
+     * @param n the number of bytes
+     */
+    void commit(size_t n);
+
+    /**
+     * @brief Give the memory back to the frame pool if the buffer holds no byte of a request
+     */
+    void release();
+
+private:
+    char   *data_{ nullptr };  ///< the buffer, nullptr if released
+    size_t  capacity_{ 0 };    ///< the buffer capacity
+    size_t  origin_{ 0 };      ///< the first byte of the current request
+    size_t  begin_{ 0 };       ///< the first unparsed byte
+    size_t  end_{ 0 };         ///< the end of the received data
+};
+
+inline const char * recv_buffer::origin() const
+{
+    return data_ + origin_;
+}
+
+inline const char * recv_buffer::unparsed() const
+{
+    return data_ + begin_;
+}
+
+inline size_t recv_buffer::unparsed_size() const
+{
+    return end_ - begin_;
+}
+
+inline bool recv_buffer::empty() const
+{
+    return begin_ == end_;
+}
+
+inline void recv_buffer::consume(size_t n)
+{
+    begin_ += n;
+}
+
+inline void recv_buffer::start_request()
+{
+    if (begin_ == end_) {
+        begin_ = 0;
+        end_ = 0;
+    }
+
+    origin_ = begin_;
+}
+
+inline size_t recv_buffer::free_size() const
+{
+    return capacity_ - end_;
+}
+
+inline void recv_buffer::commit(size_t n)
+{
+    end_ += n;
+}
@@ -0,0 +1,148 @@
+#include "response_writer.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <charconv>
+#include <utility>
+
+void response_writer::bind(http_response &response)
+{
+    response.bind(head_);
+}
+
+void response_writer::append(http_response &response, http_response::connection_header connection)
+{
+    // serialize the header block
+    auto const offset = head_.size();
+    response.serialize_header(head_, connection);
+    push_header(offset, head_.size() - offset);
+
+    // a body written into the header buffer precedes its header block there, the
+    // segments put it back after
+    if (auto const body = response.output_offset(); body != std::string::npos) {
+        push_header(body, offset - body);
+        return;
+    }
+
+    // take the body over
+    auto & body = response.body();
+    if (!body.empty()) {
+        auto const size = body.size();
+        auto const index = static_cast<int32_t>(bodies_.size());
+        bodies_.push_back(std::move(body));
+        segments_.push_back(segment{ nullptr, 0, size, index });
+        pending_ += size;
+    }
+}
+
+void response_writer::append(std::string_view data)
+{
+    auto const offset = head_.size();
+    head_.append(data);
+    push_header(offset, data.size());
+}
+
+void response_writer::append_chunk(std::string_view data)
+{
+    char size[20];
+    auto const end = std::to_chars(size, size + sizeof size, data.size(), 16).ptr;
+
+    auto const offset = head_.size();
+    head_.append(size, end);
+    head_.append("\r\n");
+    head_.append(data);
+    head_.append("\r\n");
+    push_header(offset, head_.size() - offset);
+}
+
+void response_writer::append_static(std::string_view data)
+{
+    if (!data.empty()) {
+        segments_.push_back(segment{ data.data(), 0, data.size(), -1 });
+        pending_ += data.size();
+    }
+}
+
+ssize_t response_writer::write(int fd)
+{
+    iovec iov[max_iov];
+    msghdr msg{ };
+    msg.msg_iov = iov;
+    msg.msg_iovlen = gather(iov);
+    auto const n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (n > 0) {
+        advance(n);
+    }
+
+    return n;
+}
+
+size_t response_writer::gather(iovec * iov) const
+{
+    size_t count = 0;
+    for (auto i = first_; i < segments_.size() && count < max_iov; ++i) {
+        auto const & seg = segments_[i];
+        auto const base = seg.data ? seg.data
+            : seg.body < 0 ? head_.data() + seg.offset
+            : bodies_[seg.body].data();
+        auto const skip = i == first_ ? sent_ : 0;
+        iov[count].iov_base = const_cast<char *>(base + skip);
+        iov[count].iov_len = seg.size - skip;
+        ++count;
+    }
+
+    return count;
+}
+
+void response_writer::advance(size_t n)
+{
+    // skip the written segments, the first one may be written partially
+    auto left = n;
+    pending_ -= left;
+    while (left > 0) {
+        auto const rest = segments_[first_].size - sent_;
+        if (left < rest) {
+            sent_ += left;
+            break;
+        }
+
+        left -= rest;
+        sent_ = 0;
+        ++first_;
+    }
+
+    if (pending_ == 0) {
+        clear();
+    }
+}
+
+void response_writer::push_header(size_t offset, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    pending_ += size;
+
+    // the header blocks of responses without a body are contiguous
+    if (segments_.size() > first_) {
+        auto & last = segments_.back();
+        if (!last.data && last.body < 0 && last.offset + last.size == offset) {
+            last.size += size;
+            return;
+        }
+    }
+
+    segments_.push_back(segment{ nullptr, offset, size, -1 });
+}
+
+void response_writer::clear()
+{
+    head_.clear();
+    bodies_.clear();
+    segments_.clear();
+    first_ = 0;
+    sent_ = 0;
+    pending_ = 0;
+}
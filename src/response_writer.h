@@ -0,0 +1,154 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http_response.h"
+
+struct iovec;
+
+/**
+ * @brief The queue of serialized responses, written with scatter-gather io
+ *
+ * The status lines and header blocks are serialized into one buffer, the bodies are
+ * moved in from the responses and pre-serialized static responses are referenced in place. A write sends as much of the queue as fits in one
+ * sendmsg, a partial write resumes where it stopped. The buffers keep their capacity
+ * once the queue is drained.
+ *
+ * A bound response writes its body straight into the header buffer, its header block is
+ * serialized after the body with the length known and queued before it.
+ */
+class response_writer
+{
+    /**
+     * @brief The range of the queue sent from one buffer
+     */
+    struct segment
+    {
+        const char * data{ nullptr };  ///< the external data, nullptr for the owned buffers
+        size_t       offset{ 0 };      ///< the offset in the header buffer, 0 otherwise
+        size_t       size{ 0 };        ///< the segment size
+        int32_t      body{ -1 };       ///< the body index, -1 for the header buffer
+    };
+
+public:
+    static constexpr size_t max_iov = 64;  ///< the segments sent by one write
+
+    response_writer() = default;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    response_writer(const response_writer &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const response_writer &) = delete;
+
+    /**
+     * @brief Bind a response to the header buffer, the handler writes the body in place
+     * with http_response::output()
+     *
+     * @param response the response
+     */
+    void bind(http_response &response);
+
+    /**
+     * @brief Queue a response, the body is moved out of it
+     *
+     * @param response the response
+     * @param connection the Connection header line
+     */
+    void append(http_response &response, http_response::connection_header connection);
+
+    /**
+     * @brief Queue raw data, copied into the header buffer
+     *
+     * @param data the data
+     */
+    void append(std::string_view data);
+
+    /**
+     * @brief Queue a chunk of a chunked body with its framing, copied into the header buffer
+     *
+     * @param data the chunk, an empty chunk ends the body
+     */
+    void append_chunk(std::string_view data);
+
+    /**
+     * @brief Queue immutable data without copying it, the data must outlive the write
+     *
+     * @param data the data
+     */
+    void append_static(std::string_view data);
+
+    /**
+     * @brief Check if everything queued has been written
+     */
+    bool empty() const;
+
+    /**
+     * @brief Get the number of bytes left to write
+     */
+    size_t size() const;
+
+    /**
+     * @brief Write the queue to a socket with a single sendmsg
+     *
+     * @param fd the socket
+     * @return ssize_t the bytes written, -1 with errno set on error
+     */
+    ssize_t write(int fd);
+
+    /**
+     * @brief Gather the front of the queue for a write submitted elsewhere
+     *
+     * @param iov the vector, max_iov entries
+     * @return size_t the entries used, valid until the queue changes
+     */
+    size_t gather(iovec * iov) const;
+
+    /**
+     * @brief Drop the written bytes from the front of the queue
+     *
+     * @param n the bytes written, at most size()
+     */
+    void advance(size_t n);
+
+private:
+    /**
+     * @brief Queue a range of the header buffer, merged with the last segment if contiguous
+     *
+     * @param offset the range offset
+     * @param size the range size
+     */
+    void push_header(size_t offset, size_t size);
+
+    /**
+     * @brief Drop the written data, keeps the capacity
+     */
+    void clear();
+
+    std::string              head_{ };       ///< the serialized status lines and headers
+    std::vector<std::string> bodies_{ };     ///< the bodies
+    std::vector<segment>     segments_{ };   ///< the queue
+    size_t                   first_{ 0 };    ///< the first segment not fully written
+    size_t                   sent_{ 0 };     ///< the bytes written of the first segment
+    size_t                   pending_{ 0 };  ///< the bytes left to write
+};
+
+inline bool response_writer::empty() const
+{
+    return pending_ == 0;
+}
+
+inline size_t response_writer::size() const
+{
+    return pending_;
+}
@@ -0,0 +1,53 @@
+#include "router.h"
+
+#include <algorithm>
+
+void router::add(std::string_view uri, uint64_t methods, std::shared_ptr<const static_response> response)
+{
+    route r;
+    r.methods_ = methods;
+    r.response_ = std::move(response);
+    insert(uri, std::move(r));
+}
+
+void router::insert(std::string_view uri, route &&r)
+{
+    if (std::find(uris_.begin(), uris_.end(), uri) != uris_.end()) {
+        return;
+    }
+
+    uris_.emplace_back(uri);
+    routes_.push_back(std::move(r));
+    rebuild();
+}
+
+void router::rebuild()
+{
+    // the seeds tried before the table grows
+    static constexpr uint64_t max_seeds = 4096;
+
+    // at least twice as many slots as routes keeps the seed search short
+    auto size = std::max<size_t>(8, slots_.size());
+    while (size < uris_.size() * 2) {
+        size *= 2;
+    }
+
+    for (;; size *= 2) {
+        for (uint64_t seed = 0; seed < max_seeds; ++seed) {
+            std::vector<uint32_t> slots(size, 0);
+            auto placed = true;
+            for (size_t i = 0; i < uris_.size() && placed; ++i) {
+                auto & slot = slots[hash(uris_[i], seed) & (size - 1)];
+                placed = slot == 0;
+                slot = static_cast<uint32_t>(i + 1);
+            }
+
+            if (placed) {
+                slots_ = std::move(slots);
+                seed_ = seed;
+                mask_ = size - 1;
+                return;
+            }
+        }
+    }
+}
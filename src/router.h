@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "body_consumer.h"
+#include "frame_pool.h"
+#include "http_request.h"
+#include "http_response.h"
+#include "static_response.h"
+
+/**
+ * @brief The route table, maps the registered uris to their handlers
+ *
+ * The uris are placed in an open table by a seeded hash, the seed is searched at
+ * registration until every uri has a slot of its own. A lookup hashes the uri once,
+ * reads one slot and compares one key, it neither allocates nor probes. The handlers
+ * are stored with their captured state and called through a thunk instantiated for
+ * their type, the call into the handler body is inlined in the thunk. A streaming route
+ * stores a factory creating a body consumer per request from the frame pool.
+ */
+class router
+{
+public:
+    static constexpr uint64_t any_method = ~uint64_t{ 0 };  ///< the method mask accepting every method
+
+    /**
+     * @brief The route of a uri, a handler or a constant response
+     */
+    class route
+    {
+        friend router;
+
+    public:
+        /**
+         * @brief Check if the route accepts a method
+         *
+         * @param method the request method
+         */
+        bool accepts(llhttp_method_t method) const;
+
+        /**
+         * @brief Get the largest body size
+         *
+         * @return size_t the size, 0 for the server default
+         */
+        size_t max_body() const;
+
+        /**
+         * @brief Create the body consumer of a request
+         *
+         * @return body_consumer* the consumer, nullptr if the route keeps the body
+         */
+        body_consumer *create_consumer() const;
+
+        /**
+         * @brief Get the constant response
+         *
+         * @return const static_response* the response, nullptr if the route has a handler
+         */
+        const static_response *response() const;
+
+        /**
+         * @brief Call the handler
+         *
+         * @param request the request
+         * @param response the response
+         * @return true if the request is handled
+         */
+        bool operator()(const http_request &request, http_response *response) const;
+
+    private:
+        using thunk = bool (*)(void *, const http_request &, http_response *);
+
+        using factory = body_consumer *(*)(void *);
+
+        uint64_t                               methods_{ any_method };  ///< the accepted methods mask
+        size_t                                 max_body_{ 0 };          ///< the largest body size, 0 for the default
+        thunk                                  thunk_{ nullptr };       ///< the handler thunk
+        factory                                factory_{ nullptr };     ///< the consumer factory thunk
+        std::shared_ptr<void>                  state_{ };               ///< the handler or factory with its captures
+        std::shared_ptr<const static_response> response_{ };            ///< the constant response
+    };
+
+    /**
+     * @brief Get the method mask of a method
+     *
+     * @param method the method
+     */
+    static constexpr uint64_t method_mask(llhttp_method_t method);
+
+    /**
+     * @brief Add a handler route, an existing route of the uri is kept
+     *
+     * @param uri the uri
+     * @param methods the accepted methods mask
+     * @param handler the handler, callable as bool(const http_request &, http_response *)
+     * @param max_body the largest body size, 0 for the server default
+     */
+    template <typename Handler>
+    void add(std::string_view uri, uint64_t methods, Handler &&handler, size_t max_body = 0);
+
+    /**
+     * @brief Add a streaming route, an existing route of the uri is kept
+     *
+     * The factory returns a consumer by value for each request. The consumer has a
+     * bool on_body(std::string_view) member taking the body fragments and is callable as
+     * bool(const http_request &, http_response *) once the request is complete.
+     *
+     * @param uri the uri
+     * @param methods the accepted methods mask
+     * @param factory the consumer factory
+     * @param max_body the largest body size, 0 for the server default
+     */
+    template <typename Factory>
+    void add_consumer(std::string_view uri, uint64_t methods, Factory &&factory, size_t max_body = 0);
+
+    /**
+     * @brief Add a constant response route, an existing route of the uri is kept
+     *
+     * @param uri the uri
+     * @param methods the accepted methods mask
+     * @param response the response
+     */
+    void add(std::string_view uri, uint64_t methods, std::shared_ptr<const static_response> response);
+
+    /**
+     * @brief Find the route of a uri
+     *
+     * @param uri the uri
+     * @return const route* the route if found, otherwise nullptr
+     */
+    const route *find(std::string_view uri) const;
+
+    /**
+     * @brief Get the number of routes
+     */
+    size_t size() const;
+
+private:
+    /**
+     * @brief The body consumer adapting a consumer type, allocated from the frame pool
+     */
+    template <typename Consumer>
+    class consumer_node final
+        : public body_consumer
+    {
+    public:
+        explicit consumer_node(Consumer &&consumer);
+
+        bool on_body(std::string_view data) override;
+
+        bool on_complete(const http_request &request, http_response *response) override;
+
+        void destroy() override;
+
+    private:
+        Consumer consumer_;  ///< the consumer
+    };
+
+    /**
+     * @brief Call a handler of a known type
+     */
+    template <typename Handler>
+    static bool invoke(void *state, const http_request &request, http_response *response);
+
+    /**
+     * @brief Create a consumer with a factory of a known type
+     */
+    template <typename Factory>
+    static body_consumer *create(void *state);
+
+    /**
+     * @brief Add a route and rebuild the table
+     *
+     * @param uri the uri
+     * @param r the route
+     */
+    void insert(std::string_view uri, route &&r);
+
+    /**
+     * @brief Search a seed placing every uri in a slot of its own, grows the table if none is found
+     */
+    void rebuild();
+
+    /**
+     * @brief The seeded fnv-1a hash
+     *
+     * @param uri the uri
+     * @param seed the seed
+     */
+    static uint64_t hash(std::string_view uri, uint64_t seed);
+
+    std::vector<std::string> uris_{ };    ///< the registered uris
+    std::vector<route>       routes_{ };  ///< the routes, by the index of their uri
+    std::vector<uint32_t>    slots_{ };   ///< the route index plus one by slot, 0 if empty
+    uint64_t                 seed_{ 0 };  ///< the hash seed
+    size_t                   mask_{ 0 };  ///< the slot index mask
+};
+
+inline bool router::route::accepts(llhttp_method_t method) const
+{
+    return (methods_ & method_mask(method)) != 0;
+}
+
+inline size_t router::route::max_body() const
+{
+    return max_body_;
+}
+
+inline body_consumer * router::route::create_consumer() const
+{
+    return factory_ ? factory_(state_.get()) : nullptr;
+}
+
+inline const static_response * router::route::response() const
+{
+    return response_.get();
+}
+
+inline bool router::route::operator()(const http_request &request, http_response *response) const
+{
+    return thunk_(state_.get(), request, response);
+}
+
+constexpr uint64_t router::method_mask(llhttp_method_t method)
+{
+    return method < 64 ? uint64_t{ 1 } << method : 0;
+}
+
+template <typename Handler>
+inline void router::add(std::string_view uri, uint64_t methods, Handler &&handler, size_t max_body)
+{
+    using handler_type = std::decay_t<Handler>;
+
+    route r;
+    r.methods_ = methods;
+    r.max_body_ = max_body;
+    r.thunk_ = &invoke<handler_type>;
+    r.state_ = std::make_shared<handler_type>(std::forward<Handler>(handler));
+    insert(uri, std::move(r));
+}
+
+template <typename Factory>
+inline void router::add_consumer(std::string_view uri, uint64_t methods, Factory &&factory, size_t max_body)
+{
+    using factory_type = std::decay_t<Factory>;
+
+    route r;
+    r.methods_ = methods;
+    r.max_body_ = max_body;
+    r.factory_ = &create<factory_type>;
+    r.state_ = std::make_shared<factory_type>(std::forward<Factory>(factory));
+    insert(uri, std::move(r));
+}
+
+template <typename Handler>
+inline bool router::invoke(void *state, const http_request &request, http_response *response)
+{
+    return (*static_cast<Handler *>(state))(request, response);
+}
+
+template <typename Factory>
+inline body_consumer * router::create(void *state)
+{
+    using consumer_type = std::decay_t<decltype(std::declval<Factory &>()())>;
+    using node_type = consumer_node<consumer_type>;
+
+    auto const mem = frame_pool::allocate(sizeof(node_type));
+    return ::new(mem) node_type{ (*static_cast<Factory *>(state))() };
+}
+
+template <typename Consumer>
+inline router::consumer_node<Consumer>::consumer_node(Consumer &&consumer)
+    : consumer_{ std::move(consumer) }
+{
+}
+
+template <typename Consumer>
+inline bool router::consumer_node<Consumer>::on_body(std::string_view data)
+{
+    return consumer_.on_body(data);
+}
+
+template <typename Consumer>
+inline bool router::consumer_node<Consumer>::on_complete(const http_request &request, http_response *response)
+{
+    return consumer_(request, response);
+}
+
+template <typename Consumer>
+inline void router::consumer_node<Consumer>::destroy()
+{
+    this->~consumer_node();
+    frame_pool::deallocate(this, sizeof(consumer_node));
+}
+
+inline const router::route * router::find(std::string_view uri) const
+{
+    if (slots_.empty()) {
+        return nullptr;
+    }
+
+    auto const i = slots_[hash(uri, seed_) & mask_];
+    return i != 0 && uris_[i - 1] == uri ? &routes_[i - 1] : nullptr;
+}
+
+inline size_t router::size() const
+{
+    return routes_.size();
+}
+
+inline uint64_t router::hash(std::string_view uri, uint64_t seed)
+{
+    auto h = 0xcbf29ce484222325 ^ seed;
+    for (auto const c : uri) {
+        h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+
+    return h ^ (h >> 32);
+}
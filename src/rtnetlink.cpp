@@ -0,0 +1,507 @@
+#include "rtnetlink.h"
+
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <utility>
+
+thread_local rtnetlink * rtnetlink::current_{ nullptr };
+
+namespace {
+
+constexpr size_t receive_size = 64 * 1024;  ///< the receive buffer size, a link dump fits with room
+
+/**
+ * @brief Get the attributes of a link from its RTM_NEWLINK message
+ */
+rtnetlink::link_info parse_link(const nlmsghdr & msg)
+{
+    auto const info = static_cast<const ifinfomsg *>(NLMSG_DATA(&msg));
+    rtnetlink::link_info link;
+    link.index = info->ifi_index;
+    link.flags = info->ifi_flags;
+
+    auto len = static_cast<int>(IFLA_PAYLOAD(&msg));
+    for (auto attr = IFLA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+        auto const data = RTA_DATA(attr);
+        auto const size = RTA_PAYLOAD(attr);
+        switch (attr->rta_type) {
+        case IFLA_IFNAME:
+            link.name = std::string_view{ static_cast<const char *>(data), strnlen(static_cast<const char *>(data), size) };
+            break;
+        case IFLA_LINK:
+            if (size >= sizeof(uint32_t)) {
+                link.link = static_cast<int>(*static_cast<const uint32_t *>(data));
+            }
+            break;
+        case IFLA_LINK_NETNSID:
+            if (size >= sizeof(int32_t)) {
+                link.link_netnsid = *static_cast<const int32_t *>(data);
+            }
+            break;
+        case IFLA_MTU:
+            if (size >= sizeof(uint32_t)) {
+                link.mtu = *static_cast<const uint32_t *>(data);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return link;
+}
+
+}
+
+rtnetlink::rtnetlink(event_dispatcher & dispatcher)
+    : rtnetlink{ dispatcher, open_socket() }
+{
+}
+
+rtnetlink::rtnetlink(event_dispatcher & dispatcher, int fd)
+    : io_listener{ fd }
+    , dispatcher_{ dispatcher }
+    , recv_buffer_(receive_size)
+{
+}
+
+int rtnetlink::open_socket()
+{
+    auto const fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot open rtnetlink socket" };
+    }
+
+    sockaddr_nl addr{ };
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+        auto const err = errno;
+        close(fd);
+        throw std::system_error{ err, std::system_category(), "cannot bind rtnetlink socket" };
+    }
+
+    // the acknowledgements carry the header of the request only, not its payload
+    int const one = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof one);
+    return fd;
+}
+
+rtnetlink::~rtnetlink()
+{
+    detach();
+}
+
+bool rtnetlink::attach(bool thread_client)
+{
+    if (!dispatcher_.subscribe(static_cast<io_listener &>(*this), event_dispatcher::readable)) {
+        return false;
+    }
+
+    if (!dispatcher_.subscribe(static_cast<loop_listener &>(*this))) {
+        dispatcher_.unsubscribe(static_cast<io_listener &>(*this));
+        return false;
+    }
+
+    attached_ = true;
+    if (thread_client) {
+        current_ = this;
+    }
+
+    return true;
+}
+
+void rtnetlink::detach()
+{
+    if (!attached_) {
+        return;
+    }
+
+    dispatcher_.unsubscribe(static_cast<loop_listener &>(*this));
+    dispatcher_.unsubscribe(static_cast<io_listener &>(*this));
+    attached_ = false;
+    if (current_ == this) {
+        current_ = nullptr;
+    }
+}
+
+void rtnetlink::add_bridge(std::string_view name)
+{
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    info.ifi_flags = IFF_UP;
+    info.ifi_change = IFF_UP;
+    auto const msg = begin(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, &info, sizeof info);
+    attribute(IFLA_IFNAME, name);
+    auto const link_info = begin_nested(IFLA_LINKINFO);
+    attribute(IFLA_INFO_KIND, "bridge");
+    end_nested(link_info);
+    end(msg);
+}
+
+void rtnetlink::add_veth(std::string_view name, std::string_view peer, int master, bool up)
+{
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    if (up) {
+        info.ifi_flags = IFF_UP;
+        info.ifi_change = IFF_UP;
+    }
+
+    auto const msg = begin(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, &info, sizeof info);
+    attribute(IFLA_IFNAME, name);
+    if (master > 0) {
+        auto const index = static_cast<uint32_t>(master);
+        attribute(IFLA_MASTER, &index, sizeof index);
+    }
+
+    // the peer is described by an ifinfomsg and its own attributes
+    auto const link_info = begin_nested(IFLA_LINKINFO);
+    attribute(IFLA_INFO_KIND, "veth");
+    auto const data = begin_nested(IFLA_INFO_DATA);
+    auto const peer_info = begin_nested(VETH_INFO_PEER);
+    ifinfomsg const peer_msg{ };
+    pending_.append(reinterpret_cast<const char *>(&peer_msg), NLMSG_ALIGN(sizeof peer_msg));
+    attribute(IFLA_IFNAME, peer);
+    end_nested(peer_info);
+    end_nested(data);
+    end_nested(link_info);
+    end(msg);
+}
+
+void rtnetlink::rename_link(int ifindex, std::string_view name, int master, bool up)
+{
+    // the kernel renames the link before it changes its flags and its master
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    info.ifi_index = ifindex;
+    if (up) {
+        info.ifi_flags = IFF_UP;
+        info.ifi_change = IFF_UP;
+    }
+
+    auto const msg = begin(RTM_NEWLINK, 0, &info, sizeof info);
+    attribute(IFLA_IFNAME, name);
+    if (master > 0) {
+        auto const index = static_cast<uint32_t>(master);
+        attribute(IFLA_MASTER, &index, sizeof index);
+    }
+
+    end(msg);
+}
+
+void rtnetlink::set_link_up(std::string_view name)
+{
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    info.ifi_flags = IFF_UP;
+    info.ifi_change = IFF_UP;
+    auto const msg = begin(RTM_NEWLINK, 0, &info, sizeof info);
+    attribute(IFLA_IFNAME, name);
+    end(msg);
+}
+
+void rtnetlink::delete_link(std::string_view name)
+{
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    auto const msg = begin(RTM_DELLINK, 0, &info, sizeof info);
+    attribute(IFLA_IFNAME, name);
+    end(msg);
+}
+
+void rtnetlink::add_address(int ifindex, const in_addr & addr, int prefix)
+{
+    ifaddrmsg info{ };
+    info.ifa_family = AF_INET;
+    info.ifa_prefixlen = static_cast<uint8_t>(prefix);
+    info.ifa_scope = RT_SCOPE_UNIVERSE;
+    info.ifa_index = static_cast<uint32_t>(ifindex);
+    auto const msg = begin(RTM_NEWADDR, NLM_F_CREATE | NLM_F_EXCL, &info, sizeof info);
+    attribute(IFA_LOCAL, &addr, sizeof addr);
+    attribute(IFA_ADDRESS, &addr, sizeof addr);
+    end(msg);
+}
+
+void rtnetlink::get_link(std::string_view name, link_callback cb)
+{
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    auto const msg = begin(RTM_GETLINK, 0, &info, sizeof info);
+    attribute(IFLA_IFNAME, name);
+    uint32_t const mask = RTEXT_FILTER_SKIP_STATS;
+    attribute(IFLA_EXT_MASK, &mask, sizeof mask);
+    end(msg);
+    queries_.push_back(link_query{ seq_, std::move(cb) });
+}
+
+void rtnetlink::get_link(int ifindex, link_callback cb)
+{
+    ifinfomsg info{ };
+    info.ifi_family = AF_UNSPEC;
+    info.ifi_index = ifindex;
+    auto const msg = begin(RTM_GETLINK, 0, &info, sizeof info);
+    uint32_t const mask = RTEXT_FILTER_SKIP_STATS;
+    attribute(IFLA_EXT_MASK, &mask, sizeof mask);
+    end(msg);
+    queries_.push_back(link_query{ seq_, std::move(cb) });
+}
+
+void rtnetlink::submit(callback cb)
+{
+    if (seq_ + 1 == open_) {
+        cb(0);
+        return;
+    }
+
+    groups_.push_back(group{ open_, seq_, seq_ + 1 - open_, 0, std::move(cb) });
+    open_ = seq_ + 1;
+    submitted_ = pending_.size();
+}
+
+void rtnetlink::on_read()
+{
+    for (;;) {
+        auto const n = recv(fd(), recv_buffer_.data(), recv_buffer_.size(), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // the socket overflowed and acknowledgements were lost, the groups sent so far
+            // cannot complete
+            if (errno == ENOBUFS) {
+                outstanding_ = 0;
+                fail(0, unsent_, ENOBUFS);
+                continue;
+            }
+
+            return;
+        }
+
+        auto len = static_cast<unsigned>(n);
+        for (auto msg = reinterpret_cast<const nlmsghdr *>(recv_buffer_.data()); NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+            dispatch(*msg);
+        }
+    }
+}
+
+void rtnetlink::on_write()
+{
+}
+
+void rtnetlink::on_loop()
+{
+    // the callbacks of failed sends may submit more, the rest waits for acknowledgements
+    while (submitted_ != 0 && outstanding_ < max_outstanding) {
+        flush();
+    }
+}
+
+size_t rtnetlink::begin(uint16_t type, uint16_t flags, const void * body, size_t size)
+{
+    nlmsghdr header{ };
+    header.nlmsg_type = type;
+    header.nlmsg_flags = static_cast<uint16_t>(NLM_F_REQUEST | NLM_F_ACK | flags);
+    header.nlmsg_seq = ++seq_;
+
+    auto const offset = pending_.size();
+    pending_.append(reinterpret_cast<const char *>(&header), NLMSG_HDRLEN);
+    pending_.append(static_cast<const char *>(body), size);
+    pending_.resize(offset + NLMSG_ALIGN(pending_.size() - offset));
+    return offset;
+}
+
+void rtnetlink::attribute(uint16_t type, const void * data, size_t size)
+{
+    rtattr attr{ };
+    attr.rta_type = type;
+    attr.rta_len = static_cast<unsigned short>(RTA_LENGTH(size));
+    pending_.append(reinterpret_cast<const char *>(&attr), sizeof attr);
+    pending_.append(static_cast<const char *>(data), size);
+    pending_.resize(pending_.size() + RTA_ALIGN(size) - size);
+}
+
+void rtnetlink::attribute(uint16_t type, std::string_view value)
+{
+    rtattr attr{ };
+    attr.rta_type = type;
+    attr.rta_len = static_cast<unsigned short>(RTA_LENGTH(value.size() + 1));
+    pending_.append(reinterpret_cast<const char *>(&attr), sizeof attr);
+    pending_.append(value);
+    pending_.resize(pending_.size() + RTA_ALIGN(value.size() + 1) - value.size());
+}
+
+size_t rtnetlink::begin_nested(uint16_t type)
+{
+    auto const offset = pending_.size();
+    rtattr attr{ };
+    attr.rta_type = type;
+    pending_.append(reinterpret_cast<const char *>(&attr), sizeof attr);
+    return offset;
+}
+
+void rtnetlink::end_nested(size_t offset)
+{
+    auto const len = static_cast<unsigned short>(pending_.size() - offset);
+    memcpy(pending_.data() + offset + offsetof(rtattr, rta_len), &len, sizeof len);
+}
+
+void rtnetlink::end(size_t offset)
+{
+    auto const len = static_cast<uint32_t>(pending_.size() - offset);
+    memcpy(pending_.data() + offset + offsetof(nlmsghdr, nlmsg_len), &len, sizeof len);
+}
+
+void rtnetlink::dispatch(const nlmsghdr & msg)
+{
+    if (msg.nlmsg_type == NLMSG_ERROR) {
+        if (msg.nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))) {
+            auto const err = static_cast<const nlmsgerr *>(NLMSG_DATA(&msg));
+            acknowledge(msg.nlmsg_seq, -err->error);
+        }
+
+        return;
+    }
+
+    // the reply of a link query comes before its acknowledgement
+    if (msg.nlmsg_type == RTM_NEWLINK && msg.nlmsg_len >= NLMSG_LENGTH(sizeof(ifinfomsg))) {
+        auto const it = std::find_if(queries_.begin(), queries_.end(), [&msg](const link_query & q) {
+            return q.seq == msg.nlmsg_seq;
+        });
+
+        if (it != queries_.end()) {
+            auto const cb = std::move(it->cb);
+            queries_.erase(it);
+            cb(parse_link(msg));
+        }
+    }
+}
+
+void rtnetlink::acknowledge(uint32_t seq, int error)
+{
+    if (outstanding_ != 0) {
+        --outstanding_;
+    }
+
+    // the group holding the message, if it has not been failed already
+    auto const it = std::lower_bound(groups_.begin(), groups_.end(), seq, [](const group & g, uint32_t s) {
+        return g.last < s;
+    });
+
+    if (it == groups_.end() || it->first > seq || it->remaining == 0) {
+        return;
+    }
+
+    if (error != 0 && it->error == 0) {
+        it->error = error;
+    }
+
+    if (--it->remaining == 0) {
+        complete(*it);
+    }
+}
+
+void rtnetlink::flush()
+{
+    // cut the batch at a message boundary
+    size_t size = 0;
+    uint32_t count = 0;
+    while (size < submitted_ && outstanding_ + count < max_outstanding) {
+        auto const len = reinterpret_cast<const nlmsghdr *>(pending_.data() + size)->nlmsg_len;
+        if (size != 0 && size + len > max_batch) {
+            break;
+        }
+
+        size += NLMSG_ALIGN(len);
+        ++count;
+    }
+
+    sockaddr_nl kernel{ };
+    kernel.nl_family = AF_NETLINK;
+    iovec iov{ pending_.data(), size };
+    msghdr msg{ };
+    msg.msg_name = &kernel;
+    msg.msg_namelen = sizeof kernel;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    ssize_t n;
+    do {
+        n = sendmsg(fd(), &msg, 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n >= 0) {
+        pending_.erase(0, size);
+        submitted_ -= size;
+        unsent_ += count;
+        outstanding_ += count;
+        return;
+    }
+
+    // the submitted messages are dropped, the open group keeps its messages
+    auto const err = errno;
+    auto const from = unsent_;
+    pending_.erase(0, submitted_);
+    submitted_ = 0;
+    unsent_ = open_;
+    fail(from, open_, err);
+}
+
+void rtnetlink::abort(int error)
+{
+    outstanding_ = 0;
+    fail(0, std::numeric_limits<uint32_t>::max(), error);
+}
+
+void rtnetlink::fail(uint32_t from, uint32_t to, int error)
+{
+    // collected first, the callbacks may submit more groups
+    std::vector<std::pair<callback, int>> failed;
+    for (auto & g : groups_) {
+        if (g.remaining != 0 && g.last >= from && g.first < to) {
+            g.remaining = 0;
+            failed.emplace_back(std::move(g.cb), g.error != 0 ? g.error : error);
+            std::erase_if(queries_, [&g](const link_query & q) {
+                return q.seq >= g.first && q.seq <= g.last;
+            });
+        }
+    }
+
+    while (!groups_.empty() && groups_.front().remaining == 0) {
+        groups_.pop_front();
+    }
+
+    for (auto & [cb, err] : failed) {
+        cb(err);
+    }
+}
+
+void rtnetlink::complete(group & g)
+{
+    auto const cb = std::move(g.cb);
+    auto const error = g.error;
+
+    // the queries the kernel did not answer
+    auto const first = g.first;
+    auto const last = g.last;
+    std::erase_if(queries_, [first, last](const link_query & q) {
+        return q.seq >= first && q.seq <= last;
+    });
+
+    while (!groups_.empty() && groups_.front().remaining == 0) {
+        groups_.pop_front();
+    }
+
+    cb(error);
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "event_dispatcher.h"
+
+struct nlmsghdr;
+
+/**
+ * @brief The non-blocking rtnetlink client of an event dispatcher thread
+ *
+ * The requests are netlink messages asking for an acknowledgement, numbered by their
+ * sequence number. The messages queued since the previous submit form a group whose
+ * callback is called once the kernel acknowledged all of them, with the error of the
+ * first failed one. The messages queued during a loop iteration are sent together once
+ * the io events of the iteration are handled, with one sendmsg per 32 KB, and the
+ * acknowledgements are read as the socket becomes readable, so the event loop never
+ * waits for the kernel. At most max_outstanding messages are unacknowledged at a time,
+ * the kernel drops the acknowledgements that overflow the socket receive buffer, the
+ * others wait for the next loop iteration.
+ *
+ * The callbacks run on the dispatcher thread and may queue and submit more messages,
+ * a step needing the outcome of the previous one is submitted from its callback.
+ */
+class rtnetlink
+    : public io_listener
+    , public loop_listener
+{
+public:
+    /**
+     * @brief The callback of a group, \b error is 0 or the errno of the first failed message
+     */
+    using callback = std::function<void(int error)>;
+
+    /**
+     * @brief The attributes of a link a query reports, the name is valid during the callback
+     */
+    struct link_info
+    {
+        int              index{ 0 };          ///< the link index
+        int              link{ 0 };           ///< the index of the peer of a veth end, in the peer's namespace, 0 if none
+        int              link_netnsid{ -1 };  ///< the id of the namespace of the peer, -1 if it is this one
+        unsigned         flags{ 0 };          ///< the IFF_ flags
+        uint32_t         mtu{ 0 };            ///< the mtu
+        std::string_view name{ };             ///< the link name
+    };
+
+    /**
+     * @brief The callback of a link query, called with the link before the group callback
+     */
+    using link_callback = std::function<void(const link_info & link)>;
+
+    static constexpr size_t   max_batch = 32 * 1024;  ///< the largest sendmsg
+    static constexpr uint32_t max_outstanding = 32;  ///< the messages sent and not acknowledged, bounds the replies queued on the socket
+
+    /**
+     * @brief Construct a new rtnetlink object, the socket is opened and bound
+     *
+     * @param dispatcher the event dispatcher
+     * @throw std::system_error if the socket cannot be opened
+     */
+    explicit rtnetlink(event_dispatcher & dispatcher);
+
+    /**
+     * @brief Construct a new rtnetlink object on a socket opened by open_socket, possibly
+     * in another network namespace and on another thread
+     *
+     * @param dispatcher the event dispatcher
+     * @param fd the socket, owned by the client
+     */
+    rtnetlink(event_dispatcher & dispatcher, int fd);
+
+    /**
+     * @brief Destroy the rtnetlink object, the groups in flight are dropped uncalled
+     */
+    ~rtnetlink() override;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    rtnetlink(const rtnetlink &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const rtnetlink &) = delete;
+
+    /**
+     * @brief Get the client of the calling thread
+     *
+     * @return rtnetlink* the client, nullptr if the thread has none attached
+     */
+    static rtnetlink * current();
+
+    /**
+     * @brief Open and bind a socket in the network namespace of the calling thread, the
+     * kernel picks the port id
+     *
+     * @return int the socket
+     * @throw std::system_error if the socket cannot be opened
+     */
+    static int open_socket();
+
+    /**
+     * @brief Get the event dispatcher the callbacks run on
+     */
+    event_dispatcher & dispatcher() const;
+
+    /**
+     * @brief Subscribe to the dispatcher, called on the dispatcher thread
+     *
+     * @param thread_client become the client of the calling thread, false for a client of
+     * another network namespace
+     * @return true if subscribed
+     */
+    bool attach(bool thread_client);
+
+    /**
+     * @brief Unsubscribe from the dispatcher, called on the dispatcher thread
+     */
+    void detach();
+
+    /**
+     * @brief Queue the creation of a bridge, brought up
+     *
+     * @param name the link name
+     */
+    void add_bridge(std::string_view name);
+
+    /**
+     * @brief Queue the creation of a veth pair, the first link enslaved
+     *
+     * @param name the link name
+     * @param peer the peer link name, left down
+     * @param master the index of the bridge the link joins, 0 for none
+     * @param up bring the link up
+     */
+    void add_veth(std::string_view name, std::string_view peer, int master, bool up);
+
+    /**
+     * @brief Queue renaming a link by its index, the link must be down when renamed
+     *
+     * @param ifindex the link index
+     * @param name the new name
+     * @param master the index of the bridge the link joins, 0 for none
+     * @param up bring the link up once renamed
+     */
+    void rename_link(int ifindex, std::string_view name, int master, bool up);
+
+    /**
+     * @brief Queue bringing a link up
+     *
+     * @param name the link name
+     */
+    void set_link_up(std::string_view name);
+
+    /**
+     * @brief Queue the removal of a link, a veth pair goes with either end
+     *
+     * @param name the link name
+     */
+    void delete_link(std::string_view name);
+
+    /**
+     * @brief Queue adding an ipv4 address to a link
+     *
+     * @param ifindex the link index
+     * @param addr the address
+     * @param prefix the prefix length
+     */
+    void add_address(int ifindex, const in_addr & addr, int prefix);
+
+    /**
+     * @brief Queue a link query
+     *
+     * @param name the link name
+     * @param cb called with the link index if the link exists
+     */
+    void get_link(std::string_view name, link_callback cb);
+
+    /**
+     * @brief Queue a link query by index
+     *
+     * @param ifindex the link index
+     * @param cb called with the link if it exists
+     */
+    void get_link(int ifindex, link_callback cb);
+
+    /**
+     * @brief Close the group of the messages queued since the previous submit, a group
+     * without messages is completed at once
+     *
+     * @param cb the callback
+     */
+    void submit(callback cb);
+
+    /**
+     * @brief Get the number of groups waiting for acknowledgements
+     */
+    size_t in_flight() const;
+
+    /**
+     * @brief Fail every group in flight, the acknowledgements are not waited for any more
+     *
+     * @param error the errno the callbacks are called with
+     */
+    void abort(int error);
+
+protected:
+    /**
+     * @brief Read the acknowledgements and the replies
+     */
+    void on_read() override;
+
+    /**
+     * @brief The on write callback, not subscribed
+     */
+    void on_write() override;
+
+    /**
+     * @brief Send the messages queued in this loop iteration
+     */
+    void on_loop() override;
+
+private:
+    /**
+     * @brief The messages submitted together
+     */
+    struct group
+    {
+        uint32_t first;      ///< the sequence number of the first message
+        uint32_t last;       ///< the sequence number of the last message
+        uint32_t remaining;  ///< the messages not acknowledged yet
+        int      error;      ///< the errno of the first failed message, 0 if none
+        callback cb;         ///< the callback, empty once called
+    };
+
+    /**
+     * @brief The pending link query
+     */
+    struct link_query
+    {
+        uint32_t      seq;  ///< the sequence number of the query
+        link_callback cb;   ///< the callback
+    };
+
+    /**
+     * @brief Begin a message, the body follows the header
+     *
+     * @param type the message type
+     * @param flags the flags besides NLM_F_REQUEST and NLM_F_ACK
+     * @param body the fixed size body
+     * @param size the body size
+     * @return size_t the offset of the message
+     */
+    size_t begin(uint16_t type, uint16_t flags, const void * body, size_t size);
+
+    /**
+     * @brief Append an attribute to the current message
+     */
+    void attribute(uint16_t type, const void * data, size_t size);
+
+    /**
+     * @brief Append a string attribute, null terminated
+     */
+    void attribute(uint16_t type, std::string_view value);
+
+    /**
+     * @brief Begin a nested attribute
+     *
+     * @return size_t the offset of the attribute
+     */
+    size_t begin_nested(uint16_t type);
+
+    /**
+     * @brief End a nested attribute, its length covers what follows it
+     *
+     * @param offset the offset of the attribute
+     */
+    void end_nested(size_t offset);
+
+    /**
+     * @brief End a message, its length covers what follows it
+     *
+     * @param offset the offset of the message
+     */
+    void end(size_t offset);
+
+    /**
+     * @brief Handle a message from the kernel
+     */
+    void dispatch(const nlmsghdr & msg);
+
+    /**
+     * @brief Acknowledge a message
+     *
+     * @param seq the sequence number
+     * @param error the errno, 0 on success
+     */
+    void acknowledge(uint32_t seq, int error);
+
+    /**
+     * @brief Send the messages of the submitted groups
+     */
+    void flush();
+
+    /**
+     * @brief Fail the groups with a message numbered from \b from up to \b to excluded
+     *
+     * @param from the first sequence number
+     * @param to the sequence number past the last
+     * @param error the errno
+     */
+    void fail(uint32_t from, uint32_t to, int error);
+
+    /**
+     * @brief Call the callback of a group all of whose messages are acknowledged, the
+     * completed groups at the front are dropped
+     *
+     * @param g the group
+     */
+    void complete(group & g);
+
+    event_dispatcher       &dispatcher_;         ///< the event dispatcher
+    uint32_t                seq_{ 0 };           ///< the sequence number of the last queued message
+    uint32_t                open_{ 1 };          ///< the sequence number of the first message of the open group
+    uint32_t                unsent_{ 1 };        ///< the sequence number of the first unsent message
+    uint32_t                outstanding_{ 0 };   ///< the messages sent and not acknowledged
+    std::string             pending_{ };         ///< the queued messages
+    size_t                  submitted_{ 0 };     ///< the bytes of pending_ of the submitted groups
+    std::deque<group>       groups_{ };          ///< the groups in flight in sequence order
+    std::vector<link_query> queries_{ };         ///< the pending link queries
+    std::vector<char>       recv_buffer_;        ///< the receive buffer
+    bool                    attached_{ false };  ///< subscribed to the dispatcher
+
+    static thread_local rtnetlink *current_;  ///< the client of the thread
+};
+
+inline rtnetlink * rtnetlink::current()
+{
+    return current_;
+}
+
+inline event_dispatcher & rtnetlink::dispatcher() const
+{
+    return dispatcher_;
+}
+
+inline size_t rtnetlink::in_flight() const
+{
+    return groups_.size();
+}
@@ -6,10 +6,14 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 
+#include <iostream>
 #include <system_error>
 
+#include "async_connection.h"
+
 /**
  * @brief listen on \b path
  * @param path the unix socket path
@@ -64,6 +68,13 @@ inline int listen(unsigned short port)
         throw std::system_error{ errno, std::system_category(), "cannot set socket non-blocking" };
     }
 
+    // allow other reactors to bind the same port
+    int const on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on) < 0) {
+        close(sock);
+        throw std::system_error{ errno, std::system_category(), "cannot set socket reuse port" };
+    }
+
     // bind socket
     struct sockaddr_in addr;
     addr.sin_family = AF_INET;
@@ -83,6 +94,34 @@ inline int listen(unsigned short port)
     return sock;
 }
 
+/**
+ * @brief listen on the same address as \b sock
+ * @param sock the listening socket to share
+ * @return socket file descriptor
+ */
+inline int listen(int sock)
+{
+    // get the address family and port of the socket
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    if (getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &len) < 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot get socket name" };
+    }
+
+    // tcp socket, bind another one on the same port
+    if (addr.ss_family == AF_INET) {
+        return listen(ntohs(reinterpret_cast<struct sockaddr_in *>(&addr)->sin_port));
+    }
+
+    // unix socket, share the listening socket
+    auto const dup_sock = fcntl(sock, F_DUPFD_CLOEXEC, 0);
+    if (dup_sock < 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot duplicate socket" };
+    }
+
+    return dup_sock;
+}
+
 server::server(event_dispatcher &dispatcher, const char * path)
     : io_listener{ listen(path) }
     , dispatcher_{ dispatcher }
@@ -95,27 +134,114 @@ server::server(event_dispatcher &dispatcher, unsigned short port)
 {
 }
 
+server::server(event_dispatcher &dispatcher, server &sibling)
+    : io_listener{ listen(sibling.sock()) }
+    , dispatcher_{ dispatcher }
+    , timeouts_{ sibling.timeouts_ }
+    , max_requests_{ sibling.max_requests_ }
+    , max_body_{ sibling.max_body_ }
+    , model_{ sibling.model_ }
+    , log_{ sibling.log_ }
+    , workers_{ sibling.workers_ }
+    , router_{ sibling.router_ }
+{
+    // a unix sibling duplicates the listening socket, from then on the servers watching it
+    // are woken one at a time, a lone server keeps the multishot accept
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    if (getsockname(sock(), reinterpret_cast<struct sockaddr *>(&addr), &len) == 0 && addr.ss_family != AF_INET) {
+        shared_ = true;
+        sibling.shared_ = true;
+    }
+
+    pool_.set_high_water(sibling.pool_.high_water());
+    if (sibling.stack_profile_) {
+        set_stack_profiling(sibling.stack_profile_->percentile());
+    }
+}
+
+void server::set_stack_profiling(double percentile)
+{
+    if (percentile <= 0) {
+        stack_profile_.reset();
+        return;
+    }
+
+    stack_profile_ = std::make_unique<stack_profile>(std::min(percentile, 100.0));
+}
+
+void server::record_stack_usage(const std::string &uri, size_t used)
+{
+    stack_profile_->record(uri, used);
+    if (stack_profile_->samples() % adapt_interval != 0) {
+        return;
+    }
+
+    // twice the usage at the percentile, a rare deeper request still fits with room to
+    // unwind an exception, the guard page catches what goes past the deepest one seen
+    auto const floor = stack_profile_->max() + unwind_headroom;
+    auto const size = std::clamp(std::max(stack_profile_->usage() * 2, floor), min_stack_size, stack_size);
+    if (size != pool_.stack_size()) {
+        pool_.resize(size);
+    }
+}
+
+void server::register_static_response(const char *uri,
+                                      unsigned status,
+                                      std::string_view body,
+                                      std::string_view content_type)
+{
+    http_response response;
+    response.status(status);
+    response.body().assign(body);
+    if (!content_type.empty()) {
+        response.add_header("Content-Type", content_type);
+    }
+
+    router_->add(uri, router::any_method, std::make_shared<const static_response>(response));
+}
+
 void server::on_read()
 {
     while (true) {
         // accept client
-        auto const client_sock = accept4(sock(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        auto const client_sock = dispatcher_.accept(*this);
         if (client_sock < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            auto const err = errno;
+            if (err == EAGAIN || err == EWOULDBLOCK) {
                 break;
             }
 
-            throw std::system_error{ errno, std::system_category(), "cannot accept client" };
+            // the peer reset the connection before it was taken, or a signal came in, the
+            // next connection is fine
+            if (err == ECONNABORTED || err == EINTR || err == EPROTO) {
+                std::cerr << "cannot accept client: " << std::system_category().message(err) << std::endl;
+                continue;
+            }
+
+            // out of file descriptors or memory, the connections wait in the backlog while
+            // the listener pauses, instead of waking the loop again and again
+            std::cerr << "cannot accept client: " << std::system_category().message(err)
+                      << ", pausing the listener for " << accept_backoff.count() << " ms" << std::endl;
+            dispatcher_.unsubscribe(static_cast<io_listener &>(*this));
+            dispatcher_.arm(*this, accept_backoff);
+            break;
         }
 
         // create client object
-        auto const conn = connection::allocate(*this, client_sock, 256 * 1024);
+        connection_base * const conn = model_ == connection_model::stackless
+            ? static_cast<connection_base *>(async_connection::allocate(*this, client_sock))
+            : connection::allocate(*this, client_sock);
         active_list_.push_back(*conn);
+        stats_.accepted.fetch_add(1, std::memory_order_relaxed);
 
-        // subscribe client
-        if (!dispatcher_.subscribe(*conn, event_dispatcher::readable | event_dispatcher::writable)) {
-            connection::deallocate(conn);
-            throw std::system_error{ EINVAL, std::system_category(), "cannot subscribe client" };
+        // subscribe client, a client that cannot be watched is dropped and the next one taken
+        if (!dispatcher_.subscribe(*conn, conn->events())) {
+            std::cerr << "cannot subscribe client" << std::endl;
+            active_list_.erase(active_list_.iterator_to(*conn));
+            conn->destroy();
+            stats_.closed.fetch_add(1, std::memory_order_relaxed);
+            continue;
         }
 
         // resume client
@@ -123,18 +249,52 @@ void server::on_read()
     }
 }
 
+void server::resume_synced()
+{
+    syncing_ = false;
+    for (auto const conn : resuming_) {
+        conn->resume();
+    }
+
+    resuming_.clear();
+}
+
 void server::on_write()
 {
 }
 
+void server::on_timer()
+{
+    // the backlog is accepted once subscribed again, the failure pauses the listener anew
+    if (!dispatcher_.subscribe(*this, listen_events())) {
+        std::cerr << "cannot subscribe the listener, retrying in " << accept_backoff.count() << " ms" << std::endl;
+        dispatcher_.arm(*this, accept_backoff);
+    }
+}
+
 void server::on_loop()
 {
+    // one sync covers the responses of every request handled in this iteration, a
+    // failed sync leaves the records unsynced and the resumed connections close
+    if (!parked_.empty() && !syncing_) {
+        resuming_.swap(parked_);
+
+        // on a worker the loop goes on, the connections parked meanwhile wait for the
+        // next sync, which covers all of them
+        syncing_ = workers_ && workers_->submit(dispatcher_, [log = log_] { log->sync(); }, [this] { resume_synced(); });
+        if (!syncing_) {
+            log_->sync();
+            resume_synced();
+        }
+    }
+
     // destroy closing connections
     while (!closing_list_.empty()) {
         auto & conn = closing_list_.front();
         dispatcher_.unsubscribe(conn);
-        closing_list_.pop_front_and_dispose([](connection * conn) {
-            connection::deallocate(conn);
+        closing_list_.pop_front_and_dispose([](connection_base * conn) {
+            conn->destroy();
         });
+        stats_.closed.fetch_add(1, std::memory_order_relaxed);
     }
 }
@@ -1,11 +1,23 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include "commit_log.h"
 #include "event_dispatcher.h"
 #include "connection.h"
+#include "connection_pool.h"
 #include "http_request.h"
 #include "http_response.h"
+#include "router.h"
+#include "stack_profile.h"
+#include "worker_pool.h"
 
 /**
  * @brief The server
@@ -13,34 +25,57 @@
 class server
     : public io_listener
     , public loop_listener
+    , public timer_listener
 {
 public:
-    class http_request_handler
+    /**
+     * @brief The connection execution model
+     */
+    enum class connection_model
     {
-    public:
-        http_request_handler(bool (*handler)(void *, const http_request &, http_response *),
-                             void * user);
+        stackful,   ///< a boost::coroutines2 coroutine on a pooled stack per connection
+        stackless   ///< c++20 coroutines with pooled frames per connection
+    };
 
-        bool operator()(void * user, const http_request & request, http_response * response) const;
+    /**
+     * @brief The connection counters, readable from any thread
+     */
+    struct statistics
+    {
+        std::atomic<uint64_t> accepted{ 0 };  ///< the number of accepted connections
+        std::atomic<uint64_t> closed{ 0 };    ///< the number of closed connections
+    };
 
-    private:
-        bool (*handler_)(void *, const http_request &, http_response *);
-        void * user_;
+    /**
+     * @brief The connection timeouts, zero disables a timeout
+     */
+    struct timeouts
+    {
+        std::chrono::milliseconds read_idle{ 30000 };   ///< the longest wait for data from the peer
+        std::chrono::milliseconds header{ 10000 };      ///< the longest time to receive the request header
+        std::chrono::milliseconds request{ 60000 };     ///< the longest time to handle a request
+        std::chrono::milliseconds keep_alive{ 60000 };  ///< the longest idle time between requests
     };
 
 private:
     using connection_list = boost::intrusive::list
-        < connection
+        < connection_base
         , boost::intrusive::member_hook
-            < connection
-            , connection::list_hook
-            , &connection::list_hook_
+            < connection_base
+            , connection_base::list_hook
+            , &connection_base::list_hook_
             >
         >;
 
     using pull_type = boost::coroutines2::coroutine<void>::pull_type;
 
-    using uri_handler_map = std::unordered_map<std::string, http_request_handler>;
+    static constexpr size_t stack_size = 256 * 1024;     ///< the largest connection stack size
+    static constexpr size_t min_stack_size = 16 * 1024;  ///< the smallest adapted connection stack size
+    static constexpr size_t unwind_headroom = 16 * 1024; ///< the stack kept past the deepest usage, an exception thrown there unwinds in it
+    static constexpr size_t pool_size = 128;             ///< the default connection pool high-water mark
+    static constexpr uint64_t adapt_interval = 256;      ///< the samples between stack size adaptations
+    static constexpr size_t default_max_body = 512 * 1024;  ///< the default largest request body
+    static constexpr std::chrono::milliseconds accept_backoff{ 100 };  ///< the pause of the listener after an accept failure
 
 public:
     /**
@@ -59,6 +94,21 @@ public:
      */
     server(event_dispatcher &dispatcher, unsigned short port);
 
+    /**
+     * @brief Construct a new server object listening on the same address as \b sibling
+     *
+     * A tcp sibling gets its own SO_REUSEPORT socket bound to the same port, a unix
+     * sibling shares the listening socket through a duplicated file descriptor. The
+     * routes of \b sibling are shared, its timeouts, request limit, body limit, pool
+     * high-water mark, stack profiling percentile, connection model and commit log are
+     * copied. Both are marked as sharing their socket if it is duplicated, before either
+     * subscribes.
+     *
+     * @param dispatcher the event dispatcher
+     * @param sibling the server to share the address with
+     */
+    server(event_dispatcher &dispatcher, server &sibling);
+
     /**
      * @brief Destroy the server object
      */
@@ -79,31 +129,219 @@ public:
      */
     event_dispatcher &dispatcher() const;
 
+    /**
+     * @brief get the connection counters
+     */
+    const statistics &stats() const;
+
+    /**
+     * @brief get the connection timeouts
+     */
+    const timeouts &get_timeouts() const;
+
+    /**
+     * @brief set the connection timeouts, applies to connections accepted afterwards
+     *
+     * @param t the timeouts
+     */
+    void set_timeouts(const timeouts &t);
+
+    /**
+     * @brief get the number of requests served on a connection before it is closed, 0 if unlimited
+     */
+    unsigned max_requests() const;
+
+    /**
+     * @brief set the number of requests served on a connection before it is closed, applies to
+     * connections accepted afterwards
+     *
+     * @param n the number of requests, 0 if unlimited
+     */
+    void set_max_requests(unsigned n);
+
+    /**
+     * @brief get the largest request body of the routes without a limit of their own
+     */
+    size_t max_body_size() const;
+
+    /**
+     * @brief set the largest request body of the routes without a limit of their own, a
+     * larger body is rejected with 413 before it is received
+     *
+     * @param n the size in bytes, 0 for unlimited
+     */
+    void set_max_body_size(size_t n);
+
+    /**
+     * @brief get the events the listening socket is subscribed with, a shared socket wakes
+     * one reactor per connection, the connections of an own one are accepted ahead
+     */
+    int listen_events() const;
+
+    /**
+     * @brief get the connection model
+     */
+    connection_model model() const;
+
+    /**
+     * @brief set the connection model, applies to connections accepted afterwards
+     *
+     * @param m the connection model
+     */
+    void set_model(connection_model m);
+
+    /**
+     * @brief get the connection pool
+     */
+    connection_pool &pool();
+
+    /**
+     * @brief get the connection pool
+     */
+    const connection_pool &pool() const;
+
+    /**
+     * @brief get the stack usage profile
+     *
+     * @return const stack_profile* the profile, nullptr if stack profiling is disabled
+     */
+    const stack_profile *stack_usage() const;
+
+    /**
+     * @brief enable stack profiling, the stacks of new connections are filled with a canary
+     * pattern and measured on close, the stack size follows the measured usage
+     *
+     * @param percentile the percentile of the measured usage the stack is sized for, 0 to disable
+     */
+    void set_stack_profiling(double percentile);
+
+    /**
+     * @brief record the stack usage of a request, adapts the stack size every
+     * adapt_interval samples to twice the usage at the percentile, never below the
+     * deepest usage recorded plus unwind_headroom
+     *
+     * @param uri the uri of the request, empty for a connection that served none
+     * @param used the used bytes
+     */
+    void record_stack_usage(const std::string &uri, size_t used);
+
+    /**
+     * @brief get the log the responses wait for
+     *
+     * @return commit_log* the log, nullptr if the responses are sent at once
+     */
+    commit_log *get_commit_log() const;
+
+    /**
+     * @brief set the log the responses wait for, a response is sent once the records
+     * appended by its handler are synced, shared with the siblings created afterwards
+     *
+     * @param log the log, nullptr to send the responses at once
+     */
+    void set_commit_log(commit_log *log);
+
+    /**
+     * @brief get the worker pool the log syncs run on
+     *
+     * @return worker_pool* the pool, nullptr if the syncs run on the loop thread
+     */
+    worker_pool *get_workers() const;
+
+    /**
+     * @brief set the worker pool the log syncs run on, the loop goes on while a sync is under
+     * way and the connections parked meanwhile wait for the next one, shared with the
+     * siblings created afterwards
+     *
+     * @param workers the pool, nullptr to sync on the loop thread
+     */
+    void set_workers(worker_pool *workers);
+
+    /**
+     * @brief Park a connection until the next log sync, done at the end of the loop iteration
+     *
+     * @param conn the connection object
+     */
+    void park(connection_base &conn);
+
+    /**
+     * @brief Stop waiting for the log sync, the connection timed out
+     *
+     * @param conn the parked connection object
+     */
+    void unpark(connection_base &conn);
+
     /**
      * @brief Move the connection to the closing list
      *
      * @param conn the connection object
      */
-    void move_to_closing(connection &conn);
+    void move_to_closing(connection_base &conn);
 
     /**
-     * @brief Add a uri handler
+     * @brief Add a uri handler, the routes are shared with the sibling servers and are
+     * registered before the servers start
      *
      * @param uri the uri
      * @param handler the handler
-     * @param user the user data
+     * @param user the user data passed to the handler
      */
     void register_uri_handler(const char *uri,
                               bool (*handler)(void *, const http_request &, http_response *),
                               void *user);
 
     /**
-     * @brief Find the uri handler
+     * @brief Add a uri handler accepting every method, the handler is called directly,
+     * captures included
+     *
+     * @param uri the uri
+     * @param handler the handler, callable as bool(const http_request &, http_response *)
+     */
+    template <typename Handler>
+    void register_uri_handler(const char *uri, Handler &&handler);
+
+    /**
+     * @brief Add a uri handler accepting one method, other methods are answered with 405
+     *
+     * @param uri the uri
+     * @param method the method
+     * @param handler the handler, callable as bool(const http_request &, http_response *)
+     * @param max_body the largest request body, 0 for the server default
+     */
+    template <typename Handler>
+    void register_uri_handler(const char *uri, llhttp_method_t method, Handler &&handler, size_t max_body = 0);
+
+    /**
+     * @brief Add a uri handler streaming the request body, the body is passed to a consumer
+     * as it is parsed and is not kept
+     *
+     * @param uri the uri
+     * @param method the method
+     * @param factory the consumer factory, see router::add_consumer
+     * @param max_body the largest request body, 0 for the server default
+     */
+    template <typename Factory>
+    void register_body_consumer(const char *uri, llhttp_method_t method, Factory &&factory, size_t max_body = 0);
+
+    /**
+     * @brief Add a constant response, serialized once and sent without invoking a handler
+     *
+     * @param uri the uri
+     * @param status the response status
+     * @param body the response body
+     * @param content_type the Content-Type header value, empty if none
+     */
+    void register_static_response(const char *uri,
+                                  unsigned status,
+                                  std::string_view body,
+                                  std::string_view content_type = { });
+
+    /**
+     * @brief Find the route of a uri
      *
      * @param uri The uri string
-     * @return const http_request_handler* The uri handler if found, otherwise nullptr
+     * @return const router::route* The route if found, otherwise nullptr
      */
-    const http_request_handler * find_uri_handler(const std::string &uri) const;
+    const router::route * find_route(std::string_view uri) const;
 
 protected:
     /**
@@ -121,6 +359,17 @@ protected:
      */
     void on_loop() override;
 
+    /**
+     * @brief The on timer callback, subscribes the listening socket again after an accept
+     * failure
+     */
+    void on_timer() override;
+
+    /**
+     * @brief Resume the connections the last log sync was for
+     */
+    void resume_synced();
+
     /**
      * @brief Get the socket file descriptor
      *
@@ -129,33 +378,129 @@ protected:
     int sock() const;
 
 private:
-    pull_type        *sink_{ nullptr };     ///< the push type
-    connection_list   active_list_{ };      ///< the active connection list
-    connection_list   closing_list_{ };     ///< the closing connection list
-    event_dispatcher &dispatcher_;          ///< the event dispatcher
-    uri_handler_map   uri_handler_map_{ };  ///< the uri handler map
+    pull_type        *sink_{ nullptr };       ///< the push type
+    connection_list   active_list_{ };        ///< the active connection list
+    connection_list   closing_list_{ };       ///< the closing connection list
+    event_dispatcher &dispatcher_;            ///< the event dispatcher
+    statistics        stats_{ };              ///< the connection counters
+    timeouts          timeouts_{ };           ///< the connection timeouts
+    unsigned          max_requests_{ 1000 };  ///< the requests served on a connection, 0 if unlimited
+    size_t            max_body_{ default_max_body };  ///< the default largest request body, 0 for unlimited
+    connection_model  model_{ connection_model::stackful };  ///< the connection model
+    bool              shared_{ false };       ///< the listening socket is shared with the siblings
+    connection_pool   pool_{ stack_size, sizeof(connection), pool_size };  ///< the connection pool
+    std::unique_ptr<stack_profile> stack_profile_{ };  ///< the stack usage profile, nullptr if disabled
+    commit_log                    *log_{ nullptr };    ///< the log the responses wait for, nullptr if none
+    std::vector<connection_base *> parked_{ };         ///< the connections waiting for the log sync
+    std::vector<connection_base *> resuming_{ };       ///< the parked connections being resumed
+    worker_pool                   *workers_{ nullptr };  ///< the pool the log syncs run on, nullptr if none
+    bool                           syncing_{ false };    ///< a sync runs on a worker for the connections in resuming_
+    std::shared_ptr<router>        router_{ std::make_shared<router>() };  ///< the routes, shared with the siblings
 };
 
-inline server::http_request_handler::http_request_handler(
-    bool (*handler)(void *, const http_request &, http_response *), void * user)
-    : handler_{ handler }
-    , user_{ user }
+inline event_dispatcher & server::dispatcher() const
+{
+    return dispatcher_;
+}
+
+inline const server::statistics & server::stats() const
 {
+    return stats_;
 }
 
-inline bool server::http_request_handler::operator()(void *user,
-                                                     const http_request &request,
-                                                     http_response *response) const
+inline const server::timeouts & server::get_timeouts() const
 {
-    return handler_(user, request, response);
+    return timeouts_;
 }
 
-inline event_dispatcher & server::dispatcher() const
+inline void server::set_timeouts(const timeouts & t)
 {
-    return dispatcher_;
+    timeouts_ = t;
+}
+
+inline unsigned server::max_requests() const
+{
+    return max_requests_;
+}
+
+inline void server::set_max_requests(unsigned n)
+{
+    max_requests_ = n;
+}
+
+inline size_t server::max_body_size() const
+{
+    return max_body_;
+}
+
+inline void server::set_max_body_size(size_t n)
+{
+    max_body_ = n;
 }
 
-inline void server::move_to_closing(connection & conn)
+inline int server::listen_events() const
+{
+    return event_dispatcher::readable | event_dispatcher::listening | (shared_ ? event_dispatcher::exclusive : 0);
+}
+
+inline server::connection_model server::model() const
+{
+    return model_;
+}
+
+inline void server::set_model(connection_model m)
+{
+    model_ = m;
+}
+
+inline connection_pool & server::pool()
+{
+    return pool_;
+}
+
+inline const connection_pool & server::pool() const
+{
+    return pool_;
+}
+
+inline const stack_profile * server::stack_usage() const
+{
+    return stack_profile_.get();
+}
+
+inline commit_log * server::get_commit_log() const
+{
+    return log_;
+}
+
+inline void server::set_commit_log(commit_log *log)
+{
+    log_ = log;
+}
+
+inline worker_pool * server::get_workers() const
+{
+    return workers_;
+}
+
+inline void server::set_workers(worker_pool *workers)
+{
+    workers_ = workers;
+}
+
+inline void server::park(connection_base & conn)
+{
+    parked_.push_back(&conn);
+}
+
+inline void server::unpark(connection_base & conn)
+{
+    // a sync under way on a worker resumes the connections left in resuming_
+    std::erase(parked_, &conn);
+    std::erase(resuming_, &conn);
+}
+
+inline void server::move_to_closing(connection_base & conn)
 {
     // move the connection to the closing list
     closing_list_.splice(closing_list_.begin(), active_list_, active_list_.iterator_to(conn));
@@ -165,13 +510,32 @@ inline void server::register_uri_handler(const char *uri,
                                          bool (*handler)(void *, const http_request &, http_response *),
                                          void *user)
 {
-    uri_handler_map_.emplace(uri, http_request_handler{ handler, user });
+    register_uri_handler(uri, [handler, user](const http_request &request, http_response *response) {
+        return handler(user, request, response);
+    });
+}
+
+template <typename Handler>
+inline void server::register_uri_handler(const char *uri, Handler &&handler)
+{
+    router_->add(uri, router::any_method, std::forward<Handler>(handler));
+}
+
+template <typename Handler>
+inline void server::register_uri_handler(const char *uri, llhttp_method_t method, Handler &&handler, size_t max_body)
+{
+    router_->add(uri, router::method_mask(method), std::forward<Handler>(handler), max_body);
+}
+
+template <typename Factory>
+inline void server::register_body_consumer(const char *uri, llhttp_method_t method, Factory &&factory, size_t max_body)
+{
+    router_->add_consumer(uri, router::method_mask(method), std::forward<Factory>(factory), max_body);
 }
 
-inline const server::http_request_handler * server::find_uri_handler(const std::string &uri) const
+inline const router::route * server::find_route(std::string_view uri) const
 {
-    auto const it = uri_handler_map_.find(uri);
-    return it != uri_handler_map_.end() ? &it->second : nullptr;
+    return router_->find(uri);
 }
 
 inline int server::sock() const
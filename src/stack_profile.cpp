@@ -0,0 +1,60 @@
+#include "stack_profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+void stack_profile::fill(void * stack, size_t size)
+{
+    auto const words = static_cast<uint64_t *>(stack);
+    std::fill(words, words + size / sizeof(uint64_t), canary);
+}
+
+size_t stack_profile::measure(const void * stack, size_t size)
+{
+    // the stack grows down, the untouched words are at the bottom
+    auto const words = static_cast<const uint64_t *>(stack);
+    auto const count = size / sizeof(uint64_t);
+    auto const it = std::find_if(words, words + count, [](uint64_t w) { return w != canary; });
+    return (count - static_cast<size_t>(it - words)) * sizeof(uint64_t);
+}
+
+void stack_profile::record(const std::string & uri, size_t used)
+{
+    // the older samples weigh half as much at every interval
+    if (samples_ != 0 && samples_ % decay_interval == 0) {
+        weight_ = 0;
+        for (auto & count : histogram_) {
+            count /= 2;
+            weight_ += count;
+        }
+    }
+
+    auto const bucket = std::min(used / bucket_size, bucket_count - 1);
+    ++histogram_[bucket];
+    ++weight_;
+    ++samples_;
+    max_ = std::max(max_, used);
+
+    auto & usage = uris_[uri];
+    ++usage.samples;
+    usage.max = std::max(usage.max, used);
+}
+
+size_t stack_profile::usage() const
+{
+    if (weight_ == 0) {
+        return 0;
+    }
+
+    // the smallest bucket covering the percentile of the samples
+    auto const wanted = static_cast<uint64_t>(std::ceil(static_cast<double>(weight_) * percentile_ / 100));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += histogram_[i];
+        if (seen >= wanted) {
+            return (i + 1) * bucket_size;
+        }
+    }
+
+    return bucket_count * bucket_size;
+}
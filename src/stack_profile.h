@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief The coroutine stack usage profile
+ *
+ * Collects the stack depth reached by each request, measured from the canary pattern
+ * left untouched at the bottom of its connection stack, into a histogram of 1 KB buckets
+ * and a per uri summary. The histogram is halved every decay_interval samples so the
+ * percentile follows the recent requests, the deepest usage is kept for good.
+ */
+class stack_profile
+{
+public:
+    /**
+     * @brief The stack usage of the requests to a uri
+     */
+    struct uri_usage
+    {
+        uint64_t samples{ 0 };  ///< the number of requests
+        size_t   max{ 0 };      ///< the deepest stack usage in bytes
+    };
+
+    using uri_usage_map = std::unordered_map<std::string, uri_usage>;
+
+    static constexpr uint64_t canary = 0xdeadbeefcafebabe;  ///< the pattern filling unused stack
+    static constexpr uint64_t decay_interval = 64 * 1024;    ///< the samples between two halvings of the histogram
+
+    /**
+     * @brief Construct a new stack profile object
+     *
+     * @param percentile the percentile of the observed usage the stack is sized for, in (0, 100]
+     */
+    explicit stack_profile(double percentile);
+
+    /**
+     * @brief Get the percentile the stack is sized for
+     */
+    double percentile() const;
+
+    /**
+     * @brief Get the number of recorded samples
+     */
+    uint64_t samples() const;
+
+    /**
+     * @brief Get the per uri stack usage
+     */
+    const uri_usage_map & uris() const;
+
+    /**
+     * @brief Fill a stack with the canary pattern
+     *
+     * @param stack the bottom of the stack
+     * @param size the stack size
+     */
+    static void fill(void * stack, size_t size);
+
+    /**
+     * @brief Measure the stack usage, the deepest word overwritten since fill
+     *
+     * @param stack the bottom of the stack
+     * @param size the stack size
+     * @return size_t the used bytes
+     */
+    static size_t measure(const void * stack, size_t size);
+
+    /**
+     * @brief Record the stack usage of a request
+     *
+     * @param uri the uri of the request, empty for a connection that served none
+     * @param used the used bytes
+     */
+    void record(const std::string & uri, size_t used);
+
+    /**
+     * @brief Get the stack usage at the percentile of the recent samples
+     *
+     * @return size_t the used bytes, rounded up to the bucket size, 0 if nothing recorded
+     */
+    size_t usage() const;
+
+    /**
+     * @brief Get the deepest stack usage recorded
+     */
+    size_t max() const;
+
+private:
+    static constexpr size_t bucket_size = 1024;
+    static constexpr size_t bucket_count = 1024;  ///< the last bucket holds anything deeper
+
+    double        percentile_{ 0 };               ///< the percentile the stack is sized for
+    uint64_t      samples_{ 0 };                  ///< the number of samples
+    uint64_t      weight_{ 0 };                   ///< the samples left in the histogram
+    size_t        max_{ 0 };                      ///< the deepest usage
+    uint64_t      histogram_[bucket_count]{ };    ///< the samples per 1 KB of usage, halved as they age
+    uri_usage_map uris_{ };                       ///< the per uri usage
+};
+
+inline stack_profile::stack_profile(double percentile)
+    : percentile_{ percentile }
+{
+}
+
+inline double stack_profile::percentile() const
+{
+    return percentile_;
+}
+
+inline uint64_t stack_profile::samples() const
+{
+    return samples_;
+}
+
+inline const stack_profile::uri_usage_map & stack_profile::uris() const
+{
+    return uris_;
+}
+
+inline size_t stack_profile::max() const
+{
+    return max_;
+}
@@ -0,0 +1,598 @@
+#include "state_log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+constexpr uint32_t put_network_record = 1;      ///< a created or updated network
+constexpr uint32_t remove_network_record = 2;   ///< a removed network
+constexpr uint32_t put_endpoint_record = 3;     ///< a created or updated endpoint
+constexpr uint32_t remove_endpoint_record = 4;  ///< a removed endpoint
+
+constexpr char snapshot_magic[8] = { 'T', 'N', 'S', 'T', 'A', 'T', 'E', '1' };
+
+/**
+ * @brief The header of a log record, the payload follows
+ */
+struct record_header
+{
+    uint64_t sequence{ 0 };  ///< the record sequence number, from 1
+    uint32_t type{ 0 };      ///< the record type
+    uint32_t size{ 0 };      ///< the payload size
+    uint32_t checksum{ 0 };  ///< the crc32 of the fields above and the payload
+    uint32_t reserved{ 0 };
+};
+
+/**
+ * @brief The header of the snapshot, the network records then the endpoint records follow
+ */
+struct snapshot_header
+{
+    char     magic[8]{ };     ///< snapshot_magic
+    uint64_t sequence{ 0 };   ///< the sequence number of the last log record covered
+    uint64_t networks{ 0 };   ///< the number of network records
+    uint64_t endpoints{ 0 };  ///< the number of endpoint records
+};
+
+/**
+ * @brief A network in the log and the snapshot
+ */
+struct network_record
+{
+    object_id        id{ };
+    fixed_string<64> ipv4_pool{ };
+    fixed_string<64> ipv4_gateway{ };
+    fixed_string<64> ipv6_pool{ };
+    fixed_string<64> ipv6_gateway{ };
+};
+
+/**
+ * @brief An endpoint in the log and the snapshot
+ */
+struct endpoint_record
+{
+    object_id         id{ };
+    object_id         network{ };
+    fixed_string<64>  address{ };
+    fixed_string<64>  address_ipv6{ };
+    fixed_string<32>  mac_address{ };
+    fixed_string<256> sandbox_key{ };
+    uint64_t          joined{ 0 };
+};
+
+/**
+ * @brief A removed network or endpoint in the log
+ */
+struct remove_record
+{
+    object_id id{ };
+};
+
+// the records follow each other without padding
+static_assert(sizeof(record_header) % 8 == 0 && sizeof(snapshot_header) % 8 == 0);
+static_assert(sizeof(network_record) % 8 == 0 && sizeof(endpoint_record) % 8 == 0 && sizeof(remove_record) % 8 == 0);
+
+constexpr std::array<uint32_t, 256> crc_table = [] {
+    std::array<uint32_t, 256> table{ };
+    for (uint32_t i = 0; i < 256; ++i) {
+        auto c = i;
+        for (auto k = 0; k < 8; ++k) {
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+
+        table[i] = c;
+    }
+
+    return table;
+}();
+
+uint32_t crc32(uint32_t crc, const void * data, size_t size)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief Get the checksum of a record, the header fields before the checksum and the payload
+ */
+uint32_t checksum(const record_header & header, const void * payload)
+{
+    auto const crc = crc32(0, &header, offsetof(record_header, checksum));
+    return crc32(crc, payload, header.size);
+}
+
+/**
+ * @brief Get the payload size of a record type
+ *
+ * @return size_t the size, 0 for an unknown type
+ */
+size_t payload_size(uint32_t type)
+{
+    switch (type) {
+    case put_network_record:     return sizeof(network_record);
+    case put_endpoint_record:    return sizeof(endpoint_record);
+    case remove_network_record:
+    case remove_endpoint_record: return sizeof(remove_record);
+    default:                     return 0;
+    }
+}
+
+template <size_t N>
+void copy(fixed_string<N> & to, const fixed_string<N> & from)
+{
+    to.assign(from.view());
+}
+
+network_record to_record(const network_entry & network)
+{
+    network_record r;
+    r.id = network.id;
+    copy(r.ipv4_pool, network.ipv4_pool);
+    copy(r.ipv4_gateway, network.ipv4_gateway);
+    copy(r.ipv6_pool, network.ipv6_pool);
+    copy(r.ipv6_gateway, network.ipv6_gateway);
+    return r;
+}
+
+endpoint_record to_record(const endpoint_entry & endpoint, const object_id & network)
+{
+    endpoint_record r;
+    r.id = endpoint.id;
+    r.network = network;
+    copy(r.address, endpoint.address);
+    copy(r.address_ipv6, endpoint.address_ipv6);
+    copy(r.mac_address, endpoint.mac_address);
+    copy(r.sandbox_key, endpoint.sandbox_key);
+    r.joined = endpoint.joined;
+    return r;
+}
+
+/**
+ * @brief Create or update a network from its record
+ */
+void put(state_store & store, const network_record & r)
+{
+    auto handle = store.find_network(r.id);
+    if (handle == state_store::npos) {
+        handle = store.add_network(r.id);
+    }
+
+    auto & network = store.network(handle);
+    copy(network.ipv4_pool, r.ipv4_pool);
+    copy(network.ipv4_gateway, r.ipv4_gateway);
+    copy(network.ipv6_pool, r.ipv6_pool);
+    copy(network.ipv6_gateway, r.ipv6_gateway);
+}
+
+/**
+ * @brief Create or update an endpoint from its record
+ *
+ * @return true if its network exists
+ */
+bool put(state_store & store, const endpoint_record & r)
+{
+    auto handle = store.find_endpoint(r.id);
+    if (handle == state_store::npos) {
+        auto const network = store.find_network(r.network);
+        if (network == state_store::npos) {
+            return false;
+        }
+
+        handle = store.add_endpoint(network, r.id);
+    }
+
+    auto & endpoint = store.endpoint(handle);
+    copy(endpoint.address, r.address);
+    copy(endpoint.address_ipv6, r.address_ipv6);
+    copy(endpoint.mac_address, r.mac_address);
+    copy(endpoint.sandbox_key, r.sandbox_key);
+    endpoint.joined = r.joined != 0;
+    return true;
+}
+
+/**
+ * @brief Write all of \b data
+ *
+ * @return true if written
+ */
+bool write_all(int fd, const char * data, size_t size)
+{
+    while (size > 0) {
+        auto const n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Flush a directory so the entries created or renamed in it persist
+ */
+bool sync_dir(const std::string & dir)
+{
+    auto const fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    auto const ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/**
+ * @brief A read-only private mapping of a whole file
+ */
+class file_map
+{
+public:
+    explicit file_map(int fd)
+    {
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            throw std::system_error{ errno, std::system_category(), "cannot stat state file" };
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            return;
+        }
+
+        auto const p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            throw std::system_error{ errno, std::system_category(), "cannot map state file" };
+        }
+
+        data_ = static_cast<const char *>(p);
+    }
+
+    ~file_map()
+    {
+        if (data_) {
+            munmap(const_cast<char *>(data_), size_);
+        }
+    }
+
+    file_map(const file_map &) = delete;
+
+    void operator=(const file_map &) = delete;
+
+    const char * data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+private:
+    const char * data_{ nullptr };  ///< the mapping, nullptr for an empty file
+    size_t       size_{ 0 };        ///< the file size
+};
+
+}
+
+state_log::state_log(const std::string & dir, state_store & store, std::mutex & store_mutex)
+    : dir_{ dir }
+    , snapshot_path_{ dir + "/state.snapshot" }
+    , store_{ store }
+    , store_mutex_{ store_mutex }
+{
+    if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) {
+        throw std::system_error{ errno, std::system_category(), "cannot create state directory" };
+    }
+
+    auto const path = dir + "/state.log";
+    log_fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (log_fd_ < 0) {
+        throw std::system_error{ errno, std::system_category(), "cannot open state log" };
+    }
+
+    sync_dir(dir_);
+}
+
+state_log::~state_log()
+{
+    if (log_fd_ >= 0) {
+        close(log_fd_);
+    }
+}
+
+state_log::load_stats state_log::load()
+{
+    load_stats stats;
+    auto const covered = load_snapshot(stats);
+    auto const last = replay(covered, stats);
+    appended_.store(last, std::memory_order_release);
+    synced_.store(last, std::memory_order_release);
+
+    stats.networks = store_.network_count();
+    stats.endpoints = store_.endpoint_count();
+    return stats;
+}
+
+uint64_t state_log::load_snapshot(load_stats & stats)
+{
+    auto const fd = open(snapshot_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+
+        throw std::system_error{ errno, std::system_category(), "cannot open state snapshot" };
+    }
+
+    file_map map{ fd };
+    close(fd);
+
+    // the snapshot is complete or missing, it replaces the old one by rename once flushed
+    snapshot_header header;
+    if (map.size() < sizeof header) {
+        throw std::runtime_error{ "state snapshot is corrupt" };
+    }
+
+    memcpy(&header, map.data(), sizeof header);
+    auto const expected = sizeof header + header.networks * sizeof(network_record) + header.endpoints * sizeof(endpoint_record);
+    if (memcmp(header.magic, snapshot_magic, sizeof snapshot_magic) != 0 || map.size() != expected) {
+        throw std::runtime_error{ "state snapshot is corrupt" };
+    }
+
+    // the records are inserted from the mapping as they lie, the networks first
+    auto const networks = reinterpret_cast<const network_record *>(map.data() + sizeof header);
+    for (uint64_t i = 0; i < header.networks; ++i) {
+        put(store_, networks[i]);
+    }
+
+    auto const endpoints = reinterpret_cast<const endpoint_record *>(networks + header.networks);
+    for (uint64_t i = 0; i < header.endpoints; ++i) {
+        if (!put(store_, endpoints[i])) {
+            throw std::runtime_error{ "state snapshot is corrupt" };
+        }
+    }
+
+    stats.snapshot = map.size();
+    return header.sequence;
+}
+
+uint64_t state_log::replay(uint64_t covered, load_stats & stats)
+{
+    file_map map{ log_fd_ };
+
+    auto last = covered;
+    size_t offset = 0;
+    while (map.size() - offset >= sizeof(record_header)) {
+        record_header header;
+        memcpy(&header, map.data() + offset, sizeof header);
+
+        // a torn or corrupt record ends the log
+        auto const payload = map.data() + offset + sizeof header;
+        if (header.size == 0 || header.size != payload_size(header.type)
+            || map.size() - offset - sizeof header < header.size
+            || header.checksum != checksum(header, payload)) {
+            break;
+        }
+
+        offset += sizeof header + header.size;
+
+        // the snapshot covers the records left behind by a compaction cut short
+        if (header.sequence <= covered) {
+            continue;
+        }
+
+        switch (header.type) {
+        case put_network_record:
+            put(store_, *reinterpret_cast<const network_record *>(payload));
+            break;
+        case put_endpoint_record:
+            put(store_, *reinterpret_cast<const endpoint_record *>(payload));
+            break;
+        case remove_network_record: {
+            auto const handle = store_.find_network(reinterpret_cast<const remove_record *>(payload)->id);
+            if (handle != state_store::npos) {
+                store_.remove_network(handle);
+            }
+            break;
+        }
+        case remove_endpoint_record: {
+            auto const handle = store_.find_endpoint(reinterpret_cast<const remove_record *>(payload)->id);
+            if (handle != state_store::npos) {
+                store_.remove_endpoint(handle);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        last = header.sequence;
+        ++stats.replayed;
+    }
+
+    // drop the torn tail, the next records are appended after the last good one
+    if (offset < map.size()) {
+        stats.discarded = map.size() - offset;
+        if (ftruncate(log_fd_, static_cast<off_t>(offset)) < 0 || fdatasync(log_fd_) < 0) {
+            throw std::system_error{ errno, std::system_category(), "cannot truncate state log" };
+        }
+    }
+
+    log_size_ = offset;
+    return last;
+}
+
+uint64_t state_log::put_network(const network_entry & network)
+{
+    auto const r = to_record(network);
+    return append(put_network_record, &r, sizeof r);
+}
+
+uint64_t state_log::remove_network(const object_id & id)
+{
+    remove_record const r{ id };
+    return append(remove_network_record, &r, sizeof r);
+}
+
+uint64_t state_log::put_endpoint(const endpoint_entry & endpoint)
+{
+    auto const r = to_record(endpoint, store_.network(endpoint.network).id);
+    return append(put_endpoint_record, &r, sizeof r);
+}
+
+uint64_t state_log::remove_endpoint(const object_id & id)
+{
+    remove_record const r{ id };
+    return append(remove_endpoint_record, &r, sizeof r);
+}
+
+uint64_t state_log::append(uint32_t type, const void * payload, size_t size)
+{
+    std::lock_guard<std::mutex> lock{ append_mutex_ };
+    record_header header;
+    header.sequence = appended_.load(std::memory_order_relaxed) + 1;
+    header.type = type;
+    header.size = static_cast<uint32_t>(size);
+    header.checksum = checksum(header, payload);
+    pending_.append(reinterpret_cast<const char *>(&header), sizeof header);
+    pending_.append(static_cast<const char *>(payload), size);
+    appended_.store(header.sequence, std::memory_order_release);
+    return header.sequence;
+}
+
+bool state_log::sync()
+{
+    std::lock_guard<std::mutex> lock{ sync_mutex_ };
+    if (!flush()) {
+        return false;
+    }
+
+    // a failed compaction keeps the log, the records stay synced
+    if (log_size_ >= compact_size_) {
+        compact();
+    }
+
+    return true;
+}
+
+bool state_log::flush()
+{
+    if (failed_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    // take the records appended so far, the handlers go on appending to the buffer
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock{ append_mutex_ };
+        sequence = appended_.load(std::memory_order_relaxed);
+        if (sequence == synced_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+
+        writing_.append(pending_);
+        pending_.clear();
+    }
+
+    // one write and one flush for every record of the loop iteration, a failed write is
+    // retried by the next sync from where it stopped
+    while (!writing_.empty()) {
+        auto const n = ::write(log_fd_, writing_.data(), writing_.size());
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        writing_.erase(0, static_cast<size_t>(n));
+        log_size_ += static_cast<size_t>(n);
+    }
+
+    // a failed flush may have dropped the dirty pages it did not write back, a later one
+    // would succeed without them, so the log stops syncing for good
+    if (fdatasync(log_fd_) < 0) {
+        failed_.store(true, std::memory_order_release);
+        return false;
+    }
+
+    synced_.store(sequence, std::memory_order_release);
+    return true;
+}
+
+bool state_log::compact()
+{
+    // copy the store under its mutex and write the copy without it, the handlers go on
+    // changing the store meanwhile; the copy holds every change up to the last record
+    // appended, the records appended past it are still pending and go to the log once
+    // it is truncated below
+    std::string buffer;
+    {
+        std::lock_guard<std::mutex> lock{ store_mutex_ };
+        snapshot_header header;
+        memcpy(header.magic, snapshot_magic, sizeof snapshot_magic);
+        header.sequence = appended_.load(std::memory_order_relaxed);
+        header.networks = store_.network_count();
+        header.endpoints = store_.endpoint_count();
+
+        buffer.reserve(sizeof header + header.networks * sizeof(network_record) + header.endpoints * sizeof(endpoint_record));
+        buffer.append(reinterpret_cast<const char *>(&header), sizeof header);
+        store_.for_each_network([&](uint32_t handle) {
+            auto const r = to_record(store_.network(handle));
+            buffer.append(reinterpret_cast<const char *>(&r), sizeof r);
+        });
+
+        store_.for_each_network([&](uint32_t network) {
+            store_.for_each_endpoint(network, [&](uint32_t handle) {
+                auto const r = to_record(store_.endpoint(handle), store_.network(network).id);
+                buffer.append(reinterpret_cast<const char *>(&r), sizeof r);
+            });
+        });
+    }
+
+    auto const tmp_path = snapshot_path_ + ".tmp";
+    auto const fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    auto const ok = write_all(fd, buffer.data(), buffer.size()) && fsync(fd) == 0;
+    close(fd);
+
+    // the new snapshot replaces the old one whole, then the log it covers is dropped, a
+    // crash in between leaves log records the snapshot covers, skipped on replay
+    if (!ok || rename(tmp_path.c_str(), snapshot_path_.c_str()) < 0 || !sync_dir(dir_)) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (ftruncate(log_fd_, 0) < 0) {
+        return false;
+    }
+
+    if (fdatasync(log_fd_) < 0) {
+        failed_.store(true, std::memory_order_release);
+        return false;
+    }
+
+    log_size_ = 0;
+    return true;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "commit_log.h"
+#include "state_store.h"
+
+/**
+ * @brief The persistence of the state store, a snapshot and an append-only write-ahead log
+ *
+ * Every change is appended to the log as a record with a sequence number and a checksum.
+ * The records are buffered in memory and written with one write and one fdatasync by
+ * sync, which the servers call once per loop iteration for the responses waiting on it.
+ * Once the log outgrows the compaction size, the store is written to a new snapshot
+ * that replaces the old one by rename, and the log is truncated.
+ *
+ * On startup the snapshot is mapped and its fixed size records are inserted as they lie,
+ * then the log records past the snapshot are replayed. A torn or corrupt record ends the
+ * log, it is truncated there.
+ *
+ * The changes are appended while holding the store mutex, so the log order is the order
+ * of the changes. The compaction takes the store mutex only while it copies the store,
+ * the snapshot is written, flushed and renamed without it.
+ */
+class state_log
+    : public commit_log
+{
+public:
+    static constexpr size_t default_compact_size = 8 * 1024 * 1024;  ///< the log size triggering a compaction
+
+    /**
+     * @brief What load found
+     */
+    struct load_stats
+    {
+        size_t networks{ 0 };   ///< the networks loaded
+        size_t endpoints{ 0 };  ///< the endpoints loaded
+        size_t snapshot{ 0 };   ///< the bytes of the snapshot
+        size_t replayed{ 0 };   ///< the log records replayed
+        size_t discarded{ 0 };  ///< the bytes of the torn log tail truncated
+    };
+
+    /**
+     * @brief Open the log, the files are created in \b dir if missing
+     *
+     * @param dir the state directory
+     * @param store the store persisted
+     * @param store_mutex the mutex guarding the store
+     * @throw std::system_error if the log cannot be opened
+     */
+    state_log(const std::string & dir, state_store & store, std::mutex & store_mutex);
+
+    /**
+     * @brief Destroy the state log object
+     */
+    ~state_log();
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    state_log(const state_log &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const state_log &) = delete;
+
+    /**
+     * @brief Load the snapshot and replay the log into the empty store, before the servers start
+     *
+     * @return load_stats what was loaded
+     * @throw std::system_error if the files cannot be read
+     * @throw std::runtime_error if the snapshot is corrupt
+     */
+    load_stats load();
+
+    /**
+     * @brief Set the log size triggering a compaction
+     *
+     * @param size the size in bytes
+     */
+    void set_compact_size(size_t size);
+
+    /**
+     * @brief Log a created or updated network, the store mutex is held
+     *
+     * @return uint64_t the sequence number of the record, the response waits for it
+     */
+    uint64_t put_network(const network_entry & network);
+
+    /**
+     * @brief Log a removed network, the store mutex is held
+     *
+     * @return uint64_t the sequence number of the record, the response waits for it
+     */
+    uint64_t remove_network(const object_id & id);
+
+    /**
+     * @brief Log a created or updated endpoint, the store mutex is held
+     *
+     * @return uint64_t the sequence number of the record, the response waits for it
+     */
+    uint64_t put_endpoint(const endpoint_entry & endpoint);
+
+    /**
+     * @brief Log a removed endpoint, the store mutex is held
+     *
+     * @return uint64_t the sequence number of the record, the response waits for it
+     */
+    uint64_t remove_endpoint(const object_id & id);
+
+    uint64_t appended() const override;
+
+    uint64_t synced() const override;
+
+    bool sync() override;
+
+    bool failed() const override;
+
+private:
+    /**
+     * @brief Append a record to the buffer
+     *
+     * @param type the record type
+     * @param payload the record payload
+     * @param size the payload size
+     * @return uint64_t the sequence number of the record
+     */
+    uint64_t append(uint32_t type, const void * payload, size_t size);
+
+    /**
+     * @brief Write the buffered records and flush them, the sync mutex is held
+     *
+     * @return true if the records are on stable storage
+     */
+    bool flush();
+
+    /**
+     * @brief Write the store to a new snapshot and truncate the log, the sync mutex is held
+     *
+     * @return true if the snapshot replaced the log
+     */
+    bool compact();
+
+    /**
+     * @brief Insert the snapshot records into the store
+     *
+     * @return uint64_t the sequence number of the last record the snapshot covers
+     */
+    uint64_t load_snapshot(load_stats & stats);
+
+    /**
+     * @brief Replay the log records past the snapshot, truncate a torn tail
+     *
+     * @param covered the sequence number of the last record the snapshot covers
+     * @return uint64_t the sequence number of the last record
+     */
+    uint64_t replay(uint64_t covered, load_stats & stats);
+
+    std::string           dir_;                                    ///< the state directory
+    std::string           snapshot_path_;                          ///< the snapshot file
+    int                   log_fd_{ -1 };                           ///< the log file, opened for appending
+    state_store          &store_;                                  ///< the store
+    std::mutex           &store_mutex_;                            ///< the mutex guarding the store
+    std::mutex            append_mutex_{ };                        ///< guards the record buffer
+    std::mutex            sync_mutex_{ };                          ///< serializes the writes and the compactions
+    std::string           pending_{ };                             ///< the records appended since the last write
+    std::string           writing_{ };                             ///< the records being written
+    std::atomic<uint64_t> appended_{ 0 };                          ///< the sequence number of the last record appended
+    std::atomic<uint64_t> synced_{ 0 };                            ///< the sequence number of the last record flushed
+    std::atomic<bool>     failed_{ false };                        ///< a flush failed, nothing is synced from then on
+    size_t                log_size_{ 0 };                          ///< the bytes in the log file
+    size_t                compact_size_{ default_compact_size };   ///< the log size triggering a compaction
+};
+
+inline void state_log::set_compact_size(size_t size)
+{
+    compact_size_ = size;
+}
+
+inline uint64_t state_log::appended() const
+{
+    return appended_.load(std::memory_order_acquire);
+}
+
+inline uint64_t state_log::synced() const
+{
+    return synced_.load(std::memory_order_acquire);
+}
+
+inline bool state_log::failed() const
+{
+    return failed_.load(std::memory_order_acquire);
+}
@@ -0,0 +1,147 @@
+#include "state_store.h"
+
+namespace {
+
+/**
+ * @brief Get the value of a hex digit
+ *
+ * @return int the value, -1 if \b c is not a hex digit
+ */
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+}
+
+bool object_id::parse(std::string_view hex, object_id & id)
+{
+    if (hex.size() != size * 2) {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        auto const high = hex_value(hex[i * 2]);
+        auto const low = hex_value(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+
+        id.bytes[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+
+    return true;
+}
+
+uint32_t state_store::add_network(const object_id & id)
+{
+    return networks_.insert(id);
+}
+
+uint32_t state_store::find_network(const object_id & id) const
+{
+    return networks_.find(id);
+}
+
+network_entry & state_store::network(uint32_t handle)
+{
+    return networks_[handle];
+}
+
+const network_entry & state_store::network(uint32_t handle) const
+{
+    return networks_[handle];
+}
+
+bool state_store::remove_network(uint32_t handle)
+{
+    if (networks_[handle].endpoint_count != 0) {
+        return false;
+    }
+
+    networks_.erase(handle);
+    return true;
+}
+
+uint32_t state_store::add_endpoint(uint32_t network, const object_id & id)
+{
+    auto const handle = endpoints_.insert(id);
+    if (handle == npos) {
+        return npos;
+    }
+
+    // push to the front of the network list
+    auto & n = networks_[network];
+    auto & e = endpoints_[handle];
+    e.network = network;
+    e.next = n.endpoints;
+    if (n.endpoints != npos) {
+        endpoints_[n.endpoints].prev = handle;
+    }
+
+    n.endpoints = handle;
+    ++n.endpoint_count;
+    return handle;
+}
+
+uint32_t state_store::find_endpoint(const object_id & id) const
+{
+    return endpoints_.find(id);
+}
+
+endpoint_entry & state_store::endpoint(uint32_t handle)
+{
+    return endpoints_[handle];
+}
+
+const endpoint_entry & state_store::endpoint(uint32_t handle) const
+{
+    return endpoints_[handle];
+}
+
+void state_store::remove_endpoint(uint32_t handle)
+{
+    // unlink from the network list
+    auto const & e = endpoints_[handle];
+    auto & n = networks_[e.network];
+    if (e.prev != npos) {
+        endpoints_[e.prev].next = e.next;
+    } else {
+        n.endpoints = e.next;
+    }
+
+    if (e.next != npos) {
+        endpoints_[e.next].prev = e.prev;
+    }
+
+    --n.endpoint_count;
+    endpoints_.erase(handle);
+}
+
+size_t state_store::network_count() const
+{
+    return networks_.size();
+}
+
+size_t state_store::endpoint_count() const
+{
+    return endpoints_.size();
+}
+
+table_memory state_store::networks_memory() const
+{
+    return networks_.memory();
+}
+
+table_memory state_store::endpoints_memory() const
+{
+    return endpoints_.memory();
+}
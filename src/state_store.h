@@ -0,0 +1,442 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "fixed_string.h"
+
+constexpr uint32_t no_handle = UINT32_MAX;  ///< the handle naming no entry
+
+/**
+ * @brief A docker network or endpoint id, the 64 hex digits decoded to 32 bytes
+ */
+struct object_id
+{
+    static constexpr size_t size = 32;  ///< the decoded length
+
+    /**
+     * @brief Decode an id
+     *
+     * @param hex the 64 hex digits, either case
+     * @param id the decoded id
+     * @return true if \b hex is a well-formed id
+     */
+    static bool parse(std::string_view hex, object_id & id);
+
+    /**
+     * @brief Get the hash of the id
+     */
+    uint64_t hash() const;
+
+    bool operator==(const object_id & other) const;
+
+    uint8_t bytes[size]{ };  ///< the id bytes
+};
+
+/**
+ * @brief The memory held by a table
+ */
+struct table_memory
+{
+    size_t entries{ 0 };   ///< the live entries
+    size_t capacity{ 0 };  ///< the entries the slab holds without growing
+    size_t slots{ 0 };     ///< the index slots
+    size_t bytes{ 0 };     ///< the bytes allocated by the slab and the index
+};
+
+/**
+ * @brief The table of entries keyed by an object id
+ *
+ * The entries live in a dense slab and are named by small integer handles, stable until
+ * the entry is erased, a freed handle is reused by the next insert. The id index is an
+ * open addressing table of 8 byte slots with linear probing, a slot holds the low half of
+ * the id hash and the handle so most probes stay in one cache line and only a hash match
+ * reads the entry. Erasing shifts the following slots back, the table has no tombstones.
+ *
+ * @tparam T the entry type, holds the key in an \b id member
+ */
+template <typename T>
+class id_table
+{
+    /**
+     * @brief The index slot
+     */
+    struct slot
+    {
+        uint32_t hash{ 0 };        ///< the low half of the id hash
+        uint32_t handle{ npos };   ///< the entry handle, npos for an empty slot
+    };
+
+public:
+    static constexpr uint32_t npos = no_handle;  ///< no entry
+
+    /**
+     * @brief Insert an entry
+     *
+     * @param id the key
+     * @return uint32_t the handle of the new entry, npos if the key is present
+     */
+    uint32_t insert(const object_id & id);
+
+    /**
+     * @brief Find an entry
+     *
+     * @param id the key
+     * @return uint32_t the handle, npos if missing
+     */
+    uint32_t find(const object_id & id) const;
+
+    /**
+     * @brief Erase an entry, its handle becomes invalid
+     *
+     * @param handle the handle of a live entry
+     */
+    void erase(uint32_t handle);
+
+    T & operator[](uint32_t handle);
+
+    const T & operator[](uint32_t handle) const;
+
+    /**
+     * @brief Get the number of live entries
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the memory held by the table
+     */
+    table_memory memory() const;
+
+    /**
+     * @brief Call \b f with the handle of each live entry, in handle order
+     */
+    template <typename F>
+    void for_each(F && f) const;
+
+private:
+    /**
+     * @brief Find the slot of a key
+     *
+     * @return size_t the slot holding the key, or the empty slot ending its probe
+     */
+    size_t probe(const object_id & id, uint32_t hash) const;
+
+    /**
+     * @brief Double the index, the slots are reinserted
+     */
+    void grow();
+
+    std::vector<T>        entries_{ };  ///< the slab
+    std::vector<bool>     live_{ };     ///< the live entries of the slab
+    std::vector<uint32_t> free_{ };     ///< the erased handles
+    std::vector<slot>     slots_{ };    ///< the index, a power of two
+    size_t                size_{ 0 };   ///< the live entries
+};
+
+/**
+ * @brief A network created by the daemon
+ */
+struct network_entry
+{
+    object_id        id{ };
+    fixed_string<64> ipv4_pool{ };
+    fixed_string<64> ipv4_gateway{ };
+    fixed_string<64> ipv6_pool{ };
+    fixed_string<64> ipv6_gateway{ };
+    uint32_t         endpoints{ no_handle };  ///< the first endpoint of the network
+    uint32_t         endpoint_count{ 0 };     ///< the endpoints of the network
+};
+
+/**
+ * @brief An endpoint created by the daemon, linked into the list of its network
+ */
+struct endpoint_entry
+{
+    object_id         id{ };
+    uint32_t          network{ no_handle };  ///< the network handle
+    uint32_t          prev{ no_handle };     ///< the previous endpoint of the network
+    uint32_t          next{ no_handle };     ///< the next endpoint of the network
+    bool              joined{ false };       ///< the endpoint is in a sandbox
+    fixed_string<64>  address{ };
+    fixed_string<64>  address_ipv6{ };
+    fixed_string<32>  mac_address{ };
+    fixed_string<256> sandbox_key{ };
+};
+
+/**
+ * @brief The networks and endpoints of the driver
+ *
+ * The store is not thread safe, the caller serializes the access.
+ */
+class state_store
+{
+public:
+    static constexpr uint32_t npos = no_handle;  ///< no entry
+
+    /**
+     * @brief Add a network
+     *
+     * @param id the network id
+     * @return uint32_t the network handle, npos if the network exists
+     */
+    uint32_t add_network(const object_id & id);
+
+    /**
+     * @brief Find a network
+     *
+     * @return uint32_t the network handle, npos if missing
+     */
+    uint32_t find_network(const object_id & id) const;
+
+    network_entry & network(uint32_t handle);
+
+    const network_entry & network(uint32_t handle) const;
+
+    /**
+     * @brief Remove a network without endpoints
+     *
+     * @param handle the network handle
+     * @return true if the network is removed
+     * @return false if the network still has endpoints
+     */
+    bool remove_network(uint32_t handle);
+
+    /**
+     * @brief Add an endpoint to a network
+     *
+     * @param network the network handle
+     * @param id the endpoint id
+     * @return uint32_t the endpoint handle, npos if the endpoint exists
+     */
+    uint32_t add_endpoint(uint32_t network, const object_id & id);
+
+    /**
+     * @brief Find an endpoint
+     *
+     * @return uint32_t the endpoint handle, npos if missing
+     */
+    uint32_t find_endpoint(const object_id & id) const;
+
+    endpoint_entry & endpoint(uint32_t handle);
+
+    const endpoint_entry & endpoint(uint32_t handle) const;
+
+    /**
+     * @brief Remove an endpoint from its network
+     *
+     * @param handle the endpoint handle
+     */
+    void remove_endpoint(uint32_t handle);
+
+    /**
+     * @brief Call \b f with the handle of each network
+     */
+    template <typename F>
+    void for_each_network(F && f) const;
+
+    /**
+     * @brief Call \b f with the handle of each endpoint of a network, \b f must not remove
+     * other endpoints of the network
+     *
+     * @param network the network handle
+     */
+    template <typename F>
+    void for_each_endpoint(uint32_t network, F && f) const;
+
+    size_t network_count() const;
+
+    size_t endpoint_count() const;
+
+    /**
+     * @brief Get the memory held by the networks
+     */
+    table_memory networks_memory() const;
+
+    /**
+     * @brief Get the memory held by the endpoints
+     */
+    table_memory endpoints_memory() const;
+
+private:
+    id_table<network_entry>  networks_{ };   ///< the networks
+    id_table<endpoint_entry> endpoints_{ };  ///< the endpoints
+};
+
+inline uint64_t object_id::hash() const
+{
+    // fold the four words, then the mixing of splitmix64 guards against ids that are not random
+    uint64_t words[size / sizeof(uint64_t)];
+    memcpy(words, bytes, size);
+    auto h = words[0] ^ words[1] * 0x9e3779b97f4a7c15ull ^ words[2] ^ words[3] * 0xc2b2ae3d27d4eb4full;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    return h ^ h >> 31;
+}
+
+inline bool object_id::operator==(const object_id & other) const
+{
+    return memcmp(bytes, other.bytes, size) == 0;
+}
+
+template <typename T>
+inline uint32_t id_table<T>::insert(const object_id & id)
+{
+    // keep the load factor under 3/4
+    if ((size_ + 1) * 4 > slots_.size() * 3) {
+        grow();
+    }
+
+    auto const hash = static_cast<uint32_t>(id.hash());
+    auto const i = probe(id, hash);
+    if (slots_[i].handle != npos) {
+        return npos;
+    }
+
+    // reuse an erased entry
+    uint32_t handle;
+    if (!free_.empty()) {
+        handle = free_.back();
+        free_.pop_back();
+        entries_[handle] = T{ };
+        live_[handle] = true;
+    } else {
+        handle = static_cast<uint32_t>(entries_.size());
+        entries_.emplace_back();
+        live_.push_back(true);
+    }
+
+    entries_[handle].id = id;
+    slots_[i] = slot{ hash, handle };
+    ++size_;
+    return handle;
+}
+
+template <typename T>
+inline uint32_t id_table<T>::find(const object_id & id) const
+{
+    if (size_ == 0) {
+        return npos;
+    }
+
+    return slots_[probe(id, static_cast<uint32_t>(id.hash()))].handle;
+}
+
+template <typename T>
+inline void id_table<T>::erase(uint32_t handle)
+{
+    auto const mask = slots_.size() - 1;
+    auto i = probe(entries_[handle].id, static_cast<uint32_t>(entries_[handle].id.hash()));
+
+    // shift back the following slots of the cluster that probe past the hole
+    for (auto j = (i + 1) & mask; slots_[j].handle != npos; j = (j + 1) & mask) {
+        auto const home = slots_[j].hash & mask;
+        auto const moves = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if (moves) {
+            slots_[i] = slots_[j];
+            i = j;
+        }
+    }
+
+    slots_[i] = slot{ };
+    live_[handle] = false;
+    free_.push_back(handle);
+    --size_;
+}
+
+template <typename T>
+inline T & id_table<T>::operator[](uint32_t handle)
+{
+    return entries_[handle];
+}
+
+template <typename T>
+inline const T & id_table<T>::operator[](uint32_t handle) const
+{
+    return entries_[handle];
+}
+
+template <typename T>
+inline size_t id_table<T>::size() const
+{
+    return size_;
+}
+
+template <typename T>
+inline table_memory id_table<T>::memory() const
+{
+    table_memory m;
+    m.entries = size_;
+    m.capacity = entries_.capacity();
+    m.slots = slots_.size();
+    m.bytes = entries_.capacity() * sizeof(T)
+        + live_.capacity() / 8
+        + free_.capacity() * sizeof(uint32_t)
+        + slots_.capacity() * sizeof(slot);
+    return m;
+}
+
+template <typename T>
+template <typename F>
+inline void id_table<T>::for_each(F && f) const
+{
+    for (uint32_t handle = 0; handle < entries_.size(); ++handle) {
+        if (live_[handle]) {
+            f(handle);
+        }
+    }
+}
+
+template <typename T>
+inline size_t id_table<T>::probe(const object_id & id, uint32_t hash) const
+{
+    auto const mask = slots_.size() - 1;
+    for (auto i = hash & mask; ; i = (i + 1) & mask) {
+        auto const & s = slots_[i];
+        if (s.handle == npos || (s.hash == hash && entries_[s.handle].id == id)) {
+            return i;
+        }
+    }
+}
+
+template <typename T>
+inline void id_table<T>::grow()
+{
+    std::vector<slot> slots(slots_.empty() ? 16 : slots_.size() * 2);
+    auto const mask = slots.size() - 1;
+    for (auto const & s : slots_) {
+        if (s.handle == npos) {
+            continue;
+        }
+
+        auto i = s.hash & mask;
+        while (slots[i].handle != npos) {
+            i = (i + 1) & mask;
+        }
+
+        slots[i] = s;
+    }
+
+    slots_.swap(slots);
+}
+
+template <typename F>
+inline void state_store::for_each_network(F && f) const
+{
+    networks_.for_each(std::forward<F>(f));
+}
+
+template <typename F>
+inline void state_store::for_each_endpoint(uint32_t network, F && f) const
+{
+    for (auto handle = networks_[network].endpoints; handle != npos; ) {
+        auto const next = endpoints_[handle].next;
+        f(handle);
+        handle = next;
+    }
+}
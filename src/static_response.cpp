@@ -0,0 +1,13 @@
+#include "static_response.h"
+
+static_response::static_response(const http_response & response)
+{
+    for (size_t i = 0; i < variants; ++i) {
+        offset_[i] = data_.size();
+        response.serialize_header(data_, static_cast<http_response::connection_header>(i));
+        data_.append(response.body());
+    }
+
+    offset_[variants] = data_.size();
+    data_.shrink_to_fit();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "http_response.h"
+
+/**
+ * @brief A constant response serialized once, sent without invoking a handler
+ *
+ * The complete response bytes are built at registration for each Connection header
+ * variant and kept in one immutable buffer, a request is answered by queueing a view
+ * of it.
+ */
+class static_response
+{
+    static constexpr auto variants = static_cast<size_t>(http_response::connection_header::count);
+
+public:
+    /**
+     * @brief Construct a new static response object
+     *
+     * @param response the response to serialize
+     */
+    explicit static_response(const http_response & response);
+
+    /**
+     * @brief Get the response bytes
+     *
+     * @param connection the Connection header line
+     * @return std::string_view the status line, the header block and the body
+     */
+    std::string_view bytes(http_response::connection_header connection) const;
+
+private:
+    std::string data_{ };                  ///< the serialized variants
+    size_t      offset_[variants + 1]{ };  ///< the variant offsets in the buffer
+};
+
+inline std::string_view static_response::bytes(http_response::connection_header connection) const
+{
+    auto const i = static_cast<size_t>(connection);
+    return std::string_view{ data_ }.substr(offset_[i], offset_[i + 1] - offset_[i]);
+}
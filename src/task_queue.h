@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+
+class task_queue;
+
+/**
+ * @brief The task, posted to an event dispatcher from any thread
+ *
+ * The task object is the queue node, it must stay alive until on_run is called.
+ */
+class task
+{
+    friend task_queue;
+
+public:
+    task() = default;
+
+    virtual ~task() = default;
+
+    /**
+     * @brief The on run callback, called on the event dispatcher thread
+     */
+    virtual void on_run() = 0;
+
+private:
+    std::atomic<task *> next_{ nullptr };  ///< the next task in the queue
+};
+
+/**
+ * @brief The intrusive lock-free multi-producer single-consumer task queue
+ *
+ * Pushing is wait-free, popping may report an empty queue while a producer is in the
+ * middle of a push, the producer notifies the consumer after the push completes.
+ */
+class task_queue
+{
+    /**
+     * @brief The stub task, keeps the queue non-empty
+     */
+    class stub_task
+        : public task
+    {
+    public:
+        void on_run() override { }
+    };
+
+public:
+    /**
+     * @brief Construct a new task queue object
+     */
+    task_queue();
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    task_queue(const task_queue &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const task_queue &) = delete;
+
+    /**
+     * @brief Push a task, may be called from any thread
+     *
+     * @param t the task
+     */
+    void push(task & t);
+
+    /**
+     * @brief Pop a task, must be called from the consumer thread
+     *
+     * @return task* the task, nullptr if the queue is empty
+     */
+    task * pop();
+
+private:
+    std::atomic<task *> head_;   ///< the last pushed task, written by the producers
+    task               *tail_;   ///< the next task to pop, owned by the consumer
+    stub_task           stub_;   ///< the stub task
+};
+
+inline task_queue::task_queue()
+    : head_{ &stub_ }
+    , tail_{ &stub_ }
+{
+}
+
+inline void task_queue::push(task & t)
+{
+    t.next_.store(nullptr, std::memory_order_relaxed);
+    auto const prev = head_.exchange(&t, std::memory_order_acq_rel);
+    prev->next_.store(&t, std::memory_order_release);
+}
+
+inline task * task_queue::pop()
+{
+    auto tail = tail_;
+    auto next = tail->next_.load(std::memory_order_acquire);
+
+    // skip the stub
+    if (tail == &stub_) {
+        if (!next) {
+            return nullptr;
+        }
+
+        tail_ = next;
+        tail = next;
+        next = next->next_.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+
+    // a producer is linking a new task
+    if (tail != head_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // the tail is the last task, push the stub behind it so it can be popped
+    push(stub_);
+    next = tail->next_.load(std::memory_order_acquire);
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+
+    return nullptr;
+}
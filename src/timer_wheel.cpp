@@ -0,0 +1,105 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+
+int timer_wheel::next_timeout(uint64_t now)
+{
+    // the first non-empty slot of the lowest level, in expiry order
+    auto const index = static_cast<unsigned>(current_ & slot_mask);
+    auto bits = std::rotr(occupied_[0], static_cast<int>(index));
+    while (bits) {
+        auto const distance = static_cast<unsigned>(std::countr_zero(bits));
+        auto const slot = (index + distance) & slot_mask;
+        if (!wheel_[0][slot].empty()) {
+            auto const expires = current_ + distance;
+            return expires > now ? static_cast<int>(std::min<uint64_t>(expires - now, INT_MAX)) : 0;
+        }
+
+        // the timers of the slot were cancelled
+        occupied_[0] &= ~(uint64_t{ 1 } << slot);
+        bits &= bits - 1;
+    }
+
+    // the higher levels expire no earlier than the next cascade
+    for (auto level = 1u; level < level_count; ++level) {
+        if (occupied_[level]) {
+            auto const expires = (current_ + slot_mask) & ~uint64_t{ slot_mask };
+            return expires > now ? static_cast<int>(std::min<uint64_t>(expires - now, INT_MAX)) : 0;
+        }
+    }
+
+    return -1;
+}
+
+void timer_wheel::advance(uint64_t now)
+{
+    while (current_ <= now) {
+        // nothing armed, jump to now
+        if (!occupied_[0] && !occupied_[1] && !occupied_[2] && !occupied_[3]) {
+            current_ = now + 1;
+            break;
+        }
+
+        // cascade the higher levels when the lower level wraps around
+        auto const index = static_cast<unsigned>(current_ & slot_mask);
+        if (index == 0) {
+            for (auto level = 1u; level < level_count; ++level) {
+                auto const i = static_cast<unsigned>((current_ >> (level_bits * level)) & slot_mask);
+                cascade(level, i);
+                if (i != 0) {
+                    break;
+                }
+            }
+        }
+
+        // take the expired timers out before firing, the callbacks may arm timers again
+        slot_list expired;
+        expired.swap(wheel_[0][index]);
+        occupied_[0] &= ~(uint64_t{ 1 } << index);
+        ++current_;
+
+        while (!expired.empty()) {
+            auto & timer = expired.front();
+            expired.pop_front();
+            timer.on_timer();
+        }
+    }
+}
+
+void timer_wheel::place(timer_listener & timer)
+{
+    // overdue timers fire on the next tick
+    auto expires = timer.expires_ < current_ ? current_ : timer.expires_;
+    auto const delta = expires - current_;
+
+    // find the level whose span covers the delta
+    auto level = 0u;
+    while (level + 1 < level_count && delta >> (level_bits * (level + 1))) {
+        ++level;
+    }
+
+    // park timers beyond the last level at its far end, they are placed again on cascade
+    auto const span = uint64_t{ 1 } << (level_bits * level_count);
+    if (delta >= span) {
+        expires = current_ + span - 1;
+    }
+
+    auto const index = static_cast<unsigned>((expires >> (level_bits * level)) & slot_mask);
+    wheel_[level][index].push_back(timer);
+    occupied_[level] |= uint64_t{ 1 } << index;
+}
+
+void timer_wheel::cascade(unsigned level, unsigned index)
+{
+    slot_list timers;
+    timers.swap(wheel_[level][index]);
+    occupied_[level] &= ~(uint64_t{ 1 } << index);
+
+    while (!timers.empty()) {
+        auto & timer = timers.front();
+        timers.pop_front();
+        place(timer);
+    }
+}
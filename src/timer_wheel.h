@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/list_hook.hpp>
+
+class timer_wheel;
+
+/**
+ * @brief The timer listener
+ */
+class timer_listener
+{
+    friend timer_wheel;
+
+    using list_hook = boost::intrusive::list_member_hook
+        < boost::intrusive::link_mode<boost::intrusive::auto_unlink>
+        >;
+
+public:
+    timer_listener() = default;
+
+    virtual ~timer_listener() = default;
+
+    /**
+     * @brief Check if the timer is armed
+     *
+     * @return true if the timer is armed
+     * @return false if the timer is not armed
+     */
+    bool is_armed() const;
+
+    /**
+     * @brief Get the expiry time of the armed timer
+     *
+     * @return uint64_t the expiry time in milliseconds
+     */
+    uint64_t expires() const;
+
+protected:
+    /**
+     * @brief The on timer callback
+     */
+    virtual void on_timer() = 0;
+
+private:
+    list_hook list_hook_{ };  ///< the list hook, unlinks itself on destruction
+    uint64_t  expires_{ 0 };  ///< the expiry time in milliseconds
+};
+
+/**
+ * @brief The hierarchical timer wheel
+ *
+ * Four levels of 64 slots with a 1 ms tick, level n slots span 64^n ticks. Timers
+ * beyond the last level (about 4.6 hours) are parked in the last level and placed
+ * again when it cascades. Arming and cancelling are O(1), a per level occupancy
+ * bitmap finds the next deadline without walking the slots.
+ */
+class timer_wheel
+{
+    static constexpr unsigned level_bits = 6;
+    static constexpr unsigned slot_count = 1u << level_bits;
+    static constexpr unsigned slot_mask = slot_count - 1;
+    static constexpr unsigned level_count = 4;
+
+    using slot_list = boost::intrusive::list
+        < timer_listener
+        , boost::intrusive::member_hook
+            < timer_listener
+            , timer_listener::list_hook
+            , &timer_listener::list_hook_
+            >
+        , boost::intrusive::constant_time_size<false>
+        >;
+
+public:
+    /**
+     * @brief Construct a new timer wheel object
+     *
+     * @param now the current time in milliseconds
+     */
+    explicit timer_wheel(uint64_t now);
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    timer_wheel(const timer_wheel &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const timer_wheel &) = delete;
+
+    /**
+     * @brief Arm a timer, re-arming an armed timer moves its expiry
+     *
+     * @param timer the timer
+     * @param expires the expiry time in milliseconds
+     */
+    void arm(timer_listener & timer, uint64_t expires);
+
+    /**
+     * @brief Cancel a timer
+     *
+     * @param timer the timer
+     */
+    static void cancel(timer_listener & timer);
+
+    /**
+     * @brief Get the time until the next timer may expire
+     *
+     * @param now the current time in milliseconds
+     * @return int the timeout in milliseconds, -1 if no timer is armed
+     */
+    int next_timeout(uint64_t now);
+
+    /**
+     * @brief Fire the timers expired up to \b now
+     *
+     * @param now the current time in milliseconds
+     */
+    void advance(uint64_t now);
+
+private:
+    /**
+     * @brief Put a timer into the slot matching its expiry
+     *
+     * @param timer the timer
+     */
+    void place(timer_listener & timer);
+
+    /**
+     * @brief Move the timers of a higher level slot down to the lower levels
+     *
+     * @param level the level
+     * @param index the slot index
+     */
+    void cascade(unsigned level, unsigned index);
+
+    slot_list wheel_[level_count][slot_count];  ///< the slots
+    uint64_t  occupied_[level_count]{ };        ///< the slots that may be non-empty
+    uint64_t  current_{ 0 };                    ///< the next tick to process
+};
+
+inline bool timer_listener::is_armed() const
+{
+    return list_hook_.is_linked();
+}
+
+inline uint64_t timer_listener::expires() const
+{
+    return expires_;
+}
+
+inline timer_wheel::timer_wheel(uint64_t now)
+    : current_{ now }
+{
+}
+
+inline void timer_wheel::arm(timer_listener & timer, uint64_t expires)
+{
+    timer.list_hook_.unlink();
+    timer.expires_ = expires;
+    place(timer);
+}
+
+inline void timer_wheel::cancel(timer_listener & timer)
+{
+    timer.list_hook_.unlink();
+}
@@ -0,0 +1,196 @@
+#include "veth_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <memory>
+
+thread_local veth_pool * veth_pool::current_{ nullptr };
+
+namespace {
+
+constexpr std::chrono::milliseconds retry_delay{ 1000 };  ///< the time a failed refill waits before the next one
+
+}
+
+veth_pool::veth_pool(unsigned id, event_dispatcher & dispatcher, rtnetlink & netlink)
+    : id_{ id }
+    , dispatcher_{ dispatcher }
+    , netlink_{ netlink }
+{
+}
+
+veth_pool::~veth_pool()
+{
+    detach();
+}
+
+void veth_pool::set_watermarks(size_t low, size_t high)
+{
+    high_ = high;
+    low_ = low < high ? low : high;
+}
+
+bool veth_pool::attach()
+{
+    if (!dispatcher_.subscribe(static_cast<loop_listener &>(*this))) {
+        return false;
+    }
+
+    attached_ = true;
+    current_ = this;
+
+    // the loop phase runs once the dispatcher wakes up, not before the first event
+    dispatcher_.post(*this);
+    return true;
+}
+
+void veth_pool::detach()
+{
+    if (!attached_) {
+        return;
+    }
+
+    dispatcher_.unsubscribe(static_cast<loop_listener &>(*this));
+    dispatcher_.cancel(*this);
+    attached_ = false;
+    if (current_ == this) {
+        current_ = nullptr;
+    }
+}
+
+bool veth_pool::take(pair & p)
+{
+    if (ready_.empty()) {
+        stats_.misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    p = ready_.back();
+    ready_.pop_back();
+    stats_.hits.fetch_add(1, std::memory_order_relaxed);
+    stats_.ready.store(ready_.size(), std::memory_order_relaxed);
+    return true;
+}
+
+void veth_pool::give_back(const pair & p)
+{
+    ready_.push_back(p);
+    stats_.ready.store(ready_.size(), std::memory_order_relaxed);
+}
+
+void veth_pool::release(const pair & p)
+{
+    free_.push_back(p.slot);
+}
+
+void veth_pool::on_loop()
+{
+    // a failed refill is not retried at once, the messages would fail the same way
+    if (is_armed()) {
+        return;
+    }
+
+    if (ready_.size() + creating_ < low_) {
+        refilling_ = true;
+    }
+
+    if (!refilling_) {
+        return;
+    }
+
+    // the refill runs while the client is idle, the messages of the endpoints go first, and
+    // a batch at a time, the acknowledgements of the last one start the next
+    if (netlink_.in_flight() != 0) {
+        return;
+    }
+
+    while (creating_ < refill_batch && ready_.size() + creating_ < high_) {
+        if (free_.empty() && next_slot_ == std::numeric_limits<uint16_t>::max()) {
+            break;
+        }
+
+        create();
+    }
+
+    if (ready_.size() + creating_ >= high_) {
+        refilling_ = false;
+    }
+}
+
+void veth_pool::on_run()
+{
+}
+
+void veth_pool::on_timer()
+{
+}
+
+void veth_pool::create()
+{
+    uint16_t slot;
+    if (!free_.empty()) {
+        slot = free_.back();
+        free_.pop_back();
+    } else {
+        slot = next_slot_++;
+    }
+
+    auto const host = slot_name("tq-", slot);
+    auto const peer = slot_name("tr-", slot);
+
+    // the pair a previous run left under the slot names goes first, in its own group as
+    // it is usually missing
+    netlink_.delete_link(host.view());
+    netlink_.submit([](int) {
+    });
+
+    // the pair is created down, a link is renamed only while down
+    auto const created = std::make_shared<pair>(pair{ slot, 0, 0 });
+    netlink_.add_veth(host.view(), peer.view(), 0, false);
+    netlink_.get_link(host.view(), [created](const rtnetlink::link_info & link) {
+        created->host = link.index;
+    });
+
+    netlink_.get_link(peer.view(), [created](const rtnetlink::link_info & link) {
+        created->peer = link.index;
+    });
+
+    ++creating_;
+    netlink_.submit([this, created, start = std::chrono::steady_clock::now()](int error) {
+        --creating_;
+        if (error != 0) {
+            stats_.failed.fetch_add(1, std::memory_order_relaxed);
+            free_.push_back(created->slot);
+            refilling_ = false;
+            dispatcher_.arm(*this, retry_delay);
+            return;
+        }
+
+        auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        auto const us = static_cast<uint64_t>(elapsed.count());
+        stats_.created.fetch_add(1, std::memory_order_relaxed);
+        stats_.refill_total.fetch_add(us, std::memory_order_relaxed);
+        if (us > stats_.refill_max.load(std::memory_order_relaxed)) {
+            stats_.refill_max.store(us, std::memory_order_relaxed);
+        }
+
+        ready_.push_back(*created);
+        stats_.ready.store(ready_.size(), std::memory_order_relaxed);
+    });
+}
+
+link_name veth_pool::host_name(const pair & p) const
+{
+    return slot_name("tq-", p.slot);
+}
+
+link_name veth_pool::slot_name(const char * prefix, uint16_t slot) const
+{
+    char text[16];
+    auto const n = snprintf(text, sizeof text, "%s%u-%u", prefix, id_ % 1000, static_cast<unsigned>(slot));
+
+    link_name name;
+    name.assign({ text, static_cast<size_t>(n) });
+    return name;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "event_dispatcher.h"
+#include "network_links.h"
+#include "rtnetlink.h"
+#include "task_queue.h"
+
+/**
+ * @brief The pool of veth pairs created ahead of the endpoints of an event dispatcher thread
+ *
+ * Creating a veth pair is the slow part of plumbing an endpoint, the kernel registers two
+ * devices. The pool keeps pairs created and down under their slot names, "tq-" and "tr-"
+ * with the reactor index and the slot, and an endpoint takes one and has it renamed in
+ * place, enslaved and brought up, a single message per end. Once the ready pairs fall
+ * below the low watermark the pool is refilled up to the high watermark from the loop
+ * phase of the dispatcher, a batch of pairs at a time once the rtnetlink client has nothing
+ * else in flight.
+ *
+ * A slot is deleted before its pair is created, the pairs left by a previous run under
+ * the same names are replaced rather than failing the refill. A failed refill arms the
+ * timer of the pool and the next one starts once it fires, an idle dispatcher wakes up
+ * for it.
+ *
+ * The pool is owned by one event dispatcher thread, only the counters may be read from
+ * other threads.
+ */
+class veth_pool
+    : public loop_listener
+    , public timer_listener
+    , public task
+{
+public:
+    static constexpr size_t refill_batch = 8;  ///< the pairs created at a time, four messages each
+
+    /**
+     * @brief A ready pair, the slot and the link indexes of its ends
+     */
+    struct pair
+    {
+        uint16_t slot{ 0 };  ///< the slot
+        int      host{ 0 };  ///< the index of the host end
+        int      peer{ 0 };  ///< the index of the container end
+    };
+
+    /**
+     * @brief The pool counters, readable from any thread
+     */
+    struct statistics
+    {
+        std::atomic<uint64_t> hits{ 0 };          ///< the endpoints given a ready pair
+        std::atomic<uint64_t> misses{ 0 };        ///< the endpoints whose pair was created because the pool was empty
+        std::atomic<uint64_t> created{ 0 };       ///< the pairs created by the refills
+        std::atomic<uint64_t> failed{ 0 };        ///< the pairs the refills failed to create
+        std::atomic<uint64_t> ready{ 0 };         ///< the ready pairs
+        std::atomic<uint64_t> refill_total{ 0 };  ///< the sum of the creation latencies in microseconds
+        std::atomic<uint64_t> refill_max{ 0 };    ///< the largest creation latency in microseconds
+    };
+
+    /**
+     * @brief Construct a new veth pool object, empty and disabled until its watermarks are set
+     *
+     * @param id the reactor index, part of the slot names
+     * @param dispatcher the event dispatcher
+     * @param netlink the rtnetlink client of the dispatcher
+     */
+    veth_pool(unsigned id, event_dispatcher & dispatcher, rtnetlink & netlink);
+
+    /**
+     * @brief Destroy the veth pool object, the ready pairs are left to the next run
+     */
+    ~veth_pool() override;
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    veth_pool(const veth_pool &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const veth_pool &) = delete;
+
+    /**
+     * @brief Get the pool of the calling thread
+     *
+     * @return veth_pool* the pool, nullptr if the thread has none attached
+     */
+    static veth_pool * current();
+
+    /**
+     * @brief Set the watermarks, called before the pool is attached
+     *
+     * @param low the ready pairs below which the pool is refilled
+     * @param high the ready pairs a refill stops at, 0 disables the pool
+     */
+    void set_watermarks(size_t low, size_t high);
+
+    /**
+     * @brief Check if the pool is enabled
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Subscribe to the dispatcher, become the pool of the calling thread and start the
+     * first refill, called on the dispatcher thread
+     *
+     * @return true if subscribed
+     */
+    bool attach();
+
+    /**
+     * @brief Unsubscribe from the dispatcher, called on the dispatcher thread
+     */
+    void detach();
+
+    /**
+     * @brief Take a ready pair, counted as a hit or a miss
+     *
+     * @param p the pair
+     * @return true if a pair is taken
+     * @return false if the pool is empty
+     */
+    bool take(pair & p);
+
+    /**
+     * @brief Put back a pair taken and left untouched
+     *
+     * @param p the pair
+     */
+    void give_back(const pair & p);
+
+    /**
+     * @brief Free the slot of a pair taken and renamed, or lost
+     *
+     * @param p the pair
+     */
+    void release(const pair & p);
+
+    /**
+     * @brief Get the name the host end of a pair has in the pool
+     *
+     * @param p the pair
+     */
+    link_name host_name(const pair & p) const;
+
+    /**
+     * @brief Get the counters
+     */
+    const statistics & stats() const;
+
+protected:
+    /**
+     * @brief Refill the pool if it is below the low watermark or a refill is under way
+     */
+    void on_loop() override;
+
+    /**
+     * @brief Wake up the dispatcher for the first refill, the loop phase does the work
+     */
+    void on_run() override;
+
+    /**
+     * @brief Wake up the dispatcher to retry a failed refill, the loop phase does the work
+     */
+    void on_timer() override;
+
+private:
+    /**
+     * @brief Queue the creation of the pair of a free slot
+     */
+    void create();
+
+    /**
+     * @brief Get the name of an end of the pair of a slot
+     *
+     * @param prefix the name prefix
+     * @param slot the slot
+     */
+    link_name slot_name(const char * prefix, uint16_t slot) const;
+
+    unsigned              id_{ 0 };             ///< the reactor index
+    event_dispatcher     &dispatcher_;          ///< the event dispatcher
+    rtnetlink            &netlink_;             ///< the rtnetlink client
+    size_t                low_{ 0 };            ///< the low watermark
+    size_t                high_{ 0 };           ///< the high watermark
+    std::vector<pair>     ready_{ };            ///< the ready pairs
+    std::vector<uint16_t> free_{ };             ///< the free slots below next_slot_
+    uint16_t              next_slot_{ 0 };      ///< the first slot never used
+    size_t                creating_{ 0 };       ///< the pairs being created
+    bool                  refilling_{ false };  ///< a refill is under way
+    bool                  attached_{ false };   ///< subscribed to the dispatcher
+    statistics            stats_{ };            ///< the pool counters
+
+    static thread_local veth_pool *current_;  ///< the pool of the thread
+};
+
+inline veth_pool * veth_pool::current()
+{
+    return current_;
+}
+
+inline bool veth_pool::enabled() const
+{
+    return high_ != 0;
+}
+
+inline const veth_pool::statistics & veth_pool::stats() const
+{
+    return stats_;
+}
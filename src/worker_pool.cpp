@@ -0,0 +1,185 @@
+#include "worker_pool.h"
+
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Raise a maximum counter
+ */
+void raise(std::atomic<uint64_t> & max, uint64_t value)
+{
+    auto current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief Get the microseconds since a time point
+ */
+uint64_t micros_since(std::chrono::steady_clock::time_point start)
+{
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+}
+
+worker_pool::job::job(worker_pool & pool)
+    : pool{ pool }
+{
+}
+
+void worker_pool::job::on_run()
+{
+    auto const completion = std::move(done);
+    auto const responder = std::move(respond);
+    auto const deferred = response;
+    pool.release(this);
+    if (responder) {
+        responder(deferred);
+        deferred->complete();
+    } else {
+        completion();
+    }
+}
+
+worker_pool::worker_pool(size_t threads, size_t max_queue)
+    : max_queue_{ max_queue }
+{
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this] { run(); });
+    }
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        stopping_ = true;
+    }
+
+    ready_.notify_all();
+    for (auto & t : threads_) {
+        t.join();
+    }
+
+    while (free_) {
+        delete std::exchange(free_, free_->next);
+    }
+}
+
+bool worker_pool::submit(event_dispatcher & dispatcher, work w, std::function<void()> done)
+{
+    return enqueue(dispatcher, std::move(w), std::move(done), nullptr) != nullptr;
+}
+
+bool worker_pool::offload(http_response * response, work w, std::function<void(http_response *)> done)
+{
+    auto const dispatcher = event_dispatcher::current();
+    if (!dispatcher) {
+        return false;
+    }
+
+    auto const j = enqueue(*dispatcher, std::move(w), nullptr, std::move(done));
+    if (!j) {
+        return false;
+    }
+
+    // the completion runs on this thread after the handler returned, the job is not
+    // released before and the worker does not read the response
+    j->response = response->defer();
+    return true;
+}
+
+worker_pool::job * worker_pool::enqueue(event_dispatcher & dispatcher, work && w, std::function<void()> && done,
+                                        std::function<void(http_response *)> && respond)
+{
+    job * j;
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        if (queued_ >= max_queue_ || stopping_) {
+            stats_.refused.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        if (free_) {
+            j = std::exchange(free_, free_->next);
+        } else {
+            j = new job{ *this };
+        }
+
+        j->dispatcher = &dispatcher;
+        j->closure = std::move(w);
+        j->done = std::move(done);
+        j->respond = std::move(respond);
+        j->response = nullptr;
+        j->queued = std::chrono::steady_clock::now();
+        j->next = nullptr;
+        if (tail_) {
+            tail_->next = j;
+        } else {
+            head_ = j;
+        }
+
+        tail_ = j;
+        depth = ++queued_;
+    }
+
+    ready_.notify_one();
+    stats_.submitted.fetch_add(1, std::memory_order_relaxed);
+    stats_.depth.store(depth, std::memory_order_relaxed);
+    raise(stats_.max_depth, depth);
+    return j;
+}
+
+void worker_pool::release(job * j)
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    j->next = free_;
+    free_ = j;
+}
+
+void worker_pool::run()
+{
+    for (;;) {
+        job * j;
+        {
+            std::unique_lock<std::mutex> lock{ mutex_ };
+            ready_.wait(lock, [this] { return stopping_ || head_; });
+            if (!head_) {
+                return;
+            }
+
+            j = head_;
+            head_ = j->next;
+            if (!head_) {
+                tail_ = nullptr;
+            }
+
+            stats_.depth.store(--queued_, std::memory_order_relaxed);
+        }
+
+        auto const wait = micros_since(j->queued);
+        stats_.wait_total.fetch_add(wait, std::memory_order_relaxed);
+        raise(stats_.wait_max, wait);
+
+        // the closure reports its failure through its state, a throw is only counted
+        auto const start = std::chrono::steady_clock::now();
+        stats_.busy.fetch_add(1, std::memory_order_relaxed);
+        try {
+            j->closure();
+        } catch (...) {
+            stats_.failed.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        stats_.busy.fetch_sub(1, std::memory_order_relaxed);
+        stats_.run_total.fetch_add(micros_since(start), std::memory_order_relaxed);
+
+        // the closure and its captures go on the worker, the completion on the dispatcher
+        j->closure = nullptr;
+        j->dispatcher->post(*j);
+    }
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "event_dispatcher.h"
+#include "http_response.h"
+#include "task_queue.h"
+
+/**
+ * @brief The pool of worker threads running the blocking work of the event dispatcher threads
+ *
+ * A job is a closure run on a worker and a completion run on the dispatcher thread that
+ * submitted it, posted back as a task once the closure returned, the dispatcher wakes up
+ * through its notifier. A handler defers its response, submits the job and completes the
+ * response from the completion, its connection waits without blocking the event loop.
+ *
+ * The queue is bounded, a job submitted to a full queue is refused and the caller does
+ * the work inline or answers at once. The job is the node of the queue, a completed job is
+ * kept on a freelist and reused by the next submit, so no job is allocated once the pool
+ * has seen its peak load; only closures too large for the std::function storage still
+ * allocate. The pool is shared by the dispatcher threads, the counters may be read from
+ * any thread.
+ */
+class worker_pool
+{
+public:
+    using work = std::function<void()>;  ///< the closure run on a worker, reports its outcome through the state it shares with the completion
+
+    /**
+     * @brief The pool counters, readable from any thread
+     */
+    struct statistics
+    {
+        std::atomic<uint64_t> submitted{ 0 };   ///< the jobs queued
+        std::atomic<uint64_t> refused{ 0 };     ///< the jobs refused because the queue was full
+        std::atomic<uint64_t> failed{ 0 };      ///< the closures that threw
+        std::atomic<uint64_t> depth{ 0 };       ///< the jobs waiting for a worker
+        std::atomic<uint64_t> max_depth{ 0 };   ///< the deepest the queue has been
+        std::atomic<uint64_t> busy{ 0 };        ///< the workers running a closure
+        std::atomic<uint64_t> wait_total{ 0 };  ///< the sum of the queue waits in microseconds
+        std::atomic<uint64_t> wait_max{ 0 };    ///< the longest queue wait in microseconds
+        std::atomic<uint64_t> run_total{ 0 };   ///< the sum of the closure run times in microseconds
+    };
+
+    /**
+     * @brief Construct a new worker pool object, the workers are started
+     *
+     * @param threads the number of workers
+     * @param max_queue the jobs waiting for a worker, beyond which submit refuses
+     */
+    worker_pool(size_t threads, size_t max_queue);
+
+    /**
+     * @brief Destroy the worker pool object, the queued jobs are run and the workers joined
+     *
+     * The dispatchers of the jobs must still exist, their completions are posted and run
+     * only if the dispatcher is still running. A completion must not run once the pool is
+     * destroyed, its job goes back to the freelist.
+     */
+    ~worker_pool();
+
+    /**
+     * @brief Copy constructor is deleted
+     */
+    worker_pool(const worker_pool &) = delete;
+
+    /**
+     * @brief Copy assignment is deleted
+     */
+    void operator=(const worker_pool &) = delete;
+
+    /**
+     * @brief Queue a job
+     *
+     * @param dispatcher the dispatcher the completion runs on
+     * @param w the closure, run on a worker
+     * @param done the completion, run on the dispatcher thread once the closure returned or threw
+     * @return true if queued
+     * @return false if the queue is full
+     */
+    bool submit(event_dispatcher & dispatcher, work w, std::function<void()> done);
+
+    /**
+     * @brief Run the blocking part of a handler on a worker, called by the handler on its
+     * dispatcher thread
+     *
+     * The response is deferred once the job is queued, the connection waits for it without
+     * blocking the event loop. The completion fills the response on the dispatcher thread
+     * and the response is completed after it, the handler returns true.
+     *
+     * @param response the handler's response
+     * @param w the closure, run on a worker
+     * @param done the completion, called with the deferred response
+     * @return true if queued
+     * @return false if the queue is full or the thread runs no dispatcher, the response is
+     * not deferred and the handler answers it
+     */
+    bool offload(http_response * response, work w, std::function<void(http_response *)> done);
+
+    /**
+     * @brief Get the number of workers
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the counters
+     */
+    const statistics & stats() const;
+
+private:
+    /**
+     * @brief A job, the node of the queue or the freelist and posted back to its dispatcher
+     * as a task
+     */
+    class job
+        : public task
+    {
+    public:
+        explicit job(worker_pool & pool);
+
+        /**
+         * @brief Run the completion, the job goes back to the freelist first
+         */
+        void on_run() override;
+
+        worker_pool                          &pool;                   ///< the pool of the job
+        event_dispatcher                     *dispatcher{ nullptr };  ///< the dispatcher of the completion
+        work                                  closure{ };             ///< the closure
+        std::function<void()>                 done{ };                ///< the completion of submit
+        std::function<void(http_response *)>  respond{ };             ///< the completion of offload
+        http_response                        *response{ nullptr };    ///< the deferred response of offload
+        std::chrono::steady_clock::time_point queued{ };              ///< the time the job was queued
+        job                                  *next{ nullptr };        ///< the next job in the queue or the freelist
+    };
+
+    /**
+     * @brief Queue a job, taken from the freelist or allocated if it is empty
+     *
+     * @param dispatcher the dispatcher the completion runs on
+     * @param w the closure
+     * @param done the completion of submit, empty for offload
+     * @param respond the completion of offload, empty for submit
+     * @return job* the queued job, nullptr if the queue is full
+     */
+    job * enqueue(event_dispatcher & dispatcher, work && w, std::function<void()> && done,
+                  std::function<void(http_response *)> && respond);
+
+    /**
+     * @brief Put a job back on the freelist, called by the dispatcher thread of the job
+     */
+    void release(job * j);
+
+    /**
+     * @brief The worker thread entry
+     */
+    void run();
+
+    size_t                   max_queue_{ 0 };     ///< the queue bound
+    std::mutex               mutex_{ };           ///< guards the queue, the freelist and the stop flag
+    std::condition_variable  ready_{ };           ///< signaled as jobs are queued or the pool stops
+    job                     *head_{ nullptr };    ///< the oldest job waiting for a worker
+    job                     *tail_{ nullptr };    ///< the newest job waiting for a worker
+    size_t                   queued_{ 0 };        ///< the jobs waiting for a worker
+    job                     *free_{ nullptr };    ///< the last released job
+    bool                     stopping_{ false };  ///< the workers exit once the queue is empty
+    std::vector<std::thread> threads_{ };         ///< the workers
+    statistics               stats_{ };           ///< the pool counters
+};
+
+inline size_t worker_pool::size() const
+{
+    return threads_.size();
+}
+
+inline const worker_pool::statistics & worker_pool::stats() const
+{
+    return stats_;
+}